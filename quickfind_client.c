@@ -40,6 +40,38 @@ static bool quickfind__has_valid_item(quickfind_results *results) {
     return true;
 }
 
+// NOTE(rune): Waits for a pipe connection, or returns an error. If yield_to_next_thread is set,
+// gives up when another thread has called quickfind_open since query_inc_begin.
+static quickfind_error quickfind__connect(HANDLE *pipe, uint32_t connection_timeout_millis, u32 query_inc_begin, bool yield_to_next_thread) {
+    while (1) {
+        // NOTE(rune): Check if another thread has called quickfind_open while this thread was waiting.
+        if (!query_inc_begin != quickfind_g_query_inc && yield_to_next_thread) {
+            return QUICKFIND_ERROR_CANCELLED;
+        }
+
+        *pipe = CreateFileA(QUICKFIND_PIPE_NAME,
+                            GENERIC_READ |  // read and write access
+                            GENERIC_WRITE,
+                            0,              // no sharing
+                            null,           // default security attributes
+                            OPEN_EXISTING,  // opens existing pipe
+                            0,              // default attributes
+                            null);          // no template file
+
+        if (*pipe != INVALID_HANDLE_VALUE) {
+            return QUICKFIND_OK;
+        }
+
+        if (GetLastError() != ERROR_PIPE_BUSY) {
+            return QUICKFIND_ERROR_COULD_NOT_CONNECT_TO_SERVER;
+        }
+
+        if (!WaitNamedPipeA(QUICKFIND_PIPE_NAME, connection_timeout_millis)) {
+            return QUICKFIND_ERROR_CONNECTION_TIMEOUT;
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////////
 // rune: Public API
 
@@ -63,34 +95,9 @@ QUICKFIND_API quickfind_error quickfind_open(quickfind_params *params, quickfind
     // rune: Wait for pipe connection or return an error.
 
     HANDLE pipe;
-    {
-        while (1) {
-            // NOTE(rune): Check if another thread has called quickfind_open while this thread was waiting.
-            if (!query_inc_begin != quickfind_g_query_inc && yield_to_next_thread) {
-                return QUICKFIND_ERROR_CANCELLED;
-            }
-
-            pipe = CreateFileA(QUICKFIND_PIPE_NAME,
-                               GENERIC_READ |  // read and write access
-                               GENERIC_WRITE,
-                               0,              // no sharing
-                               null,           // default security attributes
-                               OPEN_EXISTING,  // opens existing pipe
-                               0,              // default attributes
-                               null);          // no template file
-
-            if (pipe != INVALID_HANDLE_VALUE) {
-                break;
-            }
-
-            if (GetLastError() != ERROR_PIPE_BUSY) {
-                return QUICKFIND_ERROR_COULD_NOT_CONNECT_TO_SERVER;
-            }
-
-            if (!WaitNamedPipeA(QUICKFIND_PIPE_NAME, connection_timeout_millis)) {
-                return QUICKFIND_ERROR_CONNECTION_TIMEOUT;
-            }
-        }
+    error = quickfind__connect(&pipe, connection_timeout_millis, query_inc_begin, yield_to_next_thread);
+    if (error) {
+        return error;
     }
 
     ////////////////////////////////////////////////////////////////
@@ -104,9 +111,11 @@ QUICKFIND_API quickfind_error quickfind_open(quickfind_params *params, quickfind
     if (!error) {
         r->msg->head.type = MSG_TYPE_QUERY_REQUEST;
         r->msg->head.query_request.flags        = params->flags;
+        r->msg->head.query_request.sort         = params->sort;
         r->msg->head.query_request.return_count = params->return_count;
         r->msg->head.query_request.skip_count   = params->skip_count;
         r->msg->head.query_request.stop_count   = params->stop_count;
+        r->msg->head.query_request.cursor       = params->cursor;
 
         u32 body_size = min(sizeof(r->msg->body), params->text_length);
         r->msg->head.body_size = body_size;
@@ -166,6 +175,14 @@ QUICKFIND_API uint64_t quickfind_get_found_count(quickfind_results *results) {
     return ret;
 }
 
+QUICKFIND_API quickfind_cursor quickfind_get_next_cursor(quickfind_results *results) {
+    quickfind_cursor ret = { 0 };
+    if (results) {
+        ret = results->msg->head.query_response.next_cursor;
+    }
+    return ret;
+}
+
 QUICKFIND_API bool quickfind_next(quickfind_results *r) {
     if (!r) {
         return false;
@@ -224,3 +241,68 @@ QUICKFIND_API uint64_t quickfind_get_result_id(quickfind_results *results) {
     }
     return ret;
 }
+
+QUICKFIND_API uint64_t quickfind_get_result_size(quickfind_results *results) {
+    uint64_t ret = 0;
+    if (quickfind__has_valid_item(results)) {
+        ret = results->current_item->size;
+    }
+    return ret;
+}
+
+QUICKFIND_API uint64_t quickfind_get_result_modification_time(quickfind_results *results) {
+    uint64_t ret = 0;
+    if (quickfind__has_valid_item(results)) {
+        ret = results->current_item->modification_time;
+    }
+    return ret;
+}
+
+QUICKFIND_API quickfind_error quickfind_get_stats(quickfind_stats *stats, uint32_t connection_timeout_millis) {
+    quickfind_error error = QUICKFIND_OK;
+    memset(stats, 0, sizeof(*stats));
+
+    if (connection_timeout_millis == 0) {
+        connection_timeout_millis = INFINITE;
+    }
+
+    HANDLE pipe;
+    error = quickfind__connect(&pipe, connection_timeout_millis, 0, false);
+    if (error) {
+        return error;
+    }
+
+    msg *m = quickfind__alloc(sizeof(msg));
+    if (!m) {
+        error = QUICKFIND_ERROR_OUT_OF_MEMORY;
+    }
+
+    if (!error) {
+        memset(&m->head, 0, sizeof(m->head));
+        m->head.type = MSG_TYPE_STATS_REQUEST;
+        error = pipe_write_msg(pipe, m);
+    }
+
+    if (!error) {
+        error = pipe_read_msg(pipe, m);
+    }
+
+    if (!error) {
+        if (m->head.type != MSG_TYPE_STATS_RESPONSE) {
+            error = COALESCE(m->head.error, QUICKFIND_ERROR_INVALID_RESPONSE);
+        }
+    }
+
+    if (!error) {
+        stats->query_count             = m->head.stats_response.query_count;
+        stats->query_cache_hit_count   = m->head.stats_response.query_cache_hit_count;
+        stats->query_cache_miss_count  = m->head.stats_response.query_cache_miss_count;
+        stats->query_cache_entry_count = m->head.stats_response.query_cache_entry_count;
+        stats->query_cache_size        = m->head.stats_response.query_cache_size;
+    }
+
+    CloseHandle(pipe);
+    quickfind__free(m);
+
+    return error;
+}
@@ -47,9 +47,35 @@ typedef enum quickfind_flags {
     QUICKFIND_FLAG_CASE_SENSITIVE   = 0x1,
     QUICKFIND_FLAG_FULLNAME         = 0x2,
     QUICKFIND_FLAG_ONLY_FILES       = 0x4,
-    QUICKFIND_FLAG_ONLY_DIRECTORIES = 0x8
+    QUICKFIND_FLAG_ONLY_DIRECTORIES = 0x8,
+    QUICKFIND_FLAG_GLOB             = 0x10,     // Text is a glob pattern matched against the whole name. '*' matches any run of characters, '?' matches a single character.
+    QUICKFIND_FLAG_REGEX            = 0x20,     // Text is a regular expression, which must match somewhere in the name. With QUICKFIND_FLAG_FULLNAME it must match the whole name.
+    QUICKFIND_FLAG_FUZZY            = 0x40,     // Characters in text must appear in the name in order, but not necessarily next to each other. Results are ordered by match score.
+    QUICKFIND_FLAG_TYPOS_1          = 0x80,     // Also match names where text occurs with one typo (a single inserted, deleted or replaced character).
+    QUICKFIND_FLAG_TYPOS_2          = 0x100     // Also match names where text occurs with up to two typos. Takes precedence over QUICKFIND_FLAG_TYPOS_1.
 } quickfind_flags;
 
+typedef enum quickfind_sort {
+    QUICKFIND_SORT_NONE             = 0x0,      // Results are returned in database order, or by match score with QUICKFIND_FLAG_FUZZY.
+    QUICKFIND_SORT_NAME             = 0x1,      // Case insensitive, by name.
+    QUICKFIND_SORT_PATH             = 0x2,      // Case insensitive, by path of the parent directory and then by name.
+    QUICKFIND_SORT_SIZE             = 0x3,      // By file size in bytes.
+    QUICKFIND_SORT_DATE             = 0x4,      // By modification time.
+    QUICKFIND_SORT_RELEVANCE        = 0x5,      // Best matches first: whole name, then prefix, then word start, then anywhere in the name. Ties go to shallower paths and shorter names.
+
+    QUICKFIND_SORT_DESCENDING       = 0x100     // Combine with one of the keys above to reverse the order.
+} quickfind_sort;
+
+typedef struct quickfind_cursor quickfind_cursor;
+struct quickfind_cursor {
+    // NOTE(rune): Opaque data used by the server. A zeroed cursor is no cursor.
+    uint64_t name_offset;
+    uint64_t record_index;
+    uint64_t found_count;
+    uint64_t generation;
+    uint64_t query_hash;
+};
+
 typedef struct quickfind_params quickfind_params;
 struct quickfind_params {
     char    *text;
@@ -60,6 +86,13 @@ struct quickfind_params {
     uint32_t return_count;
     uint64_t skip_count;
     uint64_t stop_count;
+
+    // NOTE(rune): Optional. Pass the cursor of the previous page, and skip_count of the next page,
+    // to continue scanning where the previous page stopped, instead of counting skip_count results
+    // again. The server rescans if the cursor is for another query, or the database has changed.
+    quickfind_cursor cursor;
+
+    quickfind_sort sort;
 };
 
 typedef struct quickfind_results quickfind_results;
@@ -70,6 +103,15 @@ struct quickfind_results {
     struct msg               *msg;
 };
 
+typedef struct quickfind_stats quickfind_stats;
+struct quickfind_stats {
+    uint64_t query_count;               // Queries received since the server started.
+    uint64_t query_cache_hit_count;     // Queries answered from the query cache.
+    uint64_t query_cache_miss_count;    // Queries which had to run, because the cache had no entry for the current database generation.
+    uint32_t query_cache_entry_count;
+    uint64_t query_cache_size;          // Bytes of cached request text and response bodies.
+};
+
 ////////////////////////////////////////////////////////////////
 // rune: Functions
 
@@ -78,8 +120,12 @@ QUICKFIND_API void                quickfind_close(quickfind_results *results);
 QUICKFIND_API bool                quickfind_next(quickfind_results *results);
 QUICKFIND_API uint32_t            quickfind_get_return_count(quickfind_results *results);
 QUICKFIND_API uint64_t            quickfind_get_found_count(quickfind_results *results);
+QUICKFIND_API quickfind_cursor    quickfind_get_next_cursor(quickfind_results *results);
 QUICKFIND_API char *              quickfind_get_result_full_path(quickfind_results *results);
 QUICKFIND_API uint32_t            quickfind_get_result_attributes(quickfind_results *results);
 QUICKFIND_API uint64_t            quickfind_get_result_id(quickfind_results *results);
+QUICKFIND_API uint64_t            quickfind_get_result_size(quickfind_results *results);
+QUICKFIND_API uint64_t            quickfind_get_result_modification_time(quickfind_results *results);
+QUICKFIND_API quickfind_error     quickfind_get_stats(quickfind_stats *stats, uint32_t connection_timeout_millis);
 
 #endif
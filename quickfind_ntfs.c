@@ -216,6 +216,8 @@ static void ntfs_parse_mft_record(ntfs_mft_iter *iterator, ntfs_mft_record *reco
                 parsed_record->parent_id     = parent_id;
                 parsed_record->name          = name_attribute->file_name;
                 parsed_record->name_len   = name_attribute->file_name_length;
+                parsed_record->size              = name_attribute->real_size;
+                parsed_record->modification_time = name_attribute->modification_time;
             } else {
                 parsed_record->parse_error = NTFS_ERROR_PASRE_FILE_NAME_ATTRIBUTE_MISSING;
             }
@@ -376,7 +378,49 @@ static void ntfs_usn_mark_ignore(change_list changes) {
                 if (ci == CHANGE_TYPE_UPDATE && cj == CHANGE_TYPE_INSERT) {
                     j->ignore = true;
                 }
+
+                // NOTE(rune): Ignore modify if the file has any other change, or a later modify, since inserts,
+                // updates and the last modify all read the same file info, and a deleted file needs none.
+                if (cj == CHANGE_TYPE_MODIFY && (ci != CHANGE_TYPE_MODIFY || j->usn < i->usn)) {
+                    j->ignore = true;
+                }
+            }
+        }
+    }
+}
+
+// NOTE(rune): The journal only says that the data or basic info of a file changed, so the new size and
+// last write time are read from the file itself. Called after ntfs_usn_mark_ignore, since opening a
+// file by id is much slower than reading the journal.
+static void ntfs_usn_read_file_info(HANDLE volume, change_list changes) {
+    for (change *change = changes.first; change; change = change->next) {
+        if (change->ignore || change->type == CHANGE_TYPE_DELETE) {
+            continue;
+        }
+
+        FILE_ID_DESCRIPTOR descriptor = { 0 };
+        descriptor.dwSize          = sizeof(descriptor);
+        descriptor.Type            = FileIdType;
+        descriptor.FileId.QuadPart = (LONGLONG)change->id.id64;
+
+        HANDLE file = OpenFileById(volume,
+                                   &descriptor,
+                                   FILE_READ_ATTRIBUTES,
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                   null,
+                                   FILE_FLAG_BACKUP_SEMANTICS);
+
+        if (file != INVALID_HANDLE_VALUE) {
+            FILE_BASIC_INFO basic_info       = { 0 };
+            FILE_STANDARD_INFO standard_info = { 0 };
+            if (GetFileInformationByHandleEx(file, FileBasicInfo, &basic_info, sizeof(basic_info)) &&
+                GetFileInformationByHandleEx(file, FileStandardInfo, &standard_info, sizeof(standard_info))) {
+                change->has_file_info     = true;
+                change->size              = standard_info.Directory ? 0 : standard_info.EndOfFile.QuadPart;
+                change->modification_time = basic_info.LastWriteTime.QuadPart;
             }
+
+            CloseHandle(file);
         }
     }
 }
@@ -473,7 +517,9 @@ static change_list ntfs_get_usn_journal_changes(buffer *buffer, db *database) {
 
                 READ_USN_JOURNAL_DATA_V1 read_data_cmd = { 0 };
                 read_data_cmd.StartUsn = database->latest_usn;
-                read_data_cmd.ReasonMask = USN_REASON_FILE_CREATE | USN_REASON_FILE_DELETE | USN_REASON_RENAME_NEW_NAME;
+                read_data_cmd.ReasonMask = (USN_REASON_FILE_CREATE | USN_REASON_FILE_DELETE | USN_REASON_RENAME_NEW_NAME |
+                                            USN_REASON_DATA_EXTEND | USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_TRUNCATION |
+                                            USN_REASON_BASIC_INFO_CHANGE);
                 read_data_cmd.ReturnOnlyOnClose = 0;
                 read_data_cmd.Timeout = 1;
                 read_data_cmd.BytesToWaitFor = 4096;
@@ -513,9 +559,10 @@ static change_list ntfs_get_usn_journal_changes(buffer *buffer, db *database) {
 
                             zero_struct(change);
 
-                            change_type change_type = (usn_record_v3->Reason & USN_REASON_FILE_DELETE ? CHANGE_TYPE_DELETE :
-                                                       usn_record_v3->Reason & USN_REASON_FILE_CREATE ? CHANGE_TYPE_INSERT :
-                                                       CHANGE_TYPE_UPDATE);
+                            change_type change_type = (usn_record_v3->Reason & USN_REASON_FILE_DELETE     ? CHANGE_TYPE_DELETE :
+                                                       usn_record_v3->Reason & USN_REASON_FILE_CREATE     ? CHANGE_TYPE_INSERT :
+                                                       usn_record_v3->Reason & USN_REASON_RENAME_NEW_NAME ? CHANGE_TYPE_UPDATE :
+                                                       CHANGE_TYPE_MODIFY);
 
                             change->usn          = usn_record_v3->Usn;
                             change->type         = change_type;
@@ -523,6 +570,7 @@ static change_list ntfs_get_usn_journal_changes(buffer *buffer, db *database) {
                             change->parent_id    = ntfs_id64_from_id128(usn_record_v3->ParentFileReferenceNumber);
                             change->wname_length = usn_record_v3->FileNameLength / 2;
                             change->attributes   = usn_record_v3->FileAttributes;
+                            change->timestamp    = usn_record_v3->TimeStamp.QuadPart;
                             change->ignore       = false;
 
                             change->wname = buffer_append(buffer, usn_record_v3->FileNameLength);
@@ -551,8 +599,12 @@ static change_list ntfs_get_usn_journal_changes(buffer *buffer, db *database) {
         debug_log_error_win32("CreateFileA");
     }
 
-    CloseHandle(handle);
     ntfs_usn_mark_ignore(changes);
+    if (handle != INVALID_HANDLE_VALUE) {
+        ntfs_usn_read_file_info(handle, changes);
+    }
+
+    CloseHandle(handle);
 
     return changes;
 }
@@ -45,6 +45,11 @@ struct ntfs_parsed_mft_record {
     wchar       *name;
     u32          name_len;
     u32          attributes;
+
+    // NOTE(rune): Taken from the $FILE_NAME attribute, which NTFS only updates when the name
+    // changes, so they can lag behind $STANDARD_INFORMATION and $DATA.
+    u64          size;
+    u64          modification_time;
 };
 
 typedef struct ntfs_parsed_data_run ntfs_parsed_datarun;
@@ -261,6 +266,7 @@ static void       ntfs_mft_iter_close(ntfs_mft_iter *iterator);
 
 // rune: Helpers
 static void      ntfs_usn_mark_ignore(change_list changes);
+static void      ntfs_usn_read_file_info(HANDLE volume, change_list changes);
 static record_id ntfs_id64_from_id128(FILE_ID_128 id128);
 
 static void      change_list_add(change_list *list, change *node);
@@ -254,815 +254,7476 @@ static inline u32 count_bits_set(u32 value) {
     return __popcnt(value);
 }
 
-static char *simd_memmem_count_zeroes(char *s, usize n, char *needle, usize k, usize *zero_count) {
+static inline u64 count_trailing_zeroes64(u64 value) {
+    return _tzcnt_u64(value);
+}
+
+static inline u64 clear_leftmost_set64(u64 value) {
+    return value & (value - 1);
+}
+
+static inline u64 count_bits_set64(u64 value) {
+    return __popcnt64(value);
+}
+
+// NOTE(rune): The SSE2 and scalar kernels must also run on CPUs without the POPCNT instruction.
+static inline u32 count_bits_set_portable(u32 value) {
+    value = value - ((value >> 1) & 0x55555555);
+    value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+    return (((value + (value >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+static inline char ascii_tolower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline char ascii_toupper(char c) {
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+// NOTE(rune): Decodes a single delta, which may be escaped, and advances *i past it.
+static inline u32 decode_delta(u16 *deltas, usize *i) {
+    u32 delta = deltas[(*i)++];
+    if (delta == TRIGRAM_DELTA_ESCAPE) {
+        delta = (u32)deltas[*i] | ((u32)deltas[*i + 1] << 16);
+        *i += 2;
+    }
+    return delta;
+}
+
+static void teddy_compile(teddy *t, char **patterns, usize *pattern_lengths, u32 pattern_count) {
+    assert(pattern_count > 0 && pattern_count <= TEDDY_MAX_PATTERNS);
+
+    zero_struct(t);
+    t->pattern_count    = pattern_count;
+    t->fingerprint_size = TEDDY_MAX_FINGERPRINT_SIZE;
+
+    for (u32 i = 0; i < pattern_count; i++) {
+        assert(pattern_lengths[i] > 0);
+        t->patterns[i]        = patterns[i];
+        t->pattern_lengths[i] = pattern_lengths[i];
+        t->fingerprint_size   = min(t->fingerprint_size, (u32)pattern_lengths[i]);
+    }
+
+    for (u32 i = 0; i < pattern_count; i++) {
+        u8 bucket_bit = (u8)(1 << (i % TEDDY_BUCKET_COUNT));
+
+        for (u32 j = 0; j < t->fingerprint_size; j++) {
+            u8 c = (u8)patterns[i][j];
+            t->lo[j][c & 0x0F] |= bucket_bit;
+            t->hi[j][c >> 4]   |= bucket_bit;
+        }
+    }
+}
+
+// NOTE(rune): Checks all patterns in the candidate buckets against the text at s.
+static inline bool teddy_verify(teddy *t, char *s, u32 buckets) {
+    while (buckets != 0) {
+        u32 bucket = count_trailing_zeroes(buckets);
+
+        for (u32 i = bucket; i < t->pattern_count; i += TEDDY_BUCKET_COUNT) {
+            if (memcmp(s, t->patterns[i], t->pattern_lengths[i]) == 0) {
+                return true;
+            }
+        }
+
+        buckets = clear_leftmost_set(buckets);
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: SIMD scalar kernels
+
+static char *simd_memmem_count_zeroes_scalar(char *s, usize n, char *needle, usize k, usize *zero_count) {
     assert(k > 1);
 
     *zero_count = 0;
 
-    __m256i first = _mm256_set1_epi8(needle[0]);
-    __m256i last = _mm256_set1_epi8(needle[k - 1]);
-    __m256i zero = _mm256_set1_epi8('\0');
+    for (usize i = 0; i < n; i++) {
+        if (s[i] == needle[0] && s[i + k - 1] == needle[k - 1]) {
+            if (memcmp(s + i + 1, needle + 1, k - 2) == 0) {
+                return s + i;
+            }
+        }
 
-    for (usize i = 0; i < n; i += 32) {
-        __m256i block_first = _mm256_loadu_si256((__m256i *)(s + i));
-        __m256i block_last = _mm256_loadu_si256((__m256i *)(s + i + k - 1));
+        *zero_count += (s[i] == '\0');
+    }
 
-        __m256i eq_first = _mm256_cmpeq_epi8(first, block_first);
-        __m256i eq_last = _mm256_cmpeq_epi8(last, block_last);
-        __m256i eq_zero = _mm256_cmpeq_epi8(zero, block_first);
+    return null;
+}
 
-        u32 mask_needle = _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));
-        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+static char *simd_memmem_count_zeroes_nocase_scalar(char *s, usize n, char *needle, usize k, usize *zero_count) {
+    assert(k > 1);
+
+    *zero_count = 0;
+
+    char first = ascii_tolower(needle[0]);
+    char last  = ascii_tolower(needle[k - 1]);
+
+    for (usize i = 0; i < n; i++) {
+        if (ascii_tolower(s[i]) == first && ascii_tolower(s[i + k - 1]) == last) {
+            if (_memicmp(s + i + 1, needle + 1, k - 2) == 0) {
+                return s + i;
+            }
+        }
+
+        *zero_count += (s[i] == '\0');
+    }
+
+    return null;
+}
+
+static char *simd_memmem_anchored_count_zeroes_scalar(char *s, usize n, char *needle, usize k, usize anchor_a, usize anchor_b, usize *zero_count) {
+    assert(anchor_a < anchor_b && anchor_b < k);
+
+    *zero_count = 0;
+
+    for (usize i = 0; i < n; i++) {
+        if (s[i + anchor_a] == needle[anchor_a] && s[i + anchor_b] == needle[anchor_b]) {
+            if (memcmp(s + i, needle, k) == 0) {
+                return s + i;
+            }
+        }
+
+        *zero_count += (s[i] == '\0');
+    }
+
+    return null;
+}
+
+static char *simd_memchr_count_zeroes_scalar(char *s, usize n, char c, usize *zero_count) {
+    *zero_count = 0;
+
+    for (usize i = 0; i < n; i++) {
+        if (s[i] == c) {
+            return s + i;
+        }
+
+        *zero_count += (s[i] == '\0');
+    }
+
+    return null;
+}
+
+static char *simd_memchr_count_zeroes_nocase_scalar(char *s, usize n, char c, usize *zero_count) {
+    *zero_count = 0;
+
+    char lower = ascii_tolower(c);
+
+    for (usize i = 0; i < n; i++) {
+        if (ascii_tolower(s[i]) == lower) {
+            return s + i;
+        }
+
+        *zero_count += (s[i] == '\0');
+    }
+
+    return null;
+}
+
+static char *simd_memchr_scalar(char *s, usize n, char c) {
+    for (usize i = 0; i < n; i++) {
+        if (s[i] == c) {
+            return s + i;
+        }
+    }
+
+    return null;
+}
+
+static usize simd_count_zeroes_scalar(char *s, usize n) {
+    usize zero_count = 0;
+    for (usize i = 0; i < n; i++) {
+        zero_count += (s[i] == '\0');
+    }
+    return zero_count;
+}
+
+// NOTE(rune): Also used at the SSE2 level, since the nibble lookups need the SSSE3 shuffle.
+static char *simd_teddy_count_zeroes_scalar(char *s, usize n, teddy *t, usize *zero_count) {
+    *zero_count = 0;
+
+    for (usize i = 0; i < n; i++) {
+        u32 buckets = 0xFF;
+        for (u32 j = 0; j < t->fingerprint_size; j++) {
+            u8 c = (u8)s[i + j];
+            buckets &= t->lo[j][c & 0x0F] & t->hi[j][c >> 4];
+        }
+
+        if (buckets != 0 && teddy_verify(t, s + i, buckets)) {
+            return s + i;
+        }
+
+        *zero_count += (s[i] == '\0');
+    }
+
+    return null;
+}
+
+static usize simd_decode_deltas_scalar(u16 *deltas, usize delta_count, u32 base, u32 *out) {
+    usize out_count = 0;
+    usize i = 0;
+    u32 value = base;
+
+    while (i < delta_count) {
+        value += decode_delta(deltas, &i);
+        out[out_count++] = value;
+    }
+
+    return out_count;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: SIMD SSE2 kernels
+
+// NOTE(rune): Candidates are verified against the needle preloaded into two registers, instead of
+// with memcmp. Needles longer than 32 bytes compare the rest with memcmp, which almost never runs,
+// since few false candidates match the first 32 bytes. The needle itself is not padded, so it is
+// copied to the stack before it is loaded.
+typedef struct simd_needle_sse2 simd_needle_sse2;
+struct simd_needle_sse2 {
+    __m128i lo;
+    __m128i hi;
+    u32     lo_mask;
+    u32     hi_mask;
+};
+
+static simd_needle_sse2 simd_needle_load_sse2(char *needle, usize k) {
+    char padded[32] = { 0 };
+    memcpy(padded, needle, min(k, sizeof(padded)));
+
+    simd_needle_sse2 result;
+    result.lo      = _mm_loadu_si128((__m128i *)(padded + 0));
+    result.hi      = _mm_loadu_si128((__m128i *)(padded + 16));
+    result.lo_mask = k >= 16 ? 0xFFFF : (1u << k) - 1;
+    result.hi_mask = k >= 32 ? 0xFFFF : k > 16 ? (1u << (k - 16)) - 1 : 0;
+    return result;
+}
+
+static inline bool simd_needle_verify_sse2(simd_needle_sse2 *v, char *s, char *needle, usize k) {
+    u32 eq_lo = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(s + 0)), v->lo));
+    if ((eq_lo & v->lo_mask) != v->lo_mask) {
+        return false;
+    }
+
+    if (v->hi_mask) {
+        u32 eq_hi = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(s + 16)), v->hi));
+        if ((eq_hi & v->hi_mask) != v->hi_mask) {
+            return false;
+        }
+    }
+
+    return k <= 32 || memcmp(s + 32, needle + 32, k - 32) == 0;
+}
+
+static char *simd_memmem_count_zeroes_sse2(char *s, usize n, char *needle, usize k, usize *zero_count) {
+    assert(k > 1);
+
+    *zero_count = 0;
+
+    simd_needle_sse2 verify = simd_needle_load_sse2(needle, k);
+
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[k - 1]);
+    __m128i zero = _mm_set1_epi8('\0');
+
+    for (usize i = 0; i < n; i += 16) {
+        __m128i block_first = _mm_loadu_si128((__m128i *)(s + i));
+        __m128i block_last = _mm_loadu_si128((__m128i *)(s + i + k - 1));
+
+        __m128i eq_first = _mm_cmpeq_epi8(first, block_first);
+        __m128i eq_last = _mm_cmpeq_epi8(last, block_last);
+        __m128i eq_zero = _mm_cmpeq_epi8(zero, block_first);
+
+        u32 mask_needle = _mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+        u32 mask_zero = _mm_movemask_epi8(eq_zero);
 
         while (mask_needle != 0) {
             u32 bitpos = count_trailing_zeroes(mask_needle);
 
-            if (memcmp(s + i + bitpos + 1, needle + 1, k - 2) == 0) {
-                *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+            if (simd_needle_verify_sse2(&verify, s + i + bitpos, needle, k)) {
+                *zero_count += count_bits_set_portable(mask_zero & ~(0xFFFFFFFF << bitpos));
                 return s + i + bitpos;
             }
 
             mask_needle = clear_leftmost_set(mask_needle);
         }
 
-        *zero_count += count_bits_set(mask_zero);
+        *zero_count += count_bits_set_portable(mask_zero);
     }
 
     return null;
 }
 
-static char *simd_memmem_count_zeroes_nocase(char *s, usize n, char *needle, usize k, usize *zero_count) {
+static char *simd_memmem_count_zeroes_nocase_sse2(char *s, usize n, char *needle, usize k, usize *zero_count) {
     assert(k > 1);
 
     *zero_count = 0;
 
-    __m256i lower_first = _mm256_set1_epi8(tolower(needle[0]));
-    __m256i lower_last = _mm256_set1_epi8(tolower(needle[k - 1]));
-
-    __m256i upper_first = _mm256_set1_epi8(toupper(needle[0]));
-    __m256i upper_last = _mm256_set1_epi8(toupper(needle[k - 1]));
+    __m128i lower_first = _mm_set1_epi8(ascii_tolower(needle[0]));
+    __m128i lower_last = _mm_set1_epi8(ascii_tolower(needle[k - 1]));
 
-    __m256i zero = _mm256_set1_epi8('\0');
+    __m128i upper_first = _mm_set1_epi8(ascii_toupper(needle[0]));
+    __m128i upper_last = _mm_set1_epi8(ascii_toupper(needle[k - 1]));
 
-    for (usize i = 0; i < n; i += 32) {
-        __m256i block_first = _mm256_loadu_si256((__m256i *)(s + i));
-        __m256i block_last = _mm256_loadu_si256((__m256i *)(s + i + k - 1));
+    __m128i zero = _mm_set1_epi8('\0');
 
-        __m256i eq_lower_first = _mm256_cmpeq_epi8(lower_first, block_first);
-        __m256i eq_lower_last = _mm256_cmpeq_epi8(lower_last, block_last);
-        __m256i eq_upper_first = _mm256_cmpeq_epi8(upper_first, block_first);
-        __m256i eq_upper_last = _mm256_cmpeq_epi8(upper_last, block_last);
+    for (usize i = 0; i < n; i += 16) {
+        __m128i block_first = _mm_loadu_si128((__m128i *)(s + i));
+        __m128i block_last = _mm_loadu_si128((__m128i *)(s + i + k - 1));
 
-        __m256i eq_first = _mm256_or_si256(eq_lower_first, eq_upper_first);
-        __m256i eq_last = _mm256_or_si256(eq_lower_last, eq_upper_last);
-        __m256i eq_zero = _mm256_cmpeq_epi8(zero, block_first);
+        __m128i eq_first = _mm_or_si128(_mm_cmpeq_epi8(lower_first, block_first), _mm_cmpeq_epi8(upper_first, block_first));
+        __m128i eq_last = _mm_or_si128(_mm_cmpeq_epi8(lower_last, block_last), _mm_cmpeq_epi8(upper_last, block_last));
+        __m128i eq_zero = _mm_cmpeq_epi8(zero, block_first);
 
-        u32 mask_needle = _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));;
-        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+        u32 mask_needle = _mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+        u32 mask_zero = _mm_movemask_epi8(eq_zero);
 
         while (mask_needle != 0) {
             u32 bitpos = count_trailing_zeroes(mask_needle);
 
             if (_memicmp(s + i + bitpos + 1, needle + 1, k - 2) == 0) {
-                *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+                *zero_count += count_bits_set_portable(mask_zero & ~(0xFFFFFFFF << bitpos));
                 return s + i + bitpos;
             }
 
             mask_needle = clear_leftmost_set(mask_needle);
         }
 
-        *zero_count += count_bits_set(mask_zero);
+        *zero_count += count_bits_set_portable(mask_zero);
     }
 
     return null;
 }
 
-static char *simd_memchr_count_zeroes(char *s, usize n, char c, usize *zero_count) {
+static char *simd_memmem_anchored_count_zeroes_sse2(char *s, usize n, char *needle, usize k, usize anchor_a, usize anchor_b, usize *zero_count) {
+    assert(anchor_a < anchor_b && anchor_b < k);
+
     *zero_count = 0;
 
-    __m256i first = _mm256_set1_epi8(c);
-    __m256i zero = _mm256_set1_epi8('\0');
+    simd_needle_sse2 verify = simd_needle_load_sse2(needle, k);
 
-    for (usize i = 0; i < n; i += 32) {
-        __m256i block   = _mm256_loadu_si256((__m256i *)(s + i));
-        __m256i eq      = _mm256_cmpeq_epi8(first, block);
-        __m256i eq_zero = _mm256_cmpeq_epi8(zero, block);
+    __m128i a = _mm_set1_epi8(needle[anchor_a]);
+    __m128i b = _mm_set1_epi8(needle[anchor_b]);
+    __m128i zero = _mm_set1_epi8('\0');
 
-        u32 mask_needle = _mm256_movemask_epi8(eq);
-        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+    for (usize i = 0; i < n; i += 16) {
+        __m128i block = _mm_loadu_si128((__m128i *)(s + i));
+        __m128i block_a = _mm_loadu_si128((__m128i *)(s + i + anchor_a));
+        __m128i block_b = _mm_loadu_si128((__m128i *)(s + i + anchor_b));
+
+        __m128i eq_a = _mm_cmpeq_epi8(a, block_a);
+        __m128i eq_b = _mm_cmpeq_epi8(b, block_b);
+        __m128i eq_zero = _mm_cmpeq_epi8(zero, block);
+
+        u32 mask_needle = _mm_movemask_epi8(_mm_and_si128(eq_a, eq_b));
+        u32 mask_zero = _mm_movemask_epi8(eq_zero);
 
         while (mask_needle != 0) {
             u32 bitpos = count_trailing_zeroes(mask_needle);
-            *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
 
-            return s + i + bitpos;
+            if (simd_needle_verify_sse2(&verify, s + i + bitpos, needle, k)) {
+                *zero_count += count_bits_set_portable(mask_zero & ~(0xFFFFFFFF << bitpos));
+                return s + i + bitpos;
+            }
+
+            mask_needle = clear_leftmost_set(mask_needle);
         }
 
-        *zero_count += count_bits_set(mask_zero);
+        *zero_count += count_bits_set_portable(mask_zero);
     }
 
     return null;
 }
 
-static char *simd_memchr_count_zeroes_nocase(char *s, usize n, char c, usize *zero_count) {
+static char *simd_memchr_count_zeroes_sse2(char *s, usize n, char c, usize *zero_count) {
     *zero_count = 0;
 
-    __m256i lower = _mm256_set1_epi8(tolower(c));
-    __m256i upper = _mm256_set1_epi8(toupper(c));
-    __m256i zero = _mm256_set1_epi8('\0');
-
-    for (usize i = 0; i < n; i += 32) {
-        __m256i block = _mm256_loadu_si256((__m256i *)(s + i));
+    __m128i first = _mm_set1_epi8(c);
+    __m128i zero = _mm_set1_epi8('\0');
 
-        __m256i eq_lower = _mm256_cmpeq_epi8(lower, block);
-        __m256i eq_upper = _mm256_cmpeq_epi8(upper, block);
-        __m256i eq       = _mm256_or_si256(eq_lower, eq_upper);
-        __m256i eq_zero  = _mm256_cmpeq_epi8(zero, block);
+    for (usize i = 0; i < n; i += 16) {
+        __m128i block   = _mm_loadu_si128((__m128i *)(s + i));
+        __m128i eq      = _mm_cmpeq_epi8(first, block);
+        __m128i eq_zero = _mm_cmpeq_epi8(zero, block);
 
-        u32 mask_needle = _mm256_movemask_epi8(eq);
-        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+        u32 mask_needle = _mm_movemask_epi8(eq);
+        u32 mask_zero = _mm_movemask_epi8(eq_zero);
 
-        while (mask_needle != 0) {
+        if (mask_needle != 0) {
             u32 bitpos = count_trailing_zeroes(mask_needle);
-            *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+            *zero_count += count_bits_set_portable(mask_zero & ~(0xFFFFFFFF << bitpos));
 
             return s + i + bitpos;
         }
 
-        *zero_count += count_bits_set(mask_zero);
+        *zero_count += count_bits_set_portable(mask_zero);
     }
 
     return null;
 }
 
-static char *simd_memchr(char *s, usize n, char c) {
-    __m256i first = _mm256_set1_epi8(c);
+static char *simd_memchr_count_zeroes_nocase_sse2(char *s, usize n, char c, usize *zero_count) {
+    *zero_count = 0;
 
-    for (usize i = 0; i < n; i += 32) {
-        __m256i block = _mm256_loadu_si256((__m256i *)(s + i));
-        __m256i eq = _mm256_cmpeq_epi8(first, block);
+    __m128i lower = _mm_set1_epi8(ascii_tolower(c));
+    __m128i upper = _mm_set1_epi8(ascii_toupper(c));
+    __m128i zero = _mm_set1_epi8('\0');
 
-        u32 mask_needle = _mm256_movemask_epi8(eq);
+    for (usize i = 0; i < n; i += 16) {
+        __m128i block = _mm_loadu_si128((__m128i *)(s + i));
 
-        while (mask_needle != 0) {
+        __m128i eq      = _mm_or_si128(_mm_cmpeq_epi8(lower, block), _mm_cmpeq_epi8(upper, block));
+        __m128i eq_zero = _mm_cmpeq_epi8(zero, block);
+
+        u32 mask_needle = _mm_movemask_epi8(eq);
+        u32 mask_zero = _mm_movemask_epi8(eq_zero);
+
+        if (mask_needle != 0) {
             u32 bitpos = count_trailing_zeroes(mask_needle);
+            *zero_count += count_bits_set_portable(mask_zero & ~(0xFFFFFFFF << bitpos));
+
             return s + i + bitpos;
         }
 
+        *zero_count += count_bits_set_portable(mask_zero);
     }
 
     return null;
 }
 
-////////////////////////////////////////////////////////////////
-// rune: File IO
+static char *simd_memchr_sse2(char *s, usize n, char c) {
+    __m128i first = _mm_set1_epi8(c);
 
-static void file_open(file *file, char *path, file_access access) {
-    u32 dw_access = 0;
-    u32 dw_create = 0;
+    for (usize i = 0; i < n; i += 16) {
+        __m128i block = _mm_loadu_si128((__m128i *)(s + i));
+        u32 mask_needle = _mm_movemask_epi8(_mm_cmpeq_epi8(first, block));
 
-    switch (access) {
-        case FILE_ACCESS_READ: {
-            dw_access = GENERIC_READ;
-            dw_create = OPEN_EXISTING;
-        } break;
+        if (mask_needle != 0) {
+            return s + i + count_trailing_zeroes(mask_needle);
+        }
+    }
 
-        case FILE_ACCESS_WRITE: {
-            dw_access = GENERIC_WRITE;
-            dw_create = CREATE_ALWAYS;
-        } break;
+    return null;
+}
 
-        default: {
-            assert(false);
-        } break;
-    }
+static usize simd_count_zeroes_sse2(char *s, usize n) {
+    usize zero_count = 0;
+    usize i = 0;
 
-    file->handle = CreateFileA(path, dw_access, 0, null, dw_create, FILE_ATTRIBUTE_NORMAL, null);
+    __m128i zero = _mm_set1_epi8('\0');
 
-    if (file->handle != INVALID_HANDLE_VALUE) {
-        file->ok = true;
-    } else {
-        file->ok = false;
-        debug_log_error_win32("CreateFileA");
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128((__m128i *)(s + i));
+        zero_count += count_bits_set_portable(_mm_movemask_epi8(_mm_cmpeq_epi8(zero, block)));
     }
-}
 
-static void file_close(file *file) {
-    CloseHandle(file->handle);
+    for (; i < n; i++) {
+        zero_count += (s[i] == '\0');
+    }
+
+    return zero_count;
 }
 
-static void file_read_and_allocate(file *file, void **buffer, usize size) {
-    if (file->ok) {
-        *buffer = heap_alloc(size, false);
+static usize simd_decode_deltas_sse2(u16 *deltas, usize delta_count, u32 base, u32 *out) {
+    usize out_count = 0;
+    usize i = 0;
+    u32 value = base;
 
-        if (*buffer) {
-            file_read(file, *buffer, size);
-            if (!file->ok) {
-                heap_free(*buffer);
-                *buffer = null;
+    __m128i escape = _mm_set1_epi16((short)TRIGRAM_DELTA_ESCAPE);
+    __m128i zero = _mm_setzero_si128();
+
+    while (i < delta_count) {
+        if (i + 8 <= delta_count) {
+            __m128i block = _mm_loadu_si128((__m128i *)(deltas + i));
+
+            // NOTE(rune): Blocks with an escaped delta take the scalar path, one delta at a time.
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(block, escape)) == 0) {
+                __m128i lo = _mm_unpacklo_epi16(block, zero);
+                __m128i hi = _mm_unpackhi_epi16(block, zero);
+
+                // NOTE(rune): Prefix sum within each group of 4 u32s.
+                lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 4));
+                lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 8));
+                hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 4));
+                hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 8));
+
+                lo = _mm_add_epi32(lo, _mm_set1_epi32(value));
+                hi = _mm_add_epi32(hi, _mm_shuffle_epi32(lo, 0xFF));
+
+                _mm_storeu_si128((__m128i *)(out + out_count), lo);
+                _mm_storeu_si128((__m128i *)(out + out_count + 4), hi);
+
+                value      = (u32)_mm_cvtsi128_si32(_mm_shuffle_epi32(hi, 0xFF));
+                out_count += 8;
+                i         += 8;
+                continue;
             }
-        } else {
-            file->ok = false;
-            assert(false);
         }
+
+        value += decode_delta(deltas, &i);
+        out[out_count++] = value;
     }
+
+    return out_count;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: SIMD AVX2 kernels
+
+// NOTE(rune): Same as simd_needle_sse2, but with one 32 byte register.
+typedef struct simd_needle_avx2 simd_needle_avx2;
+struct simd_needle_avx2 {
+    __m256i bytes;
+    u32     mask;
+};
+
+static simd_needle_avx2 simd_needle_load_avx2(char *needle, usize k) {
+    char padded[32] = { 0 };
+    memcpy(padded, needle, min(k, sizeof(padded)));
+
+    simd_needle_avx2 result;
+    result.bytes = _mm256_loadu_si256((__m256i *)padded);
+    result.mask  = k >= 32 ? 0xFFFFFFFF : (1u << k) - 1;
+    return result;
+}
+
+static inline bool simd_needle_verify_avx2(simd_needle_avx2 *v, char *s, char *needle, usize k) {
+    u32 eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)s), v->bytes));
+    if ((eq & v->mask) != v->mask) {
+        return false;
+    }
+
+    return k <= 32 || memcmp(s + 32, needle + 32, k - 32) == 0;
+}
+
+static char *simd_memmem_count_zeroes_avx2(char *s, usize n, char *needle, usize k, usize *zero_count) {
+    assert(k > 1);
+
+    *zero_count = 0;
+
+    simd_needle_avx2 verify = simd_needle_load_avx2(needle, k);
+
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[k - 1]);
+    __m256i zero = _mm256_set1_epi8('\0');
+
+    for (usize i = 0; i < n; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((__m256i *)(s + i));
+        __m256i block_last = _mm256_loadu_si256((__m256i *)(s + i + k - 1));
+
+        __m256i eq_first = _mm256_cmpeq_epi8(first, block_first);
+        __m256i eq_last = _mm256_cmpeq_epi8(last, block_last);
+        __m256i eq_zero = _mm256_cmpeq_epi8(zero, block_first);
+
+        u32 mask_needle = _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));
+        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+
+        while (mask_needle != 0) {
+            u32 bitpos = count_trailing_zeroes(mask_needle);
+
+            if (simd_needle_verify_avx2(&verify, s + i + bitpos, needle, k)) {
+                *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+                return s + i + bitpos;
+            }
+
+            mask_needle = clear_leftmost_set(mask_needle);
+        }
+
+        *zero_count += count_bits_set(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memmem_count_zeroes_nocase_avx2(char *s, usize n, char *needle, usize k, usize *zero_count) {
+    assert(k > 1);
+
+    *zero_count = 0;
+
+    __m256i lower_first = _mm256_set1_epi8(ascii_tolower(needle[0]));
+    __m256i lower_last = _mm256_set1_epi8(ascii_tolower(needle[k - 1]));
+
+    __m256i upper_first = _mm256_set1_epi8(ascii_toupper(needle[0]));
+    __m256i upper_last = _mm256_set1_epi8(ascii_toupper(needle[k - 1]));
+
+    __m256i zero = _mm256_set1_epi8('\0');
+
+    for (usize i = 0; i < n; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((__m256i *)(s + i));
+        __m256i block_last = _mm256_loadu_si256((__m256i *)(s + i + k - 1));
+
+        __m256i eq_lower_first = _mm256_cmpeq_epi8(lower_first, block_first);
+        __m256i eq_lower_last = _mm256_cmpeq_epi8(lower_last, block_last);
+        __m256i eq_upper_first = _mm256_cmpeq_epi8(upper_first, block_first);
+        __m256i eq_upper_last = _mm256_cmpeq_epi8(upper_last, block_last);
+
+        __m256i eq_first = _mm256_or_si256(eq_lower_first, eq_upper_first);
+        __m256i eq_last = _mm256_or_si256(eq_lower_last, eq_upper_last);
+        __m256i eq_zero = _mm256_cmpeq_epi8(zero, block_first);
+
+        u32 mask_needle = _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));;
+        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+
+        while (mask_needle != 0) {
+            u32 bitpos = count_trailing_zeroes(mask_needle);
+
+            if (_memicmp(s + i + bitpos + 1, needle + 1, k - 2) == 0) {
+                *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+                return s + i + bitpos;
+            }
+
+            mask_needle = clear_leftmost_set(mask_needle);
+        }
+
+        *zero_count += count_bits_set(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memmem_anchored_count_zeroes_avx2(char *s, usize n, char *needle, usize k, usize anchor_a, usize anchor_b, usize *zero_count) {
+    assert(anchor_a < anchor_b && anchor_b < k);
+
+    *zero_count = 0;
+
+    simd_needle_avx2 verify = simd_needle_load_avx2(needle, k);
+
+    __m256i a = _mm256_set1_epi8(needle[anchor_a]);
+    __m256i b = _mm256_set1_epi8(needle[anchor_b]);
+    __m256i zero = _mm256_set1_epi8('\0');
+
+    for (usize i = 0; i < n; i += 32) {
+        __m256i block = _mm256_loadu_si256((__m256i *)(s + i));
+        __m256i block_a = _mm256_loadu_si256((__m256i *)(s + i + anchor_a));
+        __m256i block_b = _mm256_loadu_si256((__m256i *)(s + i + anchor_b));
+
+        __m256i eq_a = _mm256_cmpeq_epi8(a, block_a);
+        __m256i eq_b = _mm256_cmpeq_epi8(b, block_b);
+        __m256i eq_zero = _mm256_cmpeq_epi8(zero, block);
+
+        u32 mask_needle = _mm256_movemask_epi8(_mm256_and_si256(eq_a, eq_b));
+        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+
+        while (mask_needle != 0) {
+            u32 bitpos = count_trailing_zeroes(mask_needle);
+
+            if (simd_needle_verify_avx2(&verify, s + i + bitpos, needle, k)) {
+                *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+                return s + i + bitpos;
+            }
+
+            mask_needle = clear_leftmost_set(mask_needle);
+        }
+
+        *zero_count += count_bits_set(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memchr_count_zeroes_avx2(char *s, usize n, char c, usize *zero_count) {
+    *zero_count = 0;
+
+    __m256i first = _mm256_set1_epi8(c);
+    __m256i zero = _mm256_set1_epi8('\0');
+
+    for (usize i = 0; i < n; i += 32) {
+        __m256i block   = _mm256_loadu_si256((__m256i *)(s + i));
+        __m256i eq      = _mm256_cmpeq_epi8(first, block);
+        __m256i eq_zero = _mm256_cmpeq_epi8(zero, block);
+
+        u32 mask_needle = _mm256_movemask_epi8(eq);
+        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+
+        while (mask_needle != 0) {
+            u32 bitpos = count_trailing_zeroes(mask_needle);
+            *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+
+            return s + i + bitpos;
+        }
+
+        *zero_count += count_bits_set(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memchr_count_zeroes_nocase_avx2(char *s, usize n, char c, usize *zero_count) {
+    *zero_count = 0;
+
+    __m256i lower = _mm256_set1_epi8(ascii_tolower(c));
+    __m256i upper = _mm256_set1_epi8(ascii_toupper(c));
+    __m256i zero = _mm256_set1_epi8('\0');
+
+    for (usize i = 0; i < n; i += 32) {
+        __m256i block = _mm256_loadu_si256((__m256i *)(s + i));
+
+        __m256i eq_lower = _mm256_cmpeq_epi8(lower, block);
+        __m256i eq_upper = _mm256_cmpeq_epi8(upper, block);
+        __m256i eq       = _mm256_or_si256(eq_lower, eq_upper);
+        __m256i eq_zero  = _mm256_cmpeq_epi8(zero, block);
+
+        u32 mask_needle = _mm256_movemask_epi8(eq);
+        u32 mask_zero = _mm256_movemask_epi8(eq_zero);
+
+        while (mask_needle != 0) {
+            u32 bitpos = count_trailing_zeroes(mask_needle);
+            *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+
+            return s + i + bitpos;
+        }
+
+        *zero_count += count_bits_set(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memchr_avx2(char *s, usize n, char c) {
+    __m256i first = _mm256_set1_epi8(c);
+
+    for (usize i = 0; i < n; i += 32) {
+        __m256i block = _mm256_loadu_si256((__m256i *)(s + i));
+        __m256i eq = _mm256_cmpeq_epi8(first, block);
+
+        u32 mask_needle = _mm256_movemask_epi8(eq);
+
+        while (mask_needle != 0) {
+            u32 bitpos = count_trailing_zeroes(mask_needle);
+            return s + i + bitpos;
+        }
+
+    }
+
+    return null;
+}
+
+static usize simd_count_zeroes_avx2(char *s, usize n) {
+    usize zero_count = 0;
+    usize i = 0;
+
+    __m256i zero = _mm256_set1_epi8('\0');
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i block   = _mm256_loadu_si256((__m256i *)(s + i));
+        __m256i eq_zero = _mm256_cmpeq_epi8(zero, block);
+        zero_count += count_bits_set(_mm256_movemask_epi8(eq_zero));
+    }
+
+    for (; i < n; i++) {
+        zero_count += (s[i] == '\0');
+    }
+
+    return zero_count;
+}
+
+static char *simd_teddy_count_zeroes_avx2(char *s, usize n, teddy *t, usize *zero_count) {
+    *zero_count = 0;
+
+    __m256i lo[TEDDY_MAX_FINGERPRINT_SIZE];
+    __m256i hi[TEDDY_MAX_FINGERPRINT_SIZE];
+
+    for (u32 j = 0; j < t->fingerprint_size; j++) {
+        lo[j] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)t->lo[j]));
+        hi[j] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)t->hi[j]));
+    }
+
+    __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i zero = _mm256_set1_epi8('\0');
+
+    for (usize i = 0; i < n; i += 32) {
+        __m256i buckets = _mm256_set1_epi8((char)0xFF);
+
+        for (u32 j = 0; j < t->fingerprint_size; j++) {
+            __m256i block = _mm256_loadu_si256((__m256i *)(s + i + j));
+            __m256i block_lo = _mm256_and_si256(block, nibble);
+            __m256i block_hi = _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble);
+
+            buckets = _mm256_and_si256(buckets, _mm256_shuffle_epi8(lo[j], block_lo));
+            buckets = _mm256_and_si256(buckets, _mm256_shuffle_epi8(hi[j], block_hi));
+        }
+
+        __m256i block_first = _mm256_loadu_si256((__m256i *)(s + i));
+
+        u32 mask_candidate = ~(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(buckets, zero));
+        u32 mask_zero = _mm256_movemask_epi8(_mm256_cmpeq_epi8(zero, block_first));
+
+        if (mask_candidate != 0) {
+            u8 bucket_bytes[32];
+            _mm256_storeu_si256((__m256i *)bucket_bytes, buckets);
+
+            while (mask_candidate != 0) {
+                u32 bitpos = count_trailing_zeroes(mask_candidate);
+
+                if (teddy_verify(t, s + i + bitpos, bucket_bytes[bitpos])) {
+                    *zero_count += count_bits_set(mask_zero & ~(0xFFFFFFFF << bitpos));
+                    return s + i + bitpos;
+                }
+
+                mask_candidate = clear_leftmost_set(mask_candidate);
+            }
+        }
+
+        *zero_count += count_bits_set(mask_zero);
+    }
+
+    return null;
+}
+
+static usize simd_decode_deltas_avx2(u16 *deltas, usize delta_count, u32 base, u32 *out) {
+    usize out_count = 0;
+    usize i = 0;
+    u32 value = base;
+
+    __m128i escape = _mm_set1_epi16((short)TRIGRAM_DELTA_ESCAPE);
+
+    while (i < delta_count) {
+        if (i + 8 <= delta_count) {
+            __m128i block = _mm_loadu_si128((__m128i *)(deltas + i));
+
+            // NOTE(rune): Blocks with an escaped delta take the scalar path, one delta at a time.
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(block, escape)) == 0) {
+                __m256i sum = _mm256_cvtepu16_epi32(block);
+
+                // NOTE(rune): Prefix sum within each 128-bit lane, and then carry the
+                // last element of the low lane over to the high lane.
+                sum = _mm256_add_epi32(sum, _mm256_slli_si256(sum, 4));
+                sum = _mm256_add_epi32(sum, _mm256_slli_si256(sum, 8));
+
+                __m256i carry = _mm256_permute2x128_si256(sum, sum, 0x08);
+                sum = _mm256_add_epi32(sum, _mm256_shuffle_epi32(carry, 0xFF));
+                sum = _mm256_add_epi32(sum, _mm256_set1_epi32(value));
+
+                _mm256_storeu_si256((__m256i *)(out + out_count), sum);
+
+                value      = (u32)_mm256_extract_epi32(sum, 7);
+                out_count += 8;
+                i         += 8;
+                continue;
+            }
+        }
+
+        value += decode_delta(deltas, &i);
+        out[out_count++] = value;
+    }
+
+    return out_count;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: SIMD AVX-512 kernels
+
+// NOTE(rune): Same as simd_needle_sse2, but with one 64 byte register. Masked loads never fault on
+// the masked out bytes, so the needle can be loaded directly, and the verify never reads further
+// past the candidate than the needle is long.
+typedef struct simd_needle_avx512 simd_needle_avx512;
+struct simd_needle_avx512 {
+    __m512i   bytes;
+    __mmask64 mask;
+};
+
+static simd_needle_avx512 simd_needle_load_avx512(char *needle, usize k) {
+    simd_needle_avx512 result;
+    result.mask  = k >= 64 ? 0xFFFFFFFFFFFFFFFF : (1ull << k) - 1;
+    result.bytes = _mm512_maskz_loadu_epi8(result.mask, needle);
+    return result;
+}
+
+static inline bool simd_needle_verify_avx512(simd_needle_avx512 *v, char *s, char *needle, usize k) {
+    __m512i block = _mm512_maskz_loadu_epi8(v->mask, s);
+    if (_mm512_mask_cmpeq_epi8_mask(v->mask, block, v->bytes) != v->mask) {
+        return false;
+    }
+
+    return k <= 64 || memcmp(s + 64, needle + 64, k - 64) == 0;
+}
+
+static char *simd_memmem_count_zeroes_avx512(char *s, usize n, char *needle, usize k, usize *zero_count) {
+    assert(k > 1);
+
+    *zero_count = 0;
+
+    simd_needle_avx512 verify = simd_needle_load_avx512(needle, k);
+
+    __m512i first = _mm512_set1_epi8(needle[0]);
+    __m512i last = _mm512_set1_epi8(needle[k - 1]);
+
+    for (usize i = 0; i < n; i += 64) {
+        __m512i block_first = _mm512_loadu_si512(s + i);
+        __m512i block_last = _mm512_loadu_si512(s + i + k - 1);
+
+        __mmask64 eq_first = _mm512_cmpeq_epi8_mask(first, block_first);
+
+        u64 mask_needle = _mm512_mask_cmpeq_epi8_mask(eq_first, last, block_last);
+        u64 mask_zero = _mm512_testn_epi8_mask(block_first, block_first);
+
+        while (mask_needle != 0) {
+            u64 bitpos = count_trailing_zeroes64(mask_needle);
+
+            if (simd_needle_verify_avx512(&verify, s + i + bitpos, needle, k)) {
+                *zero_count += count_bits_set64(mask_zero & ~(0xFFFFFFFFFFFFFFFF << bitpos));
+                return s + i + bitpos;
+            }
+
+            mask_needle = clear_leftmost_set64(mask_needle);
+        }
+
+        *zero_count += count_bits_set64(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memmem_count_zeroes_nocase_avx512(char *s, usize n, char *needle, usize k, usize *zero_count) {
+    assert(k > 1);
+
+    *zero_count = 0;
+
+    __m512i lower_first = _mm512_set1_epi8(ascii_tolower(needle[0]));
+    __m512i lower_last = _mm512_set1_epi8(ascii_tolower(needle[k - 1]));
+
+    __m512i upper_first = _mm512_set1_epi8(ascii_toupper(needle[0]));
+    __m512i upper_last = _mm512_set1_epi8(ascii_toupper(needle[k - 1]));
+
+    for (usize i = 0; i < n; i += 64) {
+        __m512i block_first = _mm512_loadu_si512(s + i);
+        __m512i block_last = _mm512_loadu_si512(s + i + k - 1);
+
+        __mmask64 eq_first = _mm512_cmpeq_epi8_mask(lower_first, block_first) | _mm512_cmpeq_epi8_mask(upper_first, block_first);
+        __mmask64 eq_last = _mm512_mask_cmpeq_epi8_mask(eq_first, lower_last, block_last) | _mm512_mask_cmpeq_epi8_mask(eq_first, upper_last, block_last);
+
+        u64 mask_needle = eq_last;
+        u64 mask_zero = _mm512_testn_epi8_mask(block_first, block_first);
+
+        while (mask_needle != 0) {
+            u64 bitpos = count_trailing_zeroes64(mask_needle);
+
+            if (_memicmp(s + i + bitpos + 1, needle + 1, k - 2) == 0) {
+                *zero_count += count_bits_set64(mask_zero & ~(0xFFFFFFFFFFFFFFFF << bitpos));
+                return s + i + bitpos;
+            }
+
+            mask_needle = clear_leftmost_set64(mask_needle);
+        }
+
+        *zero_count += count_bits_set64(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memmem_anchored_count_zeroes_avx512(char *s, usize n, char *needle, usize k, usize anchor_a, usize anchor_b, usize *zero_count) {
+    assert(anchor_a < anchor_b && anchor_b < k);
+
+    *zero_count = 0;
+
+    simd_needle_avx512 verify = simd_needle_load_avx512(needle, k);
+
+    __m512i a = _mm512_set1_epi8(needle[anchor_a]);
+    __m512i b = _mm512_set1_epi8(needle[anchor_b]);
+
+    for (usize i = 0; i < n; i += 64) {
+        __m512i block = _mm512_loadu_si512(s + i);
+        __m512i block_a = _mm512_loadu_si512(s + i + anchor_a);
+        __m512i block_b = _mm512_loadu_si512(s + i + anchor_b);
+
+        __mmask64 eq_a = _mm512_cmpeq_epi8_mask(a, block_a);
+
+        u64 mask_needle = _mm512_mask_cmpeq_epi8_mask(eq_a, b, block_b);
+        u64 mask_zero = _mm512_testn_epi8_mask(block, block);
+
+        while (mask_needle != 0) {
+            u64 bitpos = count_trailing_zeroes64(mask_needle);
+
+            if (simd_needle_verify_avx512(&verify, s + i + bitpos, needle, k)) {
+                *zero_count += count_bits_set64(mask_zero & ~(0xFFFFFFFFFFFFFFFF << bitpos));
+                return s + i + bitpos;
+            }
+
+            mask_needle = clear_leftmost_set64(mask_needle);
+        }
+
+        *zero_count += count_bits_set64(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memchr_count_zeroes_avx512(char *s, usize n, char c, usize *zero_count) {
+    *zero_count = 0;
+
+    __m512i first = _mm512_set1_epi8(c);
+
+    for (usize i = 0; i < n; i += 64) {
+        __m512i block = _mm512_loadu_si512(s + i);
+
+        u64 mask_needle = _mm512_cmpeq_epi8_mask(first, block);
+        u64 mask_zero = _mm512_testn_epi8_mask(block, block);
+
+        if (mask_needle != 0) {
+            u64 bitpos = count_trailing_zeroes64(mask_needle);
+            *zero_count += count_bits_set64(mask_zero & ~(0xFFFFFFFFFFFFFFFF << bitpos));
+
+            return s + i + bitpos;
+        }
+
+        *zero_count += count_bits_set64(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memchr_count_zeroes_nocase_avx512(char *s, usize n, char c, usize *zero_count) {
+    *zero_count = 0;
+
+    __m512i lower = _mm512_set1_epi8(ascii_tolower(c));
+    __m512i upper = _mm512_set1_epi8(ascii_toupper(c));
+
+    for (usize i = 0; i < n; i += 64) {
+        __m512i block = _mm512_loadu_si512(s + i);
+
+        u64 mask_needle = _mm512_cmpeq_epi8_mask(lower, block) | _mm512_cmpeq_epi8_mask(upper, block);
+        u64 mask_zero = _mm512_testn_epi8_mask(block, block);
+
+        if (mask_needle != 0) {
+            u64 bitpos = count_trailing_zeroes64(mask_needle);
+            *zero_count += count_bits_set64(mask_zero & ~(0xFFFFFFFFFFFFFFFF << bitpos));
+
+            return s + i + bitpos;
+        }
+
+        *zero_count += count_bits_set64(mask_zero);
+    }
+
+    return null;
+}
+
+static char *simd_memchr_avx512(char *s, usize n, char c) {
+    __m512i first = _mm512_set1_epi8(c);
+
+    for (usize i = 0; i < n; i += 64) {
+        __m512i block = _mm512_loadu_si512(s + i);
+        u64 mask_needle = _mm512_cmpeq_epi8_mask(first, block);
+
+        if (mask_needle != 0) {
+            return s + i + count_trailing_zeroes64(mask_needle);
+        }
+    }
+
+    return null;
+}
+
+static usize simd_count_zeroes_avx512(char *s, usize n) {
+    usize zero_count = 0;
+    usize i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m512i block = _mm512_loadu_si512(s + i);
+        zero_count += count_bits_set64(_mm512_testn_epi8_mask(block, block));
+    }
+
+    for (; i < n; i++) {
+        zero_count += (s[i] == '\0');
+    }
+
+    return zero_count;
+}
+
+static char *simd_teddy_count_zeroes_avx512(char *s, usize n, teddy *t, usize *zero_count) {
+    *zero_count = 0;
+
+    __m512i lo[TEDDY_MAX_FINGERPRINT_SIZE];
+    __m512i hi[TEDDY_MAX_FINGERPRINT_SIZE];
+
+    for (u32 j = 0; j < t->fingerprint_size; j++) {
+        lo[j] = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *)t->lo[j]));
+        hi[j] = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *)t->hi[j]));
+    }
+
+    __m512i nibble = _mm512_set1_epi8(0x0F);
+
+    for (usize i = 0; i < n; i += 64) {
+        __m512i buckets = _mm512_set1_epi8((char)0xFF);
+
+        for (u32 j = 0; j < t->fingerprint_size; j++) {
+            __m512i block = _mm512_loadu_si512(s + i + j);
+            __m512i block_lo = _mm512_and_si512(block, nibble);
+            __m512i block_hi = _mm512_and_si512(_mm512_srli_epi16(block, 4), nibble);
+
+            buckets = _mm512_and_si512(buckets, _mm512_shuffle_epi8(lo[j], block_lo));
+            buckets = _mm512_and_si512(buckets, _mm512_shuffle_epi8(hi[j], block_hi));
+        }
+
+        __m512i block_first = _mm512_loadu_si512(s + i);
+
+        u64 mask_candidate = _mm512_test_epi8_mask(buckets, buckets);
+        u64 mask_zero = _mm512_testn_epi8_mask(block_first, block_first);
+
+        if (mask_candidate != 0) {
+            u8 bucket_bytes[64];
+            _mm512_storeu_si512(bucket_bytes, buckets);
+
+            while (mask_candidate != 0) {
+                u64 bitpos = count_trailing_zeroes64(mask_candidate);
+
+                if (teddy_verify(t, s + i + bitpos, bucket_bytes[bitpos])) {
+                    *zero_count += count_bits_set64(mask_zero & ~(0xFFFFFFFFFFFFFFFF << bitpos));
+                    return s + i + bitpos;
+                }
+
+                mask_candidate = clear_leftmost_set64(mask_candidate);
+            }
+        }
+
+        *zero_count += count_bits_set64(mask_zero);
+    }
+
+    return null;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: SIMD dispatch
+
+static simd_kernels g_simd_kernels[SIMD_LEVEL_COUNT] = {
+    [SIMD_LEVEL_SCALAR] = {
+        "scalar",
+        simd_memmem_count_zeroes_scalar,
+        simd_memmem_count_zeroes_nocase_scalar,
+        simd_memmem_anchored_count_zeroes_scalar,
+        simd_memchr_count_zeroes_scalar,
+        simd_memchr_count_zeroes_nocase_scalar,
+        simd_memchr_scalar,
+        simd_count_zeroes_scalar,
+        simd_decode_deltas_scalar,
+        simd_teddy_count_zeroes_scalar,
+    },
+
+    [SIMD_LEVEL_SSE2] = {
+        "sse2",
+        simd_memmem_count_zeroes_sse2,
+        simd_memmem_count_zeroes_nocase_sse2,
+        simd_memmem_anchored_count_zeroes_sse2,
+        simd_memchr_count_zeroes_sse2,
+        simd_memchr_count_zeroes_nocase_sse2,
+        simd_memchr_sse2,
+        simd_count_zeroes_sse2,
+        simd_decode_deltas_sse2,
+        simd_teddy_count_zeroes_scalar,
+    },
+
+    [SIMD_LEVEL_AVX2] = {
+        "avx2",
+        simd_memmem_count_zeroes_avx2,
+        simd_memmem_count_zeroes_nocase_avx2,
+        simd_memmem_anchored_count_zeroes_avx2,
+        simd_memchr_count_zeroes_avx2,
+        simd_memchr_count_zeroes_nocase_avx2,
+        simd_memchr_avx2,
+        simd_count_zeroes_avx2,
+        simd_decode_deltas_avx2,
+        simd_teddy_count_zeroes_avx2,
+    },
+
+    [SIMD_LEVEL_AVX512] = {
+        "avx512bw",
+        simd_memmem_count_zeroes_avx512,
+        simd_memmem_count_zeroes_nocase_avx512,
+        simd_memmem_anchored_count_zeroes_avx512,
+        simd_memchr_count_zeroes_avx512,
+        simd_memchr_count_zeroes_nocase_avx512,
+        simd_memchr_avx512,
+        simd_count_zeroes_avx512,
+        simd_decode_deltas_avx2, // NOTE(rune): A 16-wide prefix sum needs more cross-lane shuffles than it saves.
+        simd_teddy_count_zeroes_avx512,
+    },
+};
+
+static simd_level g_simd_level          = SIMD_LEVEL_SCALAR;
+static simd_level g_simd_detected_level = SIMD_LEVEL_SCALAR;
+
+// Reference: https://www.intel.com/content/www/us/en/developer/articles/technical/how-to-detect-new-instruction-support-in-the-4th-generation-intel-core-processor-family.html
+static simd_level simd_detect_level(void) {
+    int info[4] = { 0 };
+
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    bool has_sse2    = (info[3] >> 26) & 1;
+    bool has_popcnt  = (info[2] >> 23) & 1;
+    bool has_osxsave = (info[2] >> 27) & 1;
+    bool has_avx     = (info[2] >> 28) & 1;
+
+    bool has_bmi1     = false;
+    bool has_avx2     = false;
+    bool has_avx512f  = false;
+    bool has_avx512bw = false;
+
+    if (max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        has_bmi1     = (info[1] >> 3) & 1;
+        has_avx2     = (info[1] >> 5) & 1;
+        has_avx512f  = (info[1] >> 16) & 1;
+        has_avx512bw = (info[1] >> 30) & 1;
+    }
+
+    // NOTE(rune): The OS must also save the ymm/zmm registers on context switches.
+    u64 xcr0 = has_osxsave ? _xgetbv(0) : 0;
+    bool os_saves_ymm = (xcr0 & 0x06) == 0x06;
+    bool os_saves_zmm = (xcr0 & 0xe6) == 0xe6;
+
+    if (has_avx512f && has_avx512bw && has_popcnt && has_bmi1 && os_saves_zmm) {
+        return SIMD_LEVEL_AVX512;
+    }
+
+    if (has_avx && has_avx2 && has_popcnt && has_bmi1 && os_saves_ymm) {
+        return SIMD_LEVEL_AVX2;
+    }
+
+    if (has_sse2) {
+        return SIMD_LEVEL_SSE2;
+    }
+
+    return SIMD_LEVEL_SCALAR;
+}
+
+static void simd_init(void) {
+    g_simd_detected_level = simd_detect_level();
+    g_simd_level          = g_simd_detected_level;
+
+    debug_log_info("Using %s search kernels.", g_simd_kernels[g_simd_level].name);
+}
+
+static bool simd_set_level(simd_level level) {
+    if (level <= g_simd_detected_level) {
+        g_simd_level = level;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+static char *simd_memmem_count_zeroes(char *s, usize n, char *needle, usize k, usize *zero_count) {
+    return g_simd_kernels[g_simd_level].memmem_count_zeroes(s, n, needle, k, zero_count);
+}
+
+static char *simd_memmem_count_zeroes_nocase(char *s, usize n, char *needle, usize k, usize *zero_count) {
+    return g_simd_kernels[g_simd_level].memmem_count_zeroes_nocase(s, n, needle, k, zero_count);
+}
+
+static char *simd_memmem_anchored_count_zeroes(char *s, usize n, char *needle, usize k, usize anchor_a, usize anchor_b, usize *zero_count) {
+    return g_simd_kernels[g_simd_level].memmem_anchored_count_zeroes(s, n, needle, k, anchor_a, anchor_b, zero_count);
+}
+
+static char *simd_memchr_count_zeroes(char *s, usize n, char c, usize *zero_count) {
+    return g_simd_kernels[g_simd_level].memchr_count_zeroes(s, n, c, zero_count);
+}
+
+static char *simd_memchr_count_zeroes_nocase(char *s, usize n, char c, usize *zero_count) {
+    return g_simd_kernels[g_simd_level].memchr_count_zeroes_nocase(s, n, c, zero_count);
+}
+
+static char *simd_memchr(char *s, usize n, char c) {
+    return g_simd_kernels[g_simd_level].memchr(s, n, c);
+}
+
+static usize simd_count_zeroes(char *s, usize n) {
+    return g_simd_kernels[g_simd_level].count_zeroes(s, n);
+}
+
+static char *simd_teddy_count_zeroes(char *s, usize n, teddy *t, usize *zero_count) {
+    return g_simd_kernels[g_simd_level].teddy_count_zeroes(s, n, t, zero_count);
+}
+
+static usize simd_decode_deltas(u16 *deltas, usize delta_count, u32 base, u32 *out) {
+    return g_simd_kernels[g_simd_level].decode_deltas(deltas, delta_count, base, out);
+}
+
+////////////////////////////////////////////////////////////////
+// rune: File IO
+
+static void file_open(file *file, char *path, file_access access) {
+    u32 dw_access = 0;
+    u32 dw_create = 0;
+
+    switch (access) {
+        case FILE_ACCESS_READ: {
+            dw_access = GENERIC_READ;
+            dw_create = OPEN_EXISTING;
+        } break;
+
+        case FILE_ACCESS_WRITE: {
+            dw_access = GENERIC_WRITE;
+            dw_create = CREATE_ALWAYS;
+        } break;
+
+        default: {
+            assert(false);
+        } break;
+    }
+
+    file->handle = CreateFileA(path, dw_access, 0, null, dw_create, FILE_ATTRIBUTE_NORMAL, null);
+
+    if (file->handle != INVALID_HANDLE_VALUE) {
+        file->ok = true;
+    } else {
+        file->ok = false;
+        debug_log_error_win32("CreateFileA");
+    }
+}
+
+static void file_close(file *file) {
+    CloseHandle(file->handle);
+}
+
+static void file_read_and_allocate(file *file, void **buffer, usize size) {
+    if (file->ok) {
+        *buffer = heap_alloc(size, false);
+
+        if (*buffer) {
+            file_read(file, *buffer, size);
+            if (!file->ok) {
+                heap_free(*buffer);
+                *buffer = null;
+            }
+        } else {
+            file->ok = false;
+            assert(false);
+        }
+    }
+}
+
+static void file_read(file *file, void *buffer, usize size) {
+    if (file->ok) {
+        u32 bytes_read;
+        if (ReadFile(file->handle, buffer, (u32)size, &bytes_read, null)) {
+            if (bytes_read == size) {
+                // All good
+            } else {
+                file->ok = false;
+                debug_log_error("ReadFile read %i bytes but wanted to read %i", bytes_read, (u32)size);
+                assert(false);
+            }
+        } else {
+            file->ok = false;
+            debug_log_error_win32("ReadFile");
+            assert(false);
+        }
+    }
+}
+
+static void file_write(file *file, void *buffer, usize size) {
+    if (file->ok) {
+        u32 bytes_written;
+        if (WriteFile(file->handle, buffer, (u32)size, &bytes_written, null)) {
+            if (bytes_written == size) {
+                // All good
+            } else {
+                file->ok = false;
+                debug_log_error("WriteFile wrote %i bytes but wanted to write %i", bytes_written, (u32)size);
+            }
+        } else {
+            file->ok = false;
+            debug_log_error_win32("WriteFile");
+        }
+    }
+}
+
+static void file_read_u8(file *file, u8 *buffer) { file_read(file, buffer, sizeof(*buffer)); }
+static void file_read_u16(file *file, u16 *buffer) { file_read(file, buffer, sizeof(*buffer)); }
+static void file_read_u32(file *file, u32 *buffer) { file_read(file, buffer, sizeof(*buffer)); }
+static void file_read_u64(file *file, u64 *buffer) { file_read(file, buffer, sizeof(*buffer)); }
+static void file_read_usize(file *file, usize *buffer) { file_read(file, buffer, sizeof(buffer)); }
+
+static void file_write_u8(file *file, u8 buffer) { file_write(file, &buffer, sizeof(buffer)); }
+static void file_write_u16(file *file, u16 buffer) { file_write(file, &buffer, sizeof(buffer)); }
+static void file_write_u32(file *file, u32 buffer) { file_write(file, &buffer, sizeof(buffer)); }
+static void file_write_u64(file *file, u64 buffer) { file_write(file, &buffer, sizeof(buffer)); }
+static void file_write_usize(file *file, usize buffer) { file_write(file, &buffer, sizeof(buffer)); }
+
+static void file_read_array(file *file, array *array) {
+    file_read(file, array, sizeof(*array));
+    file_read_and_allocate(file, &array->elems, array->count_allocated * array->elem_size);
+}
+
+static void file_write_array(file *file, array array) {
+    file_write(file, &array, sizeof(array));
+    file_write(file, array.elems, array.count_allocated * array.elem_size);
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Database
+
+
+static void db_create(db *db) {
+    db->latest_journal_id = 0;
+    db->latest_usn = 0;
+    db->records_not_in_use_count = 0;
+    db->generation = 0;
+    zero_struct_array(db->byte_counts, countof(db->byte_counts));
+    zero_struct_array(db->folded_byte_counts, countof(db->folded_byte_counts));
+
+    array_create_size(&db->name_buffer, KILOBYTES(64), true);
+    array_create_size(&db->folded_name_buffer, KILOBYTES(64), true);
+    array_create_size(&db->lookup_array, KILOBYTES(64), true);
+    array_create_size(&db->record_array, KILOBYTES(64), true);
+    array_create_size(&db->checkpoint_array, KILOBYTES(4), true);
+    array_create_size(&db->bigram_filter_array, KILOBYTES(128), true);
+
+    zero_struct(&db->trigram_index);
+    ext_index_create(&db->ext_index);
+    name_index_create(&db->name_index);
+    dir_names_create(&db->dir_names);
+    zero_struct(&db->dir_tree);
+}
+
+static void db_destroy(db *db) {
+    array_destroy(&db->name_buffer);
+    array_destroy(&db->folded_name_buffer);
+    array_destroy(&db->record_array);
+    array_destroy(&db->lookup_array);
+    array_destroy(&db->checkpoint_array);
+
+    if (db->bigram_filter_array.elems) {
+        array_destroy(&db->bigram_filter_array);
+    }
+
+    trigram_index_destroy(&db->trigram_index);
+    ext_index_destroy(&db->ext_index);
+    name_index_destroy(&db->name_index);
+    dir_names_destroy(&db->dir_names);
+    dir_tree_destroy(&db->dir_tree);
+}
+
+static bool db_write_to_file(db *db, char *file_path) {
+    // TODO(rune): This should be a transaction, to avoid partial writes.
+
+    file file;
+    file_open(&file, file_path, FILE_ACCESS_WRITE);
+    file_write_u32(&file, DB_FILE_MAGIC);
+    file_write_u32(&file, DB_FILE_VERSION);
+    file_write_u64(&file, db->latest_journal_id);
+    file_write_u64(&file, db->latest_usn);
+    file_write_u32(&file, db->records_not_in_use_count);
+    file_write_array(&file, db->name_buffer.as_void);
+    file_write_array(&file, db->folded_name_buffer.as_void);
+    file_write_array(&file, db->record_array.as_void);
+    file_write_array(&file, db->lookup_array.as_void);
+    file_write_array(&file, db->checkpoint_array.as_void);
+    file_close(&file);
+
+    if (file.ok) {
+        return true;
+    } else {
+        assert(false);
+        return false;
+    }
+}
+
+static bool db_create_from_file(db *db, char *file_path) {
+    zero_struct(&db->trigram_index);
+    zero_struct(&db->ext_index);
+    zero_struct(&db->name_index);
+    zero_struct(&db->dir_names);
+    zero_struct(&db->dir_tree);
+    zero_struct(&db->bigram_filter_array);
+
+    file file;
+    file_open(&file, file_path, FILE_ACCESS_READ);
+
+    // NOTE(rune): Files written by an older version are discarded, and the database
+    // is reconstructed from the master file table instead.
+    u32 magic   = 0;
+    u32 version = 0;
+    file_read_u32(&file, &magic);
+    file_read_u32(&file, &version);
+    if (file.ok && (magic != DB_FILE_MAGIC || version != DB_FILE_VERSION)) {
+        debug_log_warning("Database file has unknown format (magic %x, version %u).", magic, version);
+        file.ok = false;
+    }
+
+    file_read_u64(&file, &db->latest_journal_id);
+    file_read_u64(&file, &db->latest_usn);
+    file_read_u32(&file, &db->records_not_in_use_count);
+    db->generation = 0;
+    file_read_array(&file, &db->name_buffer.as_void);
+    file_read_array(&file, &db->folded_name_buffer.as_void);
+    file_read_array(&file, &db->record_array.as_void);
+    file_read_array(&file, &db->lookup_array.as_void);
+    file_read_array(&file, &db->checkpoint_array.as_void);
+    file_close(&file);
+
+    if (file.ok && ext_index_build(db) && name_index_build(db) && dir_names_build(db) && dir_tree_build(db) && db_build_bigram_filters(db)) {
+        db_count_bytes(db);
+        return true;
+    } else {
+        db_destroy(db);
+        return false;
+    }
+}
+
+static void db_count_bytes(db *db) {
+    zero_struct_array(db->byte_counts, countof(db->byte_counts));
+    zero_struct_array(db->folded_byte_counts, countof(db->folded_byte_counts));
+
+    for (usize i = 0; i < db->name_buffer.count; i++) {
+        db->byte_counts[(u8)db->name_buffer.elems[i]]++;
+        db->folded_byte_counts[(u8)db->folded_name_buffer.elems[i]]++;
+    }
+}
+
+static char *db_get_record_name(db *db, record *record) {
+    assert(record->name_offset < db->name_buffer.count);
+    return &db->name_buffer.elems[record->name_offset];
+}
+
+// NOTE(rune): Returns the index of the record whose name contains the byte at offset
+// (the null terminator counts as part of the name). Only the null chars between the
+// nearest checkpoint and offset are counted, so this is at most DB_CHECKPOINT_BLOCK_SIZE
+// bytes of work.
+static usize db_get_record_index_by_offset(db *db, usize offset) {
+    assert(offset <= db->name_buffer.count);
+
+    usize block = offset / DB_CHECKPOINT_BLOCK_SIZE;
+    if (block >= db->checkpoint_array.count) {
+        assert(offset == db->name_buffer.count);
+        return db->record_array.count;
+    }
+
+    usize block_offset = block * DB_CHECKPOINT_BLOCK_SIZE;
+    usize zero_count   = 0;
+    if (offset > block_offset) {
+        zero_count = simd_count_zeroes(db->name_buffer.elems + block_offset, offset - block_offset);
+    }
+
+    return db->checkpoint_array.elems[block] + zero_count;
+}
+
+// NOTE(rune): Returns the index of the first record whose name starts at or after offset.
+static usize db_find_record_index_by_name_offset(db *db, usize offset) {
+    usize record_index = db_get_record_index_by_offset(db, offset);
+    if (record_index < db->record_array.count) {
+        if (db->record_array.elems[record_index].name_offset < offset) {
+            record_index++;
+        }
+    }
+
+    return record_index;
+}
+
+static record *db_get_record_parent(db *db, record *record) {
+    return db_get_record_by_id(db, record->parent_id);
+}
+
+static record *db_get_record_by_id(db *db, record_id id) {
+    usize lookup_count = db->lookup_array.count_allocated;
+
+    // NOTE(rune): The lookup always expands to fit the max record_id_t added, so if we're
+    // asking for fild_id_t that doesn't fit in the lookup, the new_record was never added
+    // to the database.
+    if (id.record_number >= lookup_count) {
+        assert(false);
+        return null;
+    }
+
+    // NOTE(rune): Assert that the lookup does not point outside the new_record buffer
+    u64 index_from_lookup = db->lookup_array.elems[id.record_number];
+    if (index_from_lookup >= db->record_array.count) {
+        assert(false);
+        return null;
+    }
+
+    if (index_from_lookup == 0) {
+        return null;
+    }
+
+    record *record_from_lookup = (record *)db->record_array.elems + index_from_lookup;
+    if (record_from_lookup) {
+        assert(record_from_lookup->id.record_number == id.record_number);
+    }
+
+    return record_from_lookup;
+}
+
+static void db_mark_record_not_in_use(db *db, record *record) {
+    if (!(record->attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
+        record->attributes |= FILE_ATTRIBUTE_NOT_IN_USE;
+        db->records_not_in_use_count++;
+        db->generation++;
+
+        trigram_index_remove(db, record);
+        ext_index_remove(&db->ext_index, (u32)(record - db->record_array.elems));
+        dir_names_remove(db, record);
+    }
+}
+
+static bool db_refresh_lookup(db *db, record *new_record) {
+    if (!array_reserve(&db->lookup_array, new_record->id.record_number + 1, true)) {
+        assert(false);
+        return false;
+    }
+
+    // NOTE(rune): Record indices are not pushed in order onto the database->lookup array, like
+    // records are pushed onto the database->records array, so we always mark the whole lookup
+    // lookup buffer as used.
+    db->lookup_array.count = db->lookup_array.count_allocated;
+
+    record *records = db->record_array.elems;
+    u32      *lookup  = db->lookup_array.elems;
+
+    // NOTE(rune): If the lookup previously pointed to another new_record, we mark the previous
+    // record as no longer in use, so that it can be pruned later.
+    u64 prev_record_index = lookup[new_record->id.record_number];
+    if (prev_record_index != 0) {
+        assert(prev_record_index < db->record_array.count);
+        record *prev_record = &records[prev_record_index];
+
+        if (new_record != prev_record) {
+            db_mark_record_not_in_use(db, prev_record);
+        }
+    }
+
+    u32 new_record_index = (u32)(new_record - records);
+    lookup[new_record->id.record_number] = new_record_index;
+
+    return true;
+}
+
+// NOTE(rune): Adds a checkpoint for each block boundary that new_record's name crosses.
+// Names are only ever appended to the name buffer, so the checkpoints are always pushed in order.
+static bool db_refresh_checkpoints(db *db, record *new_record) {
+    u32 new_record_index = (u32)(new_record - db->record_array.elems);
+
+    while (db->checkpoint_array.count * DB_CHECKPOINT_BLOCK_SIZE < db->name_buffer.count) {
+        u32 *checkpoint = array_push(&db->checkpoint_array, false);
+        if (!checkpoint) {
+            assert(false);
+            return false;
+        }
+
+        *checkpoint = new_record_index;
+    }
+
+    return true;
+}
+
+// NOTE(rune): Adds the bigrams of new_record's folded name to the filters of the blocks they start in.
+// Like checkpoints, filters are only ever pushed, since names are only ever appended.
+static bool db_refresh_bigram_filters(db *db, record *new_record) {
+    usize block_count = (db->folded_name_buffer.count + DB_CHECKPOINT_BLOCK_SIZE - 1) / DB_CHECKPOINT_BLOCK_SIZE;
+    if (block_count > db->bigram_filter_array.count) {
+        if (!array_push_count(&db->bigram_filter_array, block_count - db->bigram_filter_array.count, true)) {
+            assert(false);
+            return false;
+        }
+    }
+
+    bigram_filter *filters = db->bigram_filter_array.elems;
+    char *folded_name      = db->folded_name_buffer.elems + new_record->name_offset;
+
+    for (usize i = 0; i + 1 < new_record->name_length; i++) {
+        usize block = (new_record->name_offset + i) / DB_CHECKPOINT_BLOCK_SIZE;
+        bigram_filter_add(&filters[block], folded_name[i], folded_name[i + 1]);
+    }
+
+    return true;
+}
+
+static bool db_build_bigram_filters(db *db) {
+    if (db->bigram_filter_array.elems) {
+        array_destroy(&db->bigram_filter_array);
+    }
+
+    zero_struct(&db->bigram_filter_array);
+    if (!array_create_size(&db->bigram_filter_array, KILOBYTES(128), true)) {
+        return false;
+    }
+
+    for (usize record_index = 0; record_index < db->record_array.count; record_index++) {
+        if (!db_refresh_bigram_filters(db, &db->record_array.elems[record_index])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint32_t length_of_utf16_as_utf8(wchar *wstring, uint32_t wstring_len) {
+    uint32_t utf8_length = WideCharToMultiByte(CP_UTF8, 0, wstring, wstring_len, null, 0, null, null);
+    return utf8_length;
+}
+
+static bool convert_utf16_to_utf8(wchar *wstring, uint32_t wstring_len, char *utf8_buffer, uint32_t utf8_buffer_size) {
+    bool result = false;
+
+    result = WideCharToMultiByte(CP_UTF8, 0, wstring, wstring_len, utf8_buffer, utf8_buffer_size, null, null) > 0;
+    return result;
+}
+
+static record *db_insert(db *db, record_id id, record_id parent_id, uint32_t attributes, wchar *wname, uint32_t wname_len, u64 size, u64 modification_time) {
+    uint32_t name_len  = length_of_utf16_as_utf8(wname, wname_len);
+
+    if (!array_reserve(&db->name_buffer, db->name_buffer.count + name_len + 1 + DB_NAME_BUFFER_PADDING, false) ||
+        !array_reserve(&db->folded_name_buffer, db->folded_name_buffer.count + name_len + 1 + DB_NAME_BUFFER_PADDING, false)) {
+        assert(false);
+        return null;
+    }
+
+    char *name = array_push_count(&db->name_buffer, name_len + 1, false);
+    if (!name) {
+        assert(false);
+        return null;
+    }
+
+    bool converted = convert_utf16_to_utf8(wname, wname_len, name, name_len);
+    if (!converted) {
+        assert(false);
+        return null;
+    }
+
+    name[name_len] = '\0';
+
+    // NOTE(rune): Folding never changes the UTF-8 length, so the folded name takes up exactly
+    // the same bytes in folded_name_buffer, as the name does in name_buffer.
+    wchar folded_wname[DB_MAX_NAME_LENGTH];
+    if (wname_len > countof(folded_wname)) {
+        assert(false);
+        return null;
+    }
+
+    memcpy(folded_wname, wname, wname_len * sizeof(wchar));
+    fold_utf16(folded_wname, wname_len);
+
+    char *folded_name = array_push_count(&db->folded_name_buffer, name_len + 1, false);
+    if (!folded_name) {
+        assert(false);
+        return null;
+    }
+
+    bool folded_converted = convert_utf16_to_utf8(folded_wname, wname_len, folded_name, name_len);
+    if (!folded_converted) {
+        assert(false);
+        return null;
+    }
+
+    folded_name[name_len] = '\0';
+
+    // NOTE(rune): Deleted names stay in the name buffer, and are still scanned, so the counts are never decremented.
+    for (u32 i = 0; i < name_len; i++) {
+        db->byte_counts[(u8)name[i]]++;
+        db->folded_byte_counts[(u8)folded_name[i]]++;
+    }
+
+    // NOTE(rune): The record this insert replaces, which dir_tree_add needs to keep directory intervals.
+    u32 replaced_record_index = 0;
+    if (id.record_number < db->lookup_array.count) {
+        replaced_record_index = db->lookup_array.elems[id.record_number];
+    }
+
+    record *record = array_push(&db->record_array, false);
+    if (!record) {
+        assert(false);
+        return null;
+    }
+
+    record->id                = id;
+    record->parent_id         = parent_id;
+    record->attributes        = attributes;
+    record->name_offset       = name - db->name_buffer.elems;
+    record->name_length       = name_len;
+    record->size              = size;
+    record->modification_time = modification_time;
+
+    db_refresh_lookup(db, record);
+    db_refresh_checkpoints(db, record);
+    db_refresh_bigram_filters(db, record);
+    db->generation++;
+
+    trigram_index_add(&db->trigram_index, (u32)(record - db->record_array.elems), folded_name, name_len);
+    ext_index_add(&db->ext_index, (u32)(record - db->record_array.elems), attributes, folded_name, name_len);
+    name_index_add(db, (u32)(record - db->record_array.elems));
+    dir_names_add(db, (u32)(record - db->record_array.elems));
+    dir_tree_add(db, record, replaced_record_index);
+
+    return record;
+}
+
+
+static record *db_update(db *db, record_id id, record_id parent_id, u32 attributes, wchar *wname, u32 wname_len, u64 size, u64 modification_time) {
+    db_delete(db, id);
+
+    return db_insert(db, id, parent_id, attributes, wname, wname_len, size, modification_time);
+}
+
+// NOTE(rune): Size and modification time are not part of any index, so the record is changed in place.
+static void db_modify(db *db, record_id id, u64 size, u64 modification_time) {
+    record *record = db_get_record_by_id(db, id);
+    if (record) {
+        record->size              = size;
+        record->modification_time = modification_time;
+        db->generation++;
+    }
+}
+
+static void db_delete(db *db, record_id id) {
+    record *record = db_get_record_by_id(db, id);
+    if (record) {
+        db_mark_record_not_in_use(db, record);
+    }
+}
+
+static void db_apply_changes(db *db, change_list changes) {
+#if 1
+    printf("================================\n");
+    for (change *change = changes.first; change; change = change->next) {
+        if (change->ignore) {
+            printf(ANSI_BG_DARK_GRAY);
+        }
+
+        printf("%16llx", change->usn);
+
+        switch (change->type) {
+            case CHANGE_TYPE_INSERT: printf(ANSI_FG_GREEN "INSERT " ANSI_RESET); break;
+            case CHANGE_TYPE_UPDATE: printf(ANSI_FG_CYAN  "UPDATE " ANSI_RESET); break;
+            case CHANGE_TYPE_DELETE: printf(ANSI_FG_RED   "DELETE " ANSI_RESET); break;
+            case CHANGE_TYPE_MODIFY: printf(ANSI_FG_BLUE  "MODIFY " ANSI_RESET); break;
+        }
+
+        printf("%16llx %16llx %.*ls\n",
+               change->id.id64,
+               change->parent_id.id64,
+               change->wname_length,
+               change->wname);
+    }
+#endif
+
+    for (change *change = changes.first; change; change = change->next) {
+        if (!change->ignore) {
+            // NOTE(rune): Without file info, the size we already have is kept, and the time of the change is
+            // the best guess for the modification time.
+            record *old_record    = db_get_record_by_id(db, change->id);
+            u64 size              = old_record ? old_record->size : 0;
+            u64 modification_time = change->timestamp;
+            if (change->has_file_info) {
+                size              = change->size;
+                modification_time = change->modification_time;
+            }
+
+            switch (change->type) {
+                case CHANGE_TYPE_INSERT: {
+                    db_insert(db,
+                              change->id,
+                              change->parent_id,
+                              change->attributes,
+                              change->wname,
+                              change->wname_length,
+                              size,
+                              modification_time);
+                } break;
+
+                case CHANGE_TYPE_UPDATE: {
+                    db_update(db,
+                              change->id,
+                              change->parent_id,
+                              change->attributes,
+                              change->wname,
+                              change->wname_length,
+                              size,
+                              modification_time);
+                } break;
+
+                case CHANGE_TYPE_DELETE: {
+                    db_delete(db, change->id);
+                } break;
+
+                case CHANGE_TYPE_MODIFY: {
+                    db_modify(db, change->id, size, modification_time);
+                } break;
+            }
+        }
+
+        db->latest_usn = max(db->latest_usn, change->usn);
+    }
+
+    if (db->trigram_index.postings.elems &&
+        db->trigram_index.stale_count > db->record_array.count / TRIGRAM_MAX_STALE_RATIO) {
+        trigram_index_build(db);
+    }
+
+    if (db->dir_names.records.elems &&
+        db->dir_names.stale_count > db->dir_names.records.count / DIR_NAMES_MAX_STALE_RATIO) {
+        dir_names_build(db);
+    }
+
+    // NOTE(rune): Moved directories and exhausted intervals only mark the tree dirty, and the path order
+    // stale, so neither is renumbered under the write lock here. The server rebuilds a dirty tree before
+    // the next query, and the first path sorted query renumbers the path order, so a burst of moves, like
+    // deleting a folder to the recycle bin, costs at most one rebuild however many batches it spans.
+}
+
+static uint32_t db_prune(db *db) {
+    // TODO(rune): Implement
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Case folding
+
+static u32 length_of_utf16_unit_as_utf8(wchar c) {
+    if (c < 0x80)  return 1;
+    if (c < 0x800) return 2;
+    return 3;
+}
+
+// NOTE(rune): Lower cases with the invariant locale, which is a simple one-to-one mapping of UTF-16 code units,
+// and matches Unicode simple case folding for nearly all code points. The few mappings which would change the
+// UTF-8 length (e.g. U+212A KELVIN SIGN -> k) are left unfolded, so that folded_name_buffer keeps the same
+// byte layout as name_buffer. Surrogate pairs are never folded.
+static void fold_utf16(wchar *wtext, u32 wtext_len) {
+    wchar folded[DB_MAX_NAME_LENGTH];
+    if (wtext_len == 0 || wtext_len > countof(folded)) {
+        return;
+    }
+
+    if (!LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_LOWERCASE, wtext, wtext_len, folded, wtext_len, null, null, 0)) {
+        debug_log_error_win32("LCMapStringEx");
+        return;
+    }
+
+    for (u32 i = 0; i < wtext_len; i++) {
+        bool is_surrogate = wtext[i] >= 0xD800 && wtext[i] <= 0xDFFF;
+        if (!is_surrogate && length_of_utf16_unit_as_utf8(folded[i]) == length_of_utf16_unit_as_utf8(wtext[i])) {
+            wtext[i] = folded[i];
+        }
+    }
+}
+
+static bool fold_utf8(char *text, usize text_length, char *folded) {
+    wchar wtext[DB_MAX_NAME_LENGTH];
+
+    if (text_length > 0 && text_length <= DB_MAX_NAME_LENGTH) {
+        int wtext_len = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, text, (int)text_length, wtext, countof(wtext));
+        if (wtext_len > 0) {
+            fold_utf16(wtext, wtext_len);
+
+            int folded_length = WideCharToMultiByte(CP_UTF8, 0, wtext, wtext_len, folded, (int)text_length, null, null);
+            if (folded_length == (int)text_length) {
+                return true;
+            }
+        }
+    }
+
+    for (usize i = 0; i < text_length; i++) {
+        folded[i] = ascii_tolower(text[i]);
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Trigram index
+
+static u32 trigram_hash(char a, char b, char c) {
+    u32 trigram = (((u32)(u8)a << 16) |
+                   ((u32)(u8)b << 8)  |
+                   ((u32)(u8)c << 0));
+
+    // NOTE(rune): Fibonacci hashing.
+    return (trigram * 2654435769u) >> (32 - TRIGRAM_BUCKET_BITS);
+}
+
+static bool trigram_index_build(db *db) {
+    trigram_index *index = &db->trigram_index;
+    trigram_index_destroy(index);
+
+    array_create(&index->postings, TRIGRAM_BUCKET_COUNT, true);
+    array_create(&index->blocks, TRIGRAM_BUCKET_COUNT, true);
+
+    trigram_posting *postings = array_push_count(&index->postings, TRIGRAM_BUCKET_COUNT, true);
+    trigram_block *null_block = array_push(&index->blocks, true);
+    if (!postings || !null_block) {
+        assert(false);
+        trigram_index_destroy(index);
+        return false;
+    }
+
+    // NOTE(rune): Records which are not in use are left out, since they can never be found anyway.
+    for (usize record_index = 0; record_index < db->record_array.count; record_index++) {
+        record *record = &db->record_array.elems[record_index];
+        if (!(record->attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
+            char *folded_name = db->folded_name_buffer.elems + record->name_offset;
+            if (!trigram_index_add(index, (u32)record_index, folded_name, record->name_length)) {
+                trigram_index_destroy(index);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void trigram_index_destroy(trigram_index *index) {
+    if (index->postings.elems) {
+        array_destroy(&index->postings);
+        array_destroy(&index->blocks);
+    }
+
+    zero_struct(index);
+}
+
+// NOTE(rune): Records must be added in ascending order, which is always the case,
+// since new records are only ever appended to the record array. name must be folded.
+static bool trigram_index_add(trigram_index *index, u32 record_index, char *name, usize name_length) {
+    if (!index->postings.elems) {
+        return true;
+    }
+
+    for (usize i = 0; i + 2 < name_length; i++) {
+        trigram_posting *posting = &index->postings.elems[trigram_hash(name[i], name[i + 1], name[i + 2])];
+
+        // NOTE(rune): A record is only added once to each posting, even if the name contains the trigram multiple times.
+        if (posting->record_count > 0 && posting->last_record_index == record_index) {
+            continue;
+        }
+
+        assert(posting->record_count == 0 || posting->last_record_index < record_index);
+
+        u32 delta = record_index - posting->last_record_index;
+        u16 needed = delta < TRIGRAM_DELTA_ESCAPE ? 1 : 3;
+
+        if (posting->last_block == 0 || index->blocks.elems[posting->last_block].count + needed > TRIGRAM_BLOCK_DELTAS) {
+            u32 new_block_index = (u32)index->blocks.count;
+
+            trigram_block *new_block = array_push(&index->blocks, true);
+            if (!new_block) {
+                assert(false);
+                return false;
+            }
+
+            if (posting->last_block == 0) {
+                posting->first_block = new_block_index;
+            } else {
+                index->blocks.elems[posting->last_block].next = new_block_index;
+            }
+
+            posting->last_block = new_block_index;
+        }
+
+        trigram_block *block = &index->blocks.elems[posting->last_block];
+        if (needed == 1) {
+            block->deltas[block->count++] = (u16)delta;
+        } else {
+            block->deltas[block->count++] = TRIGRAM_DELTA_ESCAPE;
+            block->deltas[block->count++] = (u16)(delta & 0xFFFF);
+            block->deltas[block->count++] = (u16)(delta >> 16);
+        }
+
+        posting->record_count++;
+        posting->last_record_index = record_index;
+    }
+
+    return true;
+}
+
+// NOTE(rune): Removing a record index from the middle of a delta encoded posting would mean
+// re-encoding the rest of the posting, so we just leave it, and let the verification step skip it.
+static void trigram_index_remove(db *db, record *record) {
+    if (db->trigram_index.postings.elems) {
+        db->trigram_index.stale_count++;
+    }
+}
+
+// NOTE(rune): out must have room for posting->record_count record indices.
+static usize trigram_index_decode_posting(trigram_index *index, trigram_posting *posting, u32 *out) {
+    usize out_count = 0;
+    u32 base = 0;
+
+    for (u32 block_index = posting->first_block; block_index != 0; block_index = index->blocks.elems[block_index].next) {
+        trigram_block *block = &index->blocks.elems[block_index];
+
+        usize decoded_count = simd_decode_deltas(block->deltas, block->count, base, out + out_count);
+        if (decoded_count > 0) {
+            base = out[out_count + decoded_count - 1];
+        }
+
+        out_count += decoded_count;
+    }
+
+    assert(out_count == posting->record_count);
+    return out_count;
+}
+
+static bool trigram_index_find_candidates(db *db, char *needle, usize needle_length, u32 **candidates, usize *candidate_count) {
+    trigram_index *index = &db->trigram_index;
+
+    if (!index->postings.elems || needle_length < 3 || needle_length > DB_MAX_NAME_LENGTH) {
+        return false;
+    }
+
+    // NOTE(rune): The index is built from folded names, so the needle is folded too, even for case sensitive queries.
+    char folded_needle[DB_MAX_NAME_LENGTH];
+    if (!fold_utf8(needle, needle_length, folded_needle)) {
+        return false;
+    }
+
+    needle = folded_needle;
+
+    // NOTE(rune): Select the rarest distinct postings, which are selective enough to be worth decoding.
+    trigram_posting *selected[8];
+    u32 selected_count    = 0;
+    u32 max_record_count  = (u32)(db->record_array.count / TRIGRAM_MAX_POSTING_RATIO);
+    bool any_empty        = false;
+
+    for (usize i = 0; i + 2 < needle_length; i++) {
+        trigram_posting *posting = &index->postings.elems[trigram_hash(needle[i], needle[i + 1], needle[i + 2])];
+
+        if (posting->record_count == 0) {
+            any_empty = true;
+            break;
+        }
+
+        if (posting->record_count > max_record_count) {
+            continue;
+        }
+
+        bool already_selected = false;
+        for (u32 j = 0; j < selected_count; j++) {
+            if (selected[j] == posting) {
+                already_selected = true;
+            }
+        }
+
+        if (already_selected) {
+            continue;
+        }
+
+        u32 insert_at = selected_count;
+        while (insert_at > 0 && selected[insert_at - 1]->record_count > posting->record_count) {
+            insert_at--;
+        }
+
+        if (insert_at < countof(selected)) {
+            u32 move_count = min(selected_count, countof(selected) - 1) - insert_at;
+            memmove(&selected[insert_at + 1], &selected[insert_at], move_count * sizeof(selected[0]));
+            selected[insert_at] = posting;
+            selected_count = min(selected_count + 1, countof(selected));
+        }
+    }
+
+    // NOTE(rune): No record contains the trigram, so no record can contain the needle.
+    if (any_empty) {
+        *candidates      = heap_alloc(sizeof(u32), false);
+        *candidate_count = 0;
+        return *candidates != null;
+    }
+
+    if (selected_count == 0) {
+        return false;
+    }
+
+    usize scratch_size = 0;
+    for (u32 i = 1; i < selected_count; i++) {
+        scratch_size = max(scratch_size, selected[i]->record_count);
+    }
+
+    u32 *result = heap_alloc(sizeof(u32) * (selected[0]->record_count + scratch_size), false);
+    if (!result) {
+        assert(false);
+        return false;
+    }
+
+    u32 *scratch = result + selected[0]->record_count;
+
+    usize count = trigram_index_decode_posting(index, selected[0], result);
+
+    for (u32 i = 1; i < selected_count && count > 0; i++) {
+        usize other_count = trigram_index_decode_posting(index, selected[i], scratch);
+
+        usize a = 0;
+        usize b = 0;
+        usize intersect_count = 0;
+
+        while (a < count && b < other_count) {
+            if (result[a] < scratch[b]) {
+                a++;
+            } else if (result[a] > scratch[b]) {
+                b++;
+            } else {
+                result[intersect_count++] = result[a];
+                a++;
+                b++;
+            }
+        }
+
+        count = intersect_count;
+    }
+
+    *candidates      = result;
+    *candidate_count = count;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Extension index
+
+static bool ext_from_name(char *name, usize name_length, char **ext, usize *ext_length) {
+    for (usize i = name_length; i > 0; i--) {
+        if (name[i - 1] == '.') {
+            *ext        = name + i;
+            *ext_length = name_length - i;
+            return *ext_length > 0;
+        }
+    }
+
+    return false;
+}
+
+static u32 ext_hash(char *ext, usize ext_length) {
+    // NOTE(rune): FNV-1a.
+    u32 hash = 2166136261u;
+    for (usize i = 0; i < ext_length; i++) {
+        hash ^= (u8)ext[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool ext_index_create(ext_index *index) {
+    zero_struct(index);
+
+    array_create(&index->ids, KILOBYTES(64), false);
+    array_create(&index->entries, 256, true);
+    array_create(&index->names, KILOBYTES(4), false);
+    array_create(&index->buckets, EXT_MIN_BUCKET_COUNT, true);
+    array_create(&index->pages, 1024, true);
+
+    // NOTE(rune): EXT_ID_NONE and EXT_ID_OVERFLOW have entries too, but are never in the hash table.
+    ext_entry *reserved_entries = array_push_count(&index->entries, EXT_ID_FIRST, true);
+    u16 *buckets                = array_push_count(&index->buckets, EXT_MIN_BUCKET_COUNT, true);
+    ext_page *null_page         = array_push(&index->pages, true);
+    if (!index->ids.elems || !index->names.elems || !reserved_entries || !buckets || !null_page) {
+        assert(false);
+        ext_index_destroy(index);
+        return false;
+    }
+
+    memset(reserved_entries, 0, EXT_ID_FIRST * sizeof(ext_entry));
+    memset(buckets, 0, EXT_MIN_BUCKET_COUNT * sizeof(u16));
+    zero_struct(null_page);
+    return true;
+}
+
+static void ext_index_destroy(ext_index *index) {
+    if (index->entries.elems) {
+        array_destroy(&index->ids);
+        array_destroy(&index->entries);
+        array_destroy(&index->names);
+        array_destroy(&index->buckets);
+        array_destroy(&index->pages);
+    }
+
+    zero_struct(index);
+}
+
+static bool ext_index_build(db *db) {
+    ext_index *index = &db->ext_index;
+    ext_index_destroy(index);
+
+    if (!ext_index_create(index)) {
+        return false;
+    }
+
+    for (usize record_index = 0; record_index < db->record_array.count; record_index++) {
+        record *record    = &db->record_array.elems[record_index];
+        char *folded_name = db->folded_name_buffer.elems + record->name_offset;
+        if (!ext_index_add(index, (u32)record_index, record->attributes, folded_name, record->name_length)) {
+            ext_index_destroy(index);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// NOTE(rune): Returns the bucket holding the extension, or the empty bucket where it should be inserted.
+static u16 *ext_index_find_bucket(ext_index *index, char *ext, usize ext_length) {
+    u16 *buckets = index->buckets.elems;
+    u32 mask     = (u32)index->buckets.count - 1;
+    u32 at       = ext_hash(ext, ext_length) & mask;
+
+    while (buckets[at] != EXT_ID_NONE) {
+        ext_entry *entry = &index->entries.elems[buckets[at]];
+        if (entry->name_length == ext_length && memcmp(index->names.elems + entry->name_offset, ext, ext_length) == 0) {
+            break;
+        }
+
+        at = (at + 1) & mask;
+    }
+
+    return &buckets[at];
+}
+
+static bool ext_index_grow_buckets(ext_index *index) {
+    array(u16) old_buckets = index->buckets;
+    usize new_bucket_count = old_buckets.count * 2;
+
+    array_create(&index->buckets, new_bucket_count, true);
+    u16 *buckets = array_push_count(&index->buckets, new_bucket_count, true);
+    if (!buckets) {
+        assert(false);
+        array_destroy(&index->buckets);
+        index->buckets = old_buckets;
+        return false;
+    }
+
+    memset(buckets, 0, new_bucket_count * sizeof(u16));
+
+    for (usize id = EXT_ID_FIRST; id < index->entries.count; id++) {
+        ext_entry *entry = &index->entries.elems[id];
+        *ext_index_find_bucket(index, index->names.elems + entry->name_offset, entry->name_length) = (u16)id;
+    }
+
+    array_destroy(&old_buckets);
+    return true;
+}
+
+static u16 ext_index_find_or_add_id(ext_index *index, char *ext, usize ext_length) {
+    u16 *bucket = ext_index_find_bucket(index, ext, ext_length);
+    if (*bucket != EXT_ID_NONE) {
+        return *bucket;
+    }
+
+    if (index->entries.count >= EXT_MAX_IDS) {
+        return EXT_ID_OVERFLOW;
+    }
+
+    u32 name_offset  = (u32)index->names.count;
+    char *name       = array_push_count(&index->names, ext_length, false);
+    ext_entry *entry = array_push(&index->entries, true);
+    if (!name || !entry) {
+        assert(false);
+        return EXT_ID_OVERFLOW;
+    }
+
+    zero_struct(entry);
+    entry->name_offset = name_offset;
+    entry->name_length = (u32)ext_length;
+    memcpy(name, ext, ext_length);
+
+    u16 id  = (u16)(index->entries.count - 1);
+    *bucket = id;
+
+    // NOTE(rune): Keep the load factor at or below 1/2.
+    if (index->entries.count * 2 > index->buckets.count) {
+        ext_index_grow_buckets(index);
+    }
+
+    return id;
+}
+
+static bool ext_index_add(ext_index *index, u32 record_index, u32 attributes, char *name, usize name_length) {
+    if (!index->entries.elems) {
+        return true;
+    }
+
+    assert(record_index == index->ids.count);
+
+    u16 id = EXT_ID_NONE;
+
+    char *ext        = null;
+    usize ext_length = 0;
+    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY) && ext_from_name(name, name_length, &ext, &ext_length)) {
+        id = ext_index_find_or_add_id(index, ext, ext_length);
+    }
+
+    u16 *id_slot = array_push(&index->ids, false);
+    if (!id_slot) {
+        assert(false);
+        return false;
+    }
+
+    *id_slot = id;
+
+    // NOTE(rune): Records which are not in use are left out of the postings, since they can never be found anyway.
+    if (id == EXT_ID_NONE || (attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
+        return true;
+    }
+
+    // NOTE(rune): Records are added in ascending order, so a new page is only ever appended to the end.
+    u32 first_record_index = record_index - record_index % EXT_PAGE_RECORDS;
+    u32 last_page          = index->entries.elems[id].last_page;
+
+    if (last_page == 0 || index->pages.elems[last_page].first_record_index != first_record_index) {
+        assert(last_page == 0 || index->pages.elems[last_page].first_record_index < first_record_index);
+
+        u32 new_page_index = (u32)index->pages.count;
+
+        ext_page *new_page = array_push(&index->pages, true);
+        if (!new_page) {
+            assert(false);
+            return false;
+        }
+
+        zero_struct(new_page);
+        new_page->first_record_index = first_record_index;
+
+        if (last_page == 0) {
+            index->entries.elems[id].first_page = new_page_index;
+        } else {
+            index->pages.elems[last_page].next = new_page_index;
+        }
+
+        index->entries.elems[id].last_page = new_page_index;
+        last_page = new_page_index;
+    }
+
+    u32 bit = record_index - first_record_index;
+    index->pages.elems[last_page].words[bit / 64] |= (u64)1 << (bit % 64);
+    index->entries.elems[id].record_count++;
+
+    return true;
+}
+
+// NOTE(rune): Unlike the trigram index, the postings are bitmaps, so we can clear the record's
+// bit directly, after walking to its page.
+static void ext_index_remove(ext_index *index, u32 record_index) {
+    if (!index->entries.elems || record_index >= index->ids.count) {
+        return;
+    }
+
+    u16 id = index->ids.elems[record_index];
+    if (id == EXT_ID_NONE) {
+        return;
+    }
+
+    ext_entry *entry       = &index->entries.elems[id];
+    u32 first_record_index = record_index - record_index % EXT_PAGE_RECORDS;
+
+    for (u32 page_index = entry->first_page; page_index != 0; page_index = index->pages.elems[page_index].next) {
+        ext_page *page = &index->pages.elems[page_index];
+        if (page->first_record_index > first_record_index) {
+            break;
+        }
+
+        if (page->first_record_index == first_record_index) {
+            u32 bit  = record_index - first_record_index;
+            u64 mask = (u64)1 << (bit % 64);
+
+            if (page->words[bit / 64] & mask) {
+                page->words[bit / 64] &= ~mask;
+                entry->record_count--;
+            }
+
+            break;
+        }
+    }
+}
+
+static u16 ext_index_find(ext_index *index, char *ext, usize ext_length) {
+    if (!index->entries.elems) {
+        return EXT_ID_OVERFLOW;
+    }
+
+    u16 id = *ext_index_find_bucket(index, ext, ext_length);
+    return id != EXT_ID_NONE ? id : EXT_ID_OVERFLOW;
+}
+
+// NOTE(rune): out must have room for entry->record_count record indices.
+static usize ext_index_decode_posting(ext_index *index, ext_entry *entry, u32 *out) {
+    usize out_count = 0;
+
+    for (u32 page_index = entry->first_page; page_index != 0; page_index = index->pages.elems[page_index].next) {
+        ext_page *page = &index->pages.elems[page_index];
+
+        for (u32 i = 0; i < EXT_PAGE_WORDS; i++) {
+            u64 word = page->words[i];
+            while (word != 0) {
+                out[out_count++] = page->first_record_index + i * 64 + (u32)count_trailing_zeroes64(word);
+                word = clear_leftmost_set64(word);
+            }
+        }
+    }
+
+    assert(out_count == entry->record_count);
+    return out_count;
+}
+
+static bool ext_index_find_candidates(db *db, char **exts, usize *ext_lengths, u32 ext_count, usize max_candidate_count, u32 **candidates, usize *candidate_count) {
+    ext_index *index = &db->ext_index;
+
+    if (!index->entries.elems || ext_count == 0 || ext_count > QUERY_MAX_EXTS) {
+        return false;
+    }
+
+    ext_entry *selected[QUERY_MAX_EXTS];
+    u32 selected_count = 0;
+    usize total_count  = 0;
+
+    for (u32 i = 0; i < ext_count; i++) {
+        // NOTE(rune): No name can have an extension longer than DB_MAX_NAME_LENGTH.
+        if (ext_lengths[i] > DB_MAX_NAME_LENGTH) {
+            continue;
+        }
+
+        char folded_ext[DB_MAX_NAME_LENGTH];
+        fold_utf8(exts[i], ext_lengths[i], folded_ext);
+
+        ext_entry *entry = &index->entries.elems[ext_index_find(index, folded_ext, ext_lengths[i])];
+
+        bool already_selected = false;
+        for (u32 j = 0; j < selected_count; j++) {
+            if (selected[j] == entry) {
+                already_selected = true;
+            }
+        }
+
+        if (!already_selected) {
+            selected[selected_count++] = entry;
+            total_count += entry->record_count;
+        }
+    }
+
+    if (total_count > max_candidate_count) {
+        return false;
+    }
+
+    // NOTE(rune): With multiple extensions, each posting is decoded to scratch, and then merged into result.
+    usize scratch_size = selected_count > 1 ? total_count : 0;
+
+    u32 *result = heap_alloc(sizeof(u32) * (total_count + scratch_size + 1), false);
+    if (!result) {
+        assert(false);
+        return false;
+    }
+
+    if (selected_count == 1) {
+        ext_index_decode_posting(index, selected[0], result);
+    } else if (selected_count > 1) {
+        u32 *scratch = result + total_count;
+        usize at[QUERY_MAX_EXTS];
+        usize end[QUERY_MAX_EXTS];
+
+        usize decoded_count = 0;
+        for (u32 i = 0; i < selected_count; i++) {
+            at[i]          = decoded_count;
+            decoded_count += ext_index_decode_posting(index, selected[i], scratch + decoded_count);
+            end[i]         = decoded_count;
+        }
+
+        // NOTE(rune): Each record has only one extension, so the postings never overlap.
+        for (usize out = 0; out < total_count; out++) {
+            u32 smallest = 0;
+            for (u32 i = 1; i < selected_count; i++) {
+                if (at[i] < end[i] && (at[smallest] == end[smallest] || scratch[at[i]] < scratch[at[smallest]])) {
+                    smallest = i;
+                }
+            }
+
+            result[out] = scratch[at[smallest]++];
+        }
+    }
+
+    *candidates      = result;
+    *candidate_count = total_count;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Name index
+
+static bool name_index_create(name_index *index) {
+    zero_struct(index);
+
+    array_create(&index->buckets, NAME_INDEX_MIN_BUCKET_COUNT, true);
+    array_create(&index->next, KILOBYTES(64), false);
+
+    u32 *buckets = array_push_count(&index->buckets, NAME_INDEX_MIN_BUCKET_COUNT, true);
+    if (!buckets || !index->next.elems) {
+        assert(false);
+        name_index_destroy(index);
+        return false;
+    }
+
+    memset(buckets, 0, NAME_INDEX_MIN_BUCKET_COUNT * sizeof(u32));
+    return true;
+}
+
+static void name_index_destroy(name_index *index) {
+    if (index->buckets.elems) {
+        array_destroy(&index->buckets);
+    }
+
+    if (index->next.elems) {
+        array_destroy(&index->next);
+    }
+
+    zero_struct(index);
+}
+
+static bool name_index_build(db *db) {
+    name_index *index = &db->name_index;
+    name_index_destroy(index);
+
+    if (!name_index_create(index)) {
+        return false;
+    }
+
+    for (usize record_index = 0; record_index < db->record_array.count; record_index++) {
+        if (!name_index_add(db, (u32)record_index)) {
+            name_index_destroy(index);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void name_index_link(db *db, u32 record_index) {
+    name_index *index = &db->name_index;
+    record *record    = &db->record_array.elems[record_index];
+    char *folded_name = db->folded_name_buffer.elems + record->name_offset;
+
+    u32 mask = (u32)index->buckets.count - 1;
+    u32 at   = ext_hash(folded_name, record->name_length) & mask;
+
+    index->next.elems[record_index] = index->buckets.elems[at];
+    index->buckets.elems[at]        = record_index + 1;
+}
+
+static bool name_index_add(db *db, u32 record_index) {
+    name_index *index = &db->name_index;
+    if (!index->buckets.elems) {
+        return false;
+    }
+
+    assert(record_index == index->next.count);
+
+    u32 *next = array_push(&index->next, true);
+    if (!next) {
+        assert(false);
+        name_index_destroy(index);
+        return false;
+    }
+
+    // NOTE(rune): Keep the load factor at or below 1. Relinking in record order keeps each chain in descending order.
+    if (index->next.count > index->buckets.count) {
+        usize bucket_count = index->buckets.count * 2;
+        u32 *buckets       = array_push_count(&index->buckets, bucket_count - index->buckets.count, true);
+        if (!buckets) {
+            assert(false);
+            name_index_destroy(index);
+            return false;
+        }
+
+        memset(index->buckets.elems, 0, bucket_count * sizeof(u32));
+        for (u32 i = 0; i < record_index; i++) {
+            name_index_link(db, i);
+        }
+    }
+
+    name_index_link(db, record_index);
+    return true;
+}
+
+static bool name_index_find_candidates(db *db, char *text, usize text_length, u32 **candidates, usize *candidate_count) {
+    name_index *index = &db->name_index;
+    if (!index->buckets.elems || index->next.count != db->record_array.count) {
+        return false;
+    }
+
+    // NOTE(rune): Bounded by DB_MAX_NAME_LENGTH, so the folded text fits on the stack. No name is longer.
+    char folded_text[DB_MAX_NAME_LENGTH];
+    bool too_long = text_length > DB_MAX_NAME_LENGTH;
+    if (!too_long) {
+        fold_utf8(text, text_length, folded_text);
+    }
+
+    // NOTE(rune): First count, then collect in ascending order.
+    u32 mask    = (u32)index->buckets.count - 1;
+    u32 head    = too_long ? 0 : index->buckets.elems[ext_hash(folded_text, text_length) & mask];
+    usize count = 0;
+
+    for (u32 at = head; at != 0; at = index->next.elems[at - 1]) {
+        record *record = &db->record_array.elems[at - 1];
+        if (!(record->attributes & FILE_ATTRIBUTE_NOT_IN_USE) &&
+            record->name_length == text_length &&
+            memcmp(db->folded_name_buffer.elems + record->name_offset, folded_text, text_length) == 0) {
+            count++;
+        }
+    }
+
+    u32 *result = heap_alloc(sizeof(u32) * (count + 1), false);
+    if (!result) {
+        assert(false);
+        return false;
+    }
+
+    usize i = count;
+    for (u32 at = head; at != 0; at = index->next.elems[at - 1]) {
+        record *record = &db->record_array.elems[at - 1];
+        if (!(record->attributes & FILE_ATTRIBUTE_NOT_IN_USE) &&
+            record->name_length == text_length &&
+            memcmp(db->folded_name_buffer.elems + record->name_offset, folded_text, text_length) == 0) {
+            result[--i] = at - 1;
+        }
+    }
+
+    *candidates      = result;
+    *candidate_count = count;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Directory names
+
+static bool dir_names_create(dir_names *names) {
+    zero_struct(names);
+
+    array_create(&names->names, KILOBYTES(64), false);
+    array_create(&names->folded_names, KILOBYTES(64), false);
+    array_create(&names->records, KILOBYTES(4), false);
+
+    if (!names->names.elems || !names->folded_names.elems || !names->records.elems) {
+        assert(false);
+        dir_names_destroy(names);
+        return false;
+    }
+
+    return true;
+}
+
+static void dir_names_destroy(dir_names *names) {
+    if (names->names.elems) {
+        array_destroy(&names->names);
+    }
+
+    if (names->folded_names.elems) {
+        array_destroy(&names->folded_names);
+    }
+
+    if (names->records.elems) {
+        array_destroy(&names->records);
+    }
+
+    zero_struct(names);
+}
+
+static bool dir_names_build(db *db) {
+    dir_names *names = &db->dir_names;
+    dir_names_destroy(names);
+
+    if (!dir_names_create(names)) {
+        return false;
+    }
+
+    for (usize record_index = 0; record_index < db->record_array.count; record_index++) {
+        // NOTE(rune): Deleted directories are left out, so a rebuild drops all stale names.
+        if (db->record_array.elems[record_index].attributes & FILE_ATTRIBUTE_NOT_IN_USE) {
+            continue;
+        }
+
+        if (!dir_names_add(db, (u32)record_index)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool dir_names_add(db *db, u32 record_index) {
+    dir_names *names = &db->dir_names;
+    record *record   = &db->record_array.elems[record_index];
+
+    if (!names->records.elems) {
+        return false;
+    }
+
+    if (!(record->attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return true;
+    }
+
+    // NOTE(rune): Same padding as the name buffer, since the SIMD kernels read in whole blocks.
+    usize size = record->name_length + 1;
+    if (!array_reserve(&names->names, names->names.count + size + DB_NAME_BUFFER_PADDING, false) ||
+        !array_reserve(&names->folded_names, names->folded_names.count + size + DB_NAME_BUFFER_PADDING, false)) {
+        assert(false);
+        dir_names_destroy(names);
+        return false;
+    }
+
+    char *name        = array_push_count(&names->names, size, false);
+    char *folded_name = array_push_count(&names->folded_names, size, false);
+    u32 *mapping      = array_push(&names->records, false);
+    if (!name || !folded_name || !mapping) {
+        assert(false);
+        dir_names_destroy(names);
+        return false;
+    }
+
+    memcpy(name, db->name_buffer.elems + record->name_offset, size);
+    memcpy(folded_name, db->folded_name_buffer.elems + record->name_offset, size);
+    *mapping = record_index;
+    return true;
+}
+
+static void dir_names_remove(db *db, record *record) {
+    if (db->dir_names.records.elems && (record->attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        db->dir_names.stale_count++;
+    }
+}
+
+static bool dir_names_find_candidates(db *db, char *needle, usize needle_length, quickfind_flags flags, u32 **candidates, usize *candidate_count) {
+    dir_names *names = &db->dir_names;
+    if (!names->records.elems) {
+        return false;
+    }
+
+    // NOTE(rune): At most one candidate per name, so we never have to grow the result.
+    u32 *result = heap_alloc(sizeof(u32) * (names->records.count + 1), false);
+    if (!result) {
+        assert(false);
+        return false;
+    }
+
+    usize count = 0;
+
+    if (needle_length == 0) {
+        for (usize i = 0; i < names->records.count; i++) {
+            u32 record_index = names->records.elems[i];
+            if (!(db->record_array.elems[record_index].attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
+                result[count++] = record_index;
+            }
+        }
+    } else if (needle_length <= DB_MAX_NAME_LENGTH) {
+        // NOTE(rune): Like query_iter_init, case insensitive queries scan the folded names for the folded needle.
+        char folded_needle[DB_MAX_NAME_LENGTH];
+        char *buffer = names->names.elems;
+        if (!(flags & QUICKFIND_FLAG_CASE_SENSITIVE)) {
+            fold_utf8(needle, needle_length, folded_needle);
+            needle = folded_needle;
+            buffer = names->folded_names.elems;
+        }
+
+        char *at         = buffer;
+        char *end        = buffer + names->names.count;
+        usize name_index = 0;
+
+        while (at < end) {
+            usize null_count = 0;
+            char *match      = find_first_occurrence_and_count_nulls(at, end - at, needle, needle_length, QUICKFIND_FLAG_CASE_SENSITIVE, &null_count);
+            if (match == null || match >= end) {
+                break;
+            }
+
+            char *name_end = simd_memchr(match, end - match, '\0');
+            if (name_end == null || name_end >= end) {
+                assert(false);
+                break;
+            }
+
+            // NOTE(rune): Same as query_iter_advance, the null at the end of the name is counted by the next search.
+            name_index += null_count;
+            at          = name_end;
+
+            if (name_index >= names->records.count) {
+                assert(false);
+                break;
+            }
+
+            u32 record_index = names->records.elems[name_index];
+            if (!(db->record_array.elems[record_index].attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
+                result[count++] = record_index;
+            }
+        }
+    }
+
+    *candidates      = result;
+    *candidate_count = count;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Directory tree
+
+// NOTE(rune): Like db_get_record_parent, but returns 0 instead of asserting if the parent is missing.
+static u32 dir_tree_parent_index(db *db, record *record) {
+    u64 parent_record_number = record->parent_id.record_number;
+    if (parent_record_number >= db->lookup_array.count) {
+        return 0;
+    }
+
+    u32 parent_index = db->lookup_array.elems[parent_record_number];
+    return parent_index < db->record_array.count ? parent_index : 0;
+}
+
+static inline bool dir_tree_is_live_directory(record *record) {
+    return (record->attributes & FILE_ATTRIBUTE_DIRECTORY) && !(record->attributes & FILE_ATTRIBUTE_NOT_IN_USE);
+}
+
+// NOTE(rune): Deleted directories are numbered too, as long as no newer record has taken their record
+// number, since walk_ancestors_is_child_of_root still walks through them.
+static inline bool dir_tree_is_numbered(db *db, u32 record_index) {
+    record *record = &db->record_array.elems[record_index];
+    return (record->attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+           record->id.record_number < db->lookup_array.count &&
+           db->lookup_array.elems[record->id.record_number] == record_index;
+}
+
+static u32 dir_tree_hash(u64 parent_record_number, char *name, usize name_length) {
+    u64 hash = ext_hash(name, name_length) ^ (parent_record_number * 0x9E3779B97F4A7C15ull);
+    return (u32)(hash >> 32) ^ (u32)hash;
+}
+
+static void dir_tree_insert_bucket(db *db, u32 record_index) {
+    dir_tree *tree    = &db->dir_tree;
+    record *record    = &db->record_array.elems[record_index];
+    char *folded_name = db->folded_name_buffer.elems + record->name_offset;
+
+    u32 mask = (u32)tree->buckets.count - 1;
+    u32 at   = dir_tree_hash(record->parent_id.record_number, folded_name, record->name_length) & mask;
+    while (tree->buckets.elems[at] != 0) {
+        at = (at + 1) & mask;
+    }
+
+    tree->buckets.elems[at] = record_index + 1;
+    tree->bucket_used_count++;
+}
+
+// NOTE(rune): (Re)creates the hash table with all directories in use, which also drops deleted directories.
+static bool dir_tree_create_buckets(db *db, usize bucket_count) {
+    dir_tree *tree = &db->dir_tree;
+    if (tree->buckets.elems) {
+        array_destroy(&tree->buckets);
+    }
+
+    array_create(&tree->buckets, bucket_count, true);
+    u32 *buckets = array_push_count(&tree->buckets, bucket_count, true);
+    if (!buckets) {
+        assert(false);
+        return false;
+    }
+
+    memset(buckets, 0, bucket_count * sizeof(u32));
+    tree->bucket_used_count = 0;
+
+    for (usize record_index = 0; record_index < db->record_array.count; record_index++) {
+        if (dir_tree_is_live_directory(&db->record_array.elems[record_index])) {
+            dir_tree_insert_bucket(db, (u32)record_index);
+        }
+    }
+
+    return true;
+}
+
+// NOTE(rune): Bottom up merge sort of record indices by folded name. scratch must have room for count indices.
+static void dir_tree_sort_by_folded_name(db *db, u32 *indices, u32 count, u32 *scratch) {
+    char *folded_names = db->folded_name_buffer.elems;
+    record *records    = db->record_array.elems;
+
+    u32 *src = indices;
+    u32 *dst = scratch;
+    for (u32 width = 1; width < count; width *= 2) {
+        for (u32 begin = 0; begin < count; begin += width * 2) {
+            u32 middle = min(begin + width, count);
+            u32 end    = min(begin + width * 2, count);
+            u32 a      = begin;
+            u32 b      = middle;
+            u32 at     = begin;
+
+            while (a < middle && b < end) {
+                char *a_name = folded_names + records[src[a]].name_offset;
+                char *b_name = folded_names + records[src[b]].name_offset;
+                dst[at++] = strcmp(b_name, a_name) < 0 ? src[b++] : src[a++];
+            }
+
+            while (a < middle) dst[at++] = src[a++];
+            while (b < end)    dst[at++] = src[b++];
+        }
+
+        u32 *temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    if (src != indices) {
+        memcpy(indices, src, count * sizeof(u32));
+    }
+}
+
+// NOTE(rune): The children of directory i are written to children[first_child[i]..first_child[i + 1]].
+// first_child must have room for record_count + 2 zeroed entries. Returns the number of numbered directories.
+static u32 dir_tree_collect_children(db *db, u32 *first_child, u32 *children) {
+    u32 record_count = (u32)db->record_array.count;
+    record *records  = db->record_array.elems;
+
+    u32 dir_count = 0;
+    for (u32 i = 0; i < record_count; i++) {
+        if (dir_tree_is_numbered(db, i)) {
+            dir_count++;
+
+            u32 parent_index = dir_tree_parent_index(db, &records[i]);
+            if (parent_index != i && dir_tree_is_numbered(db, parent_index)) {
+                first_child[parent_index + 2]++;
+            }
+        }
+    }
+
+    // NOTE(rune): Prefix sum, so first_child[i + 1] is where the children of i are written.
+    for (u32 i = 2; i < record_count + 2; i++) {
+        first_child[i] += first_child[i - 1];
+    }
+
+    for (u32 i = 0; i < record_count; i++) {
+        if (dir_tree_is_numbered(db, i)) {
+            u32 parent_index = dir_tree_parent_index(db, &records[i]);
+            if (parent_index != i && dir_tree_is_numbered(db, parent_index)) {
+                children[first_child[parent_index + 1]++] = i;
+            }
+        }
+    }
+
+    return dir_count;
+}
+
+static bool dir_tree_build(db *db) {
+    dir_tree *tree = &db->dir_tree;
+    dir_tree_destroy(tree);
+
+    u32 record_count = (u32)db->record_array.count;
+    record *records  = db->record_array.elems;
+
+    array_create(&tree->intervals, max(record_count, 1), true);
+    dir_interval *intervals = array_push_count(&tree->intervals, record_count, true);
+
+    // NOTE(rune): The children of directory i are children[first_child[i]..first_child[i + 1]].
+    u32 *first_child = heap_alloc((record_count + 2) * sizeof(u32), true);
+    u32 *children    = heap_alloc((record_count + 1) * sizeof(u32), false);
+    u32 *stack       = heap_alloc((record_count + 1) * sizeof(u32) * 2, false);
+
+    bool ok = intervals && first_child && children && stack;
+    if (ok) {
+        memset(intervals, 0, record_count * sizeof(dir_interval));
+
+        u32 dir_count = dir_tree_collect_children(db, first_child, children);
+
+        // NOTE(rune): Leave as many spare numbers as we can afford with 32-bit numbers.
+        u32 spare   = min(DIR_TREE_MAX_SPARE, 0xFFFFFFF0u / (dir_count + 1) - 1);
+        u32 counter = 1;
+
+        tree->root_record_index = 0;
+
+        for (u32 root_index = 0; root_index < record_count; root_index++) {
+            record *root = &records[root_index];
+            if (!dir_tree_is_numbered(db, root_index) || root->id.id64 != root->parent_id.id64 || intervals[root_index].enter != 0) {
+                continue;
+            }
+
+            if (tree->root_record_index == 0) {
+                tree->root_record_index = root_index;
+            }
+
+            intervals[root_index].reachable = true;
+
+            // NOTE(rune): Iterative depth first traversal, where the stack holds pairs of directory and next child.
+            u32 stack_count = 0;
+            stack[stack_count * 2 + 0] = root_index;
+            stack[stack_count * 2 + 1] = first_child[root_index];
+            stack_count++;
+            intervals[root_index].enter = counter++;
+
+            while (stack_count > 0) {
+                u32 dir_index = stack[(stack_count - 1) * 2 + 0];
+                u32 *cursor   = &stack[(stack_count - 1) * 2 + 1];
+
+                if (*cursor < first_child[dir_index + 1]) {
+                    u32 child_index = children[(*cursor)++];
+                    if (intervals[child_index].enter == 0) {
+                        intervals[child_index].enter     = counter++;
+                        intervals[child_index].depth     = intervals[dir_index].depth + 1;
+                        intervals[child_index].reachable = intervals[child_index].depth < WALK_ANCESTORS_MAX_DEPTH;
+
+                        stack[stack_count * 2 + 0] = child_index;
+                        stack[stack_count * 2 + 1] = first_child[child_index];
+                        stack_count++;
+                    }
+                } else {
+                    intervals[dir_index].next_free = counter;
+                    counter += spare;
+                    intervals[dir_index].exit = counter - 1;
+                    stack_count--;
+                }
+            }
+        }
+
+        // NOTE(rune): Files, and directories which were not reached from a root, are one below their parent.
+        for (u32 i = 0; i < record_count; i++) {
+            if (intervals[i].enter == 0) {
+                u32 parent_index = dir_tree_parent_index(db, &records[i]);
+                if (parent_index != i && intervals[parent_index].enter != 0) {
+                    intervals[i].depth     = intervals[parent_index].depth + 1;
+                    intervals[i].reachable = (intervals[parent_index].reachable &&
+                                              intervals[i].depth < WALK_ANCESTORS_MAX_DEPTH &&
+                                              dir_tree_has_parent(db, &records[i], parent_index));
+                }
+            }
+        }
+
+        usize bucket_count = DIR_TREE_MIN_BUCKET_COUNT;
+        while (bucket_count < (usize)dir_count * 2) {
+            bucket_count *= 2;
+        }
+
+        ok = dir_tree_create_buckets(db, bucket_count);
+    }
+
+    if (first_child) heap_free(first_child);
+    if (children)    heap_free(children);
+    if (stack)       heap_free(stack);
+
+    if (ok) {
+        ok = dir_tree_number_paths(db);
+    }
+
+    if (!ok) {
+        assert(false);
+        dir_tree_destroy(tree);
+    }
+
+    return ok;
+}
+
+static bool dir_tree_number_paths(db *db) {
+    dir_tree *tree = &db->dir_tree;
+    if (!tree->intervals.elems || tree->intervals.count != db->record_array.count) {
+        return false;
+    }
+
+    u32 record_count        = (u32)db->record_array.count;
+    record *records         = db->record_array.elems;
+    dir_interval *intervals = tree->intervals.elems;
+
+    u32 *first_child = heap_alloc((record_count + 2) * sizeof(u32), true);
+    u32 *children    = heap_alloc((record_count + 1) * sizeof(u32), false);
+    u32 *stack       = heap_alloc((record_count + 1) * sizeof(u32) * 2, false);
+
+    bool ok = first_child && children && stack;
+    if (ok) {
+        dir_tree_collect_children(db, first_child, children);
+
+        // NOTE(rune): The stack is not used yet, so it doubles as scratch space for sorting.
+        for (u32 i = 0; i < record_count; i++) {
+            u32 child_count = first_child[i + 1] - first_child[i];
+            if (child_count > 1) {
+                dir_tree_sort_by_folded_name(db, children + first_child[i], child_count, stack);
+            }
+
+            intervals[i].path_order = 0;
+        }
+
+        u32 counter = 1;
+        for (u32 root_index = 0; root_index < record_count; root_index++) {
+            record *root = &records[root_index];
+            if (!dir_tree_is_numbered(db, root_index) || root->id.id64 != root->parent_id.id64 || intervals[root_index].path_order != 0) {
+                continue;
+            }
+
+            // NOTE(rune): Iterative depth first traversal, where the stack holds pairs of directory and next child.
+            u32 stack_count = 0;
+            stack[stack_count * 2 + 0] = root_index;
+            stack[stack_count * 2 + 1] = first_child[root_index];
+            stack_count++;
+            intervals[root_index].path_order = counter++;
+
+            while (stack_count > 0) {
+                u32 dir_index = stack[(stack_count - 1) * 2 + 0];
+                u32 *cursor   = &stack[(stack_count - 1) * 2 + 1];
+
+                if (*cursor < first_child[dir_index + 1]) {
+                    u32 child_index = children[(*cursor)++];
+                    if (intervals[child_index].path_order == 0) {
+                        intervals[child_index].path_order = counter++;
+
+                        stack[stack_count * 2 + 0] = child_index;
+                        stack[stack_count * 2 + 1] = first_child[child_index];
+                        stack_count++;
+                    }
+                } else {
+                    stack_count--;
+                }
+            }
+        }
+
+        tree->path_order_stale = false;
+    }
+
+    if (first_child) heap_free(first_child);
+    if (children)    heap_free(children);
+    if (stack)       heap_free(stack);
+
+    return ok;
+}
+
+// NOTE(rune): Queries hold the database lock exclusively, see server_acquire_read_lock, so
+// rebuilding or renumbering here does not race with other queries.
+static void dir_tree_prepare_intervals(db *db) {
+    if (db->dir_tree.intervals.elems && db->dir_tree.dirty) {
+        dir_tree_build(db);
+    }
+}
+
+static void dir_tree_prepare_path_order(db *db) {
+    if (dir_tree_is_valid(db) && db->dir_tree.path_order_stale) {
+        dir_tree_number_paths(db);
+    }
+}
+
+static u32 dir_tree_get_parent_path_order(db *db, record *record) {
+    dir_tree *tree = &db->dir_tree;
+    if (!dir_tree_is_valid(db) || tree->path_order_stale) {
+        return 0;
+    }
+
+    u32 record_index = (u32)(record - db->record_array.elems);
+    u32 parent_index = dir_tree_parent_index(db, record);
+    if (parent_index == record_index || !dir_tree_has_parent(db, record, parent_index)) {
+        return 0;
+    }
+
+    return tree->intervals.elems[parent_index].path_order;
+}
+
+static void dir_tree_destroy(dir_tree *tree) {
+    if (tree->intervals.elems) {
+        array_destroy(&tree->intervals);
+    }
+
+    if (tree->buckets.elems) {
+        array_destroy(&tree->buckets);
+    }
+
+    zero_struct(tree);
+}
+
+static void dir_tree_add(db *db, record *record, u32 replaced_record_index) {
+    dir_tree *tree = &db->dir_tree;
+    if (!tree->intervals.elems) {
+        return;
+    }
+
+    u32 record_index = (u32)(record - db->record_array.elems);
+    assert(record_index == tree->intervals.count);
+
+    dir_interval *interval = array_push(&tree->intervals, true);
+    if (!interval) {
+        assert(false);
+        dir_tree_destroy(tree);
+        return;
+    }
+
+    zero_struct(interval);
+
+    // NOTE(rune): The parent is always added before its children, but a moved directory leaves
+    // the depths of its descendants stale until the tree is renumbered.
+    u32 parent_index = dir_tree_parent_index(db, record);
+    if (parent_index != record_index && parent_index < record_index) {
+        dir_interval *parent = &tree->intervals.elems[parent_index];
+        interval->depth      = parent->depth + 1;
+        interval->reachable  = parent->reachable && interval->depth < WALK_ANCESTORS_MAX_DEPTH && dir_tree_has_parent(db, record, parent_index);
+    }
+
+    if (record->id.id64 == record->parent_id.id64) {
+        interval->reachable = true;
+    }
+
+    // NOTE(rune): Children of a directory whose record number is taken by a file now walk through the file.
+    if (!dir_tree_is_live_directory(record)) {
+        if (replaced_record_index != 0 && replaced_record_index < record_index &&
+            (db->record_array.elems[replaced_record_index].attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            tree->dirty = true;
+        }
+
+        return;
+    }
+
+    tree->path_order_stale = true;
+
+    // NOTE(rune): Keep the load factor at or below 1/2. Recreating the table also inserts the new record.
+    if ((tree->bucket_used_count + 1) * 2 > tree->buckets.count) {
+        if (!dir_tree_create_buckets(db, tree->buckets.count * 2)) {
+            dir_tree_destroy(tree);
+            return;
+        }
+    } else {
+        dir_tree_insert_bucket(db, record_index);
+    }
+
+    // NOTE(rune): A renamed directory keeps its interval, since its descendants are unchanged. A
+    // moved directory may take its descendants along, so the whole tree must be renumbered.
+    if (replaced_record_index != 0 && replaced_record_index < record_index) {
+        struct record *replaced = &db->record_array.elems[replaced_record_index];
+        if (replaced->attributes & FILE_ATTRIBUTE_DIRECTORY) {
+            dir_interval replaced_interval = tree->intervals.elems[replaced_record_index];
+            if (replaced->parent_id.id64 == record->parent_id.id64 && replaced_interval.enter != 0 &&
+                replaced_interval.reachable == interval->reachable) {
+                *interval = replaced_interval;
+            } else {
+                tree->dirty = true;
+            }
+
+            return;
+        }
+    }
+
+    // NOTE(rune): A new directory has no descendants yet, so it can take half of the parent's spare numbers.
+    // Its own spare numbers are then half of those, so new directories nested below each other, and new
+    // siblings, both run out after about log2(spare) directories, instead of after a fixed couple.
+    if (parent_index == record_index || !dir_tree_is_numbered(db, parent_index)) {
+        tree->dirty = true;
+        return;
+    }
+
+    dir_interval *parent = &tree->intervals.elems[parent_index];
+    if (parent->enter == 0 || parent->next_free > parent->exit) {
+        tree->dirty = true;
+        return;
+    }
+
+    u32 remaining = parent->exit - parent->next_free + 1;
+    u32 taken     = max(remaining / 2, 1);
+
+    interval->enter     = parent->next_free;
+    interval->exit      = parent->next_free + taken - 1;
+    interval->next_free = interval->enter + 1;
+    parent->next_free  += taken;
+}
+
+static bool dir_tree_is_valid(db *db) {
+    dir_tree *tree = &db->dir_tree;
+    return tree->intervals.elems && !tree->dirty && tree->intervals.count == db->record_array.count;
+}
+
+static bool dir_tree_find_path(db *db, char *path, usize path_length, u32 *record_index) {
+    dir_tree *tree  = &db->dir_tree;
+    record *records = db->record_array.elems;
+
+    if (!tree->buckets.elems || tree->root_record_index >= db->record_array.count) {
+        return false;
+    }
+
+    usize i = 0;
+
+    // NOTE(rune): The database only holds the C: volume, like walk_ancestors_build_path assumes.
+    if (path_length >= 2 && path[1] == ':') {
+        if (path[0] != 'C' && path[0] != 'c') {
+            return false;
+        }
+
+        i = 2;
+    }
+
+    u32 current = tree->root_record_index;
+    u32 mask    = (u32)tree->buckets.count - 1;
+
+    while (i < path_length) {
+        while (i < path_length && (path[i] == '\\' || path[i] == '/')) {
+            i++;
+        }
+
+        usize component_begin = i;
+        while (i < path_length && !(path[i] == '\\' || path[i] == '/')) {
+            i++;
+        }
+
+        usize component_length = i - component_begin;
+        if (component_length == 0) {
+            break;
+        }
+
+        if (component_length > DB_MAX_NAME_LENGTH) {
+            return false;
+        }
+
+        char component[DB_MAX_NAME_LENGTH];
+        fold_utf8(path + component_begin, component_length, component);
+
+        u64 parent_record_number = records[current].id.record_number;
+        u32 at                   = dir_tree_hash(parent_record_number, component, component_length) & mask;
+        u32 found                = 0;
+
+        for (; tree->buckets.elems[at] != 0; at = (at + 1) & mask) {
+            u32 candidate_index = tree->buckets.elems[at] - 1;
+            record *candidate   = &records[candidate_index];
+            char *folded_name   = db->folded_name_buffer.elems + candidate->name_offset;
+
+            if (candidate_index != current &&
+                dir_tree_is_live_directory(candidate) &&
+                candidate->parent_id.record_number == parent_record_number &&
+                memcmp(folded_name, component, component_length) == 0 &&
+                folded_name[component_length] == '\0') {
+                found = candidate_index;
+                break;
+            }
+        }
+
+        if (found == 0) {
+            return false;
+        }
+
+        current = found;
+    }
+
+    *record_index = current;
+    return true;
+}
+
+static bool dir_tree_is_below(db *db, record *record, u32 dir_record_index) {
+    dir_tree *tree         = &db->dir_tree;
+    struct record *records = db->record_array.elems;
+
+    u32 record_index = (u32)(record - records);
+    if (record_index == dir_record_index) {
+        return false;
+    }
+
+    // NOTE(rune): Only directories are numbered, so files are checked through their parent.
+    u32 numbered_index = record_index;
+    if (!(record->attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        numbered_index = dir_tree_parent_index(db, record);
+        if (numbered_index == dir_record_index) {
+            return true;
+        }
+
+        if (numbered_index == 0) {
+            return false;
+        }
+    }
+
+    if (dir_tree_is_valid(db)) {
+        dir_interval *dir = &tree->intervals.elems[dir_record_index];
+        u32 enter         = tree->intervals.elems[numbered_index].enter;
+        return enter != 0 && dir->enter != 0 && dir->enter <= enter && enter <= dir->exit;
+    }
+
+    // NOTE(rune): Without valid intervals, we walk the ancestors, but still compare record indices instead of paths.
+    for (u32 depth = 0; depth < 256; depth++) {
+        if (numbered_index == dir_record_index) {
+            return true;
+        }
+
+        struct record *ancestor = &records[numbered_index];
+        if (ancestor->id.id64 == ancestor->parent_id.id64) {
+            return false;
+        }
+
+        numbered_index = dir_tree_parent_index(db, ancestor);
+        if (numbered_index == 0) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static u32 dir_tree_get_depth(db *db, u32 record_index) {
+    dir_tree *tree = &db->dir_tree;
+    return record_index < tree->intervals.count ? tree->intervals.elems[record_index].depth : 0;
+}
+
+static bool dir_tree_has_parent(db *db, record *record, u32 parent_index) {
+    return db->record_array.elems[parent_index].id.record_number == record->parent_id.record_number;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Sanity checks
+
+// NOTE(rune): Counts the number of names in the database's name buffer, and compares
+// it to the number of records in the database. When the run_query static searches
+// the name buffer, it uses the number of null chars encountered the determine the
+// matched record's index. Therefore its important that the number of null chars in
+// the name buffer always matches the number of records in the record buffer.
+static bool debug_sanity_check_names(db *db) {
+    usize n = 0;
+
+    if (db->folded_name_buffer.count != db->name_buffer.count) {
+        assert(!"Size of folded_name_buffer does not match size of name_buffer.");
+        return false;
+    }
+
+    for (usize i = 0; i < db->name_buffer.count; i++) {
+        char c = db->name_buffer.elems[i];
+        if (c == '\0') {
+            n++;
+        }
+
+        if ((c == '\0') != (db->folded_name_buffer.elems[i] == '\0')) {
+            assert(!"Null-chars in folded_name_buffer do not match null-chars in name_buffer.");
+            return false;
+        }
+    }
+
+    u64 record_count = db->record_array.count;
+    if (n != record_count) {
+        assert(!"Number of null-chars in name_buffer does not match number of records.");
+        return false;
+    }
+
+    for (usize i = 0; i < record_count; i++) {
+        record *record = &db->record_array.elems[i];
+        if (strlen(db->name_buffer.elems + record->name_offset) != record->name_length) {
+            assert(!"Stored name length does not match length of name.");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool debug_sanity_check_lookup(db *db) {
+    record *records      = db->record_array.elems;
+    usize   record_count = db->record_array.count;
+
+    u32  *lookup        = db->lookup_array.elems;
+    usize lookup_count  = db->lookup_array.count;
+
+    // NOTE(rune): Check lookup_array -> record_array.
+    for (usize record_number = 0; record_number < lookup_count; record_number++) {
+        u32 idx_from_lookup = lookup[record_number];
+
+        if (idx_from_lookup == 0) {
+            continue;
+        }
+
+        if (idx_from_lookup > record_count) {
+            assert(!"Lookup points to record outside record buffer.");
+            return false;
+        }
+
+        record *record = records + idx_from_lookup;
+
+        if (record->id.record_number != record_number) {
+            assert(!"Lookup does not match record_number of record.");
+            return false;
+        }
+    }
+
+    // NOTE(rune): Check record_array -> lookup_array.
+    for (usize record_idx = 0; record_idx < record_count; record_idx++) {
+        record *it = records + record_idx;
+
+        if (it->id.record_number >= lookup_count) {
+            assert(!"Lookup does not contain all record numbers.");
+            return false;
+        }
+
+        u32 idx_from_lookup = lookup[it->id.record_number];
+        record *record_from_lookup = records + idx_from_lookup;
+
+        if (idx_from_lookup == 0 && it->id.record_number != 0) {
+            assert(!"Lookup does not contain all record numbers.");
+            return false;
+        }
+
+        if (it->id.record_number != it->id.record_number) {
+            assert(!"Lookup does not match record_number of record.");
+            return false;
+        }
+
+        u32 parent_idx_from_lookup = lookup[it->parent_id.record_number];
+        if (parent_idx_from_lookup == 0 && it->parent_id.record_number != 0) {
+            assert(!"Lookup does not contain parent record.");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool debug_sanity_check_checkpoints(db *db) {
+    usize expected_count = (db->name_buffer.count + DB_CHECKPOINT_BLOCK_SIZE - 1) / DB_CHECKPOINT_BLOCK_SIZE;
+    if (db->checkpoint_array.count != expected_count) {
+        assert(!"Number of checkpoints does not match size of name_buffer.");
+        return false;
+    }
+
+    for (usize block = 0; block < db->checkpoint_array.count; block++) {
+        u32 record_index = db->checkpoint_array.elems[block];
+        if (record_index >= db->record_array.count) {
+            assert(!"Checkpoint points to record outside record buffer.");
+            return false;
+        }
+
+        usize block_offset = block * DB_CHECKPOINT_BLOCK_SIZE;
+        usize name_begin   = db->record_array.elems[record_index].name_offset;
+        usize name_end     = name_begin + strlen(db->name_buffer.elems + name_begin);
+
+        if (block_offset < name_begin || block_offset > name_end) {
+            assert(!"Checkpoint does not point to the record containing the beginning of the block.");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool debug_sanity_check_ext_index(db *db) {
+    ext_index *index = &db->ext_index;
+    if (!index->entries.elems) {
+        return true;
+    }
+
+    if (index->ids.count != db->record_array.count) {
+        assert(!"Number of extension ids does not match number of records.");
+        return false;
+    }
+
+    u32 *record_counts = heap_alloc(index->entries.count * sizeof(u32), true);
+    if (!record_counts) {
+        assert(false);
+        return false;
+    }
+
+    bool ok = true;
+
+    for (usize record_index = 0; record_index < db->record_array.count && ok; record_index++) {
+        record *record    = &db->record_array.elems[record_index];
+        char *folded_name = db->folded_name_buffer.elems + record->name_offset;
+        u16 id            = index->ids.elems[record_index];
+
+        char *ext        = null;
+        usize ext_length = 0;
+        if ((record->attributes & FILE_ATTRIBUTE_DIRECTORY) || !ext_from_name(folded_name, record->name_length, &ext, &ext_length)) {
+            if (id != EXT_ID_NONE) {
+                assert(!"Record without extension has an extension id.");
+                ok = false;
+            }
+        } else if (id != EXT_ID_OVERFLOW) {
+            ext_entry *entry = &index->entries.elems[id];
+            if (id == EXT_ID_NONE || entry->name_length != ext_length || memcmp(index->names.elems + entry->name_offset, ext, ext_length)) {
+                assert(!"Extension id does not match extension of name.");
+                ok = false;
+            }
+        }
+
+        if (!(record->attributes & FILE_ATTRIBUTE_NOT_IN_USE) && id != EXT_ID_NONE) {
+            record_counts[id]++;
+        }
+    }
+
+    for (usize id = 0; id < index->entries.count && ok; id++) {
+        if (index->entries.elems[id].record_count != record_counts[id]) {
+            assert(!"Extension posting does not match records in use.");
+            ok = false;
+        }
+    }
+
+    heap_free(record_counts);
+    return ok;
+}
+
+static bool debug_sanity_check_dir_tree(db *db) {
+    dir_tree *tree = &db->dir_tree;
+    if (!dir_tree_is_valid(db)) {
+        return true;
+    }
+
+    for (u32 record_index = 0; record_index < db->record_array.count; record_index++) {
+        record *record         = &db->record_array.elems[record_index];
+        dir_interval *interval = &tree->intervals.elems[record_index];
+
+        if (!(record->attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
+            u32 parent_index = dir_tree_parent_index(db, record);
+            if (parent_index != record_index && tree->intervals.elems[parent_index].enter != 0 &&
+                interval->depth != tree->intervals.elems[parent_index].depth + 1) {
+                assert(!"Record depth does not match depth of its parent.");
+                return false;
+            }
+
+            if (interval->reachable != walk_ancestors_is_child_of_root(record, db, WALK_ANCESTORS_MAX_DEPTH)) {
+                assert(!"Record reachability does not match its ancestors.");
+                return false;
+            }
+        }
+
+        if (!(record->attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            if (interval->enter != 0) {
+                assert(!"File has a directory interval.");
+                return false;
+            }
+
+            continue;
+        }
+
+        if (!dir_tree_is_numbered(db, record_index) || interval->enter == 0) {
+            continue;
+        }
+
+        if (interval->enter > interval->exit || interval->next_free <= interval->enter || interval->next_free > interval->exit + 1) {
+            assert(!"Directory interval is malformed.");
+            return false;
+        }
+
+        u32 parent_index = dir_tree_parent_index(db, record);
+        if (parent_index != record_index && dir_tree_is_numbered(db, parent_index)) {
+            dir_interval *parent = &tree->intervals.elems[parent_index];
+            if (parent->enter >= interval->enter || interval->exit > parent->exit || interval->exit >= parent->next_free) {
+                assert(!"Directory interval is not nested in the interval of its parent.");
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Glob matching
+
+static usize glob_next_char(char *name, usize name_length, usize i) {
+    i++;
+    while (i < name_length && (name[i] & 0xc0) == 0x80) {
+        i++;
+    }
+
+    return i;
+}
+
+static bool glob_match(char *pattern, usize pattern_length, char *name, usize name_length) {
+    usize p = 0;
+    usize n = 0;
+
+    // NOTE(rune): Standard backtracking matcher. When a literal does not match, we let the
+    // most recent '*' consume one more character and retry from there. Earlier stars never
+    // need to be revisited, so this is O(pattern_length * name_length) in the worst case.
+    bool has_star = false;
+    usize star_p  = 0;
+    usize star_n  = 0;
+
+    while (n < name_length) {
+        if (p < pattern_length && pattern[p] == '*') {
+            p++;
+            has_star = true;
+            star_p   = p;
+            star_n   = n;
+        } else if (p < pattern_length && pattern[p] == '?') {
+            p++;
+            n = glob_next_char(name, name_length, n);
+        } else if (p < pattern_length && pattern[p] == name[n]) {
+            p++;
+            n++;
+        } else if (has_star) {
+            star_n = glob_next_char(name, name_length, star_n);
+            p      = star_p;
+            n      = star_n;
+        } else {
+            return false;
+        }
+    }
+
+    while (p < pattern_length && pattern[p] == '*') {
+        p++;
+    }
+
+    return p == pattern_length;
+}
+
+static void glob_longest_literal(char *pattern, usize pattern_length, char **literal, usize *literal_length) {
+    *literal        = pattern;
+    *literal_length = 0;
+
+    usize i = 0;
+    while (i < pattern_length) {
+        while (i < pattern_length && (pattern[i] == '*' || pattern[i] == '?')) {
+            i++;
+        }
+
+        usize run_begin = i;
+        while (i < pattern_length && !(pattern[i] == '*' || pattern[i] == '?')) {
+            i++;
+        }
+
+        if (i - run_begin > *literal_length) {
+            *literal        = pattern + run_begin;
+            *literal_length = i - run_begin;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Regex
+
+static void regex_byte_set_add(regex_byte_set *set, u8 lo, u8 hi) {
+    for (u32 c = lo; c <= hi; c++) {
+        set->bits[c / 8] |= (u8)(1 << (c % 8));
+    }
+}
+
+static bool regex_byte_set_has(regex_byte_set *set, u8 c) {
+    return (set->bits[c / 8] & (1 << (c % 8))) != 0;
+}
+
+static bool regex_byte_set_add_escape(regex_byte_set *set, char c) {
+    switch (c) {
+        case 'd': {
+            regex_byte_set_add(set, '0', '9');
+        } break;
+
+        case 'w': {
+            regex_byte_set_add(set, 'a', 'z');
+            regex_byte_set_add(set, 'A', 'Z');
+            regex_byte_set_add(set, '0', '9');
+            regex_byte_set_add(set, '_', '_');
+        } break;
+
+        case 's': {
+            regex_byte_set_add(set, ' ', ' ');
+            regex_byte_set_add(set, '\t', '\r');
+        } break;
+
+        default: {
+            return false;
+        } break;
+    }
+
+    return true;
+}
+
+// NOTE(rune): Escaping any ascii punctuation gives the literal character.
+static bool regex_is_escapable(char c) {
+    bool is_alnum = ((c >= 'a' && c <= 'z') ||
+                     (c >= 'A' && c <= 'Z') ||
+                     (c >= '0' && c <= '9'));
+
+    return c >= 0x21 && c <= 0x7e && !is_alnum;
+}
+
+static u32 regex_node_push(regex_parser *p, regex_node_kind kind) {
+    if (p->node_count == REGEX_MAX_NODES) {
+        p->error = true;
+        return 0;
+    }
+
+    u32 index = p->node_count++;
+    zero_struct(&p->nodes[index]);
+    p->nodes[index].kind = (u8)kind;
+    return index;
+}
+
+static u32 regex_node_range(regex_parser *p, u8 lo, u8 hi) {
+    u32 index = regex_node_push(p, REGEX_NODE_RANGE);
+    p->nodes[index].lo = lo;
+    p->nodes[index].hi = hi;
+    return index;
+}
+
+static u32 regex_node_set(regex_parser *p, regex_byte_set *set) {
+    if (p->re->set_count == REGEX_MAX_SETS) {
+        p->error = true;
+        return 0;
+    }
+
+    u32 index = regex_node_push(p, REGEX_NODE_SET);
+    p->nodes[index].set = (u16)p->re->set_count;
+    p->re->sets[p->re->set_count++] = *set;
+    return index;
+}
+
+static u32 regex_node_pair(regex_parser *p, regex_node_kind kind, u32 a, u32 b) {
+    u32 index = regex_node_push(p, kind);
+    p->nodes[index].a = a;
+    p->nodes[index].b = b;
+    return index;
+}
+
+static u32 regex_node_repeat(regex_parser *p, u32 a, u32 min, u32 max) {
+    u32 index = regex_node_push(p, REGEX_NODE_REPEAT);
+    p->nodes[index].a   = a;
+    p->nodes[index].min = min;
+    p->nodes[index].max = max;
+    return index;
+}
+
+static u32 regex_node_bytes(regex_parser *p, u8 *bytes, usize count) {
+    u32 node = regex_node_range(p, bytes[0], bytes[0]);
+    for (usize i = 1; i < count; i++) {
+        node = regex_node_pair(p, REGEX_NODE_CONCAT, node, regex_node_range(p, bytes[i], bytes[i]));
+    }
+
+    return node;
+}
+
+// NOTE(rune): Matches any utf8 character of two or more bytes.
+static u32 regex_node_any_multibyte(regex_parser *p) {
+    u32 lead         = regex_node_range(p, 0xc0, 0xff);
+    u32 continuation = regex_node_repeat(p, regex_node_range(p, 0x80, 0xbf), 0, REGEX_REPEAT_INFINITE);
+    return regex_node_pair(p, REGEX_NODE_CONCAT, lead, continuation);
+}
+
+// NOTE(rune): Matches any character, except the ascii characters in set.
+static u32 regex_node_negated_set(regex_parser *p, regex_byte_set *set) {
+    regex_byte_set negated = { 0 };
+    for (u32 c = 0; c < 0x80; c++) {
+        if (!regex_byte_set_has(set, (u8)c)) {
+            regex_byte_set_add(&negated, (u8)c, (u8)c);
+        }
+    }
+
+    return regex_node_pair(p, REGEX_NODE_ALT, regex_node_set(p, &negated), regex_node_any_multibyte(p));
+}
+
+// NOTE(rune): Reads one utf8 character from the pattern. For case insensitive patterns, the
+// character is folded the same way as the folded name buffer.
+static usize regex_read_char(regex_parser *p, u8 *bytes) {
+    u8 lead      = (u8)p->at[0];
+    usize length = 0;
+
+    if      (lead < 0x80)           length = 1;
+    else if ((lead & 0xe0) == 0xc0) length = 2;
+    else if ((lead & 0xf0) == 0xe0) length = 3;
+    else if ((lead & 0xf8) == 0xf0) length = 4;
+
+    if (length == 0 || length > (usize)(p->end - p->at)) {
+        p->error = true;
+        return 0;
+    }
+
+    for (usize i = 0; i < length; i++) {
+        bytes[i] = (u8)p->at[i];
+        if (i > 0 && (bytes[i] & 0xc0) != 0x80) {
+            p->error = true;
+            return 0;
+        }
+    }
+
+    p->at += length;
+
+    if (!(p->flags & QUICKFIND_FLAG_CASE_SENSITIVE)) {
+        char folded[4];
+        fold_utf8((char *)bytes, length, folded);
+        memcpy(bytes, folded, length);
+    }
+
+    return length;
+}
+
+static u32 regex_parse_class(regex_parser *p) {
+    bool negated = false;
+    if (p->at < p->end && *p->at == '^') {
+        negated = true;
+        p->at++;
+    }
+
+    regex_byte_set set = { 0 };
+    u32 node           = 0;
+    bool empty         = true;
+    bool first         = true;
+
+    while (!p->error) {
+        if (p->at == p->end) {
+            p->error = true;
+            break;
+        }
+
+        if (*p->at == ']' && !first) {
+            p->at++;
+            break;
+        }
+
+        first = false;
+
+        u8 bytes[4];
+        usize length = 0;
+
+        if (*p->at == '\\' && p->end - p->at >= 2) {
+            char c = p->at[1];
+            p->at += 2;
+
+            if (regex_byte_set_add_escape(&set, c)) {
+                empty = false;
+                continue;
+            }
+
+            if (c == 't') {
+                c = '\t';
+            } else if (!regex_is_escapable(c)) {
+                p->error = true;
+                break;
+            }
+
+            bytes[0] = (u8)c;
+            length   = 1;
+        } else {
+            length = regex_read_char(p, bytes);
+            if (p->error) {
+                break;
+            }
+        }
+
+        // NOTE(rune): Ranges are limited to ascii.
+        if (length == 1 && p->end - p->at >= 2 && p->at[0] == '-' && p->at[1] != ']') {
+            p->at++;
+
+            u8 hi[4];
+            usize hi_length = regex_read_char(p, hi);
+            if (p->error || hi_length != 1 || hi[0] < bytes[0]) {
+                p->error = true;
+                break;
+            }
+
+            regex_byte_set_add(&set, bytes[0], hi[0]);
+            empty = false;
+        } else if (length == 1) {
+            regex_byte_set_add(&set, bytes[0], bytes[0]);
+            empty = false;
+        } else if (negated) {
+            p->error = true;
+            break;
+        } else {
+            u32 multibyte = regex_node_bytes(p, bytes, length);
+            node          = node ? regex_node_pair(p, REGEX_NODE_ALT, node, multibyte) : multibyte;
+        }
+    }
+
+    if (p->error) {
+        return 0;
+    }
+
+    // NOTE(rune): The folded name buffer is all lowercase, but we add both cases, so that
+    // negated classes still exclude both.
+    if (!(p->flags & QUICKFIND_FLAG_CASE_SENSITIVE)) {
+        for (u8 c = 'a'; c <= 'z'; c++) {
+            if (regex_byte_set_has(&set, c) || regex_byte_set_has(&set, ascii_toupper(c))) {
+                regex_byte_set_add(&set, c, c);
+                regex_byte_set_add(&set, ascii_toupper(c), ascii_toupper(c));
+            }
+        }
+    }
+
+    if (negated) {
+        return regex_node_negated_set(p, &set);
+    }
+
+    if (!empty) {
+        u32 ascii = regex_node_set(p, &set);
+        node      = node ? regex_node_pair(p, REGEX_NODE_ALT, ascii, node) : ascii;
+    }
+
+    if (node == 0) {
+        p->error = true;
+    }
+
+    return node;
+}
+
+static u32 regex_parse_alt(regex_parser *p, u32 depth);
+
+static u32 regex_parse_atom(regex_parser *p, u32 depth) {
+    char c = *p->at;
+
+    switch (c) {
+        case '(': {
+            p->at++;
+            if (p->end - p->at >= 2 && p->at[0] == '?' && p->at[1] == ':') {
+                p->at += 2;
+            }
+
+            u32 node = regex_parse_alt(p, depth + 1);
+            if (p->at == p->end || *p->at != ')') {
+                p->error = true;
+                return 0;
+            }
+
+            p->at++;
+            return node;
+        } break;
+
+        case '[': {
+            p->at++;
+            return regex_parse_class(p);
+        } break;
+
+        case '.': {
+            p->at++;
+            return regex_node_pair(p, REGEX_NODE_ALT, regex_node_range(p, 0x00, 0x7f), regex_node_any_multibyte(p));
+        } break;
+
+        case '^': {
+            p->at++;
+            return regex_node_push(p, REGEX_NODE_BOL);
+        } break;
+
+        case '$': {
+            p->at++;
+            return regex_node_push(p, REGEX_NODE_EOL);
+        } break;
+
+        case '\\': {
+            if (p->end - p->at < 2) {
+                p->error = true;
+                return 0;
+            }
+
+            c = p->at[1];
+            p->at += 2;
+
+            regex_byte_set set = { 0 };
+            if (regex_byte_set_add_escape(&set, c)) {
+                return regex_node_set(p, &set);
+            }
+
+            if (regex_byte_set_add_escape(&set, ascii_tolower(c))) {
+                return regex_node_negated_set(p, &set);
+            }
+
+            if (c == 't') {
+                c = '\t';
+            } else if (!regex_is_escapable(c)) {
+                p->error = true;
+                return 0;
+            }
+
+            u8 byte = (u8)c;
+            return regex_node_bytes(p, &byte, 1);
+        } break;
+
+        case ')':
+        case '*':
+        case '+':
+        case '?':
+        case '{': {
+            p->error = true;
+            return 0;
+        } break;
+
+        default: {
+            u8 bytes[4];
+            usize length = regex_read_char(p, bytes);
+            if (p->error) {
+                return 0;
+            }
+
+            return regex_node_bytes(p, bytes, length);
+        } break;
+    }
+}
+
+static bool regex_parse_number(regex_parser *p, u32 *number) {
+    if (p->at == p->end || !(*p->at >= '0' && *p->at <= '9')) {
+        return false;
+    }
+
+    *number = 0;
+    while (p->at < p->end && *p->at >= '0' && *p->at <= '9') {
+        *number = *number * 10 + (*p->at - '0');
+        if (*number > REGEX_MAX_REPEAT) {
+            return false;
+        }
+
+        p->at++;
+    }
+
+    return true;
+}
+
+static u32 regex_parse_repeat(regex_parser *p, u32 depth) {
+    u32 node = regex_parse_atom(p, depth);
+
+    while (!p->error && p->at < p->end) {
+        u32 min = 0;
+        u32 max = 0;
+
+        switch (*p->at) {
+            case '*': {
+                min = 0;
+                max = REGEX_REPEAT_INFINITE;
+                p->at++;
+            } break;
+
+            case '+': {
+                min = 1;
+                max = REGEX_REPEAT_INFINITE;
+                p->at++;
+            } break;
+
+            case '?': {
+                min = 0;
+                max = 1;
+                p->at++;
+            } break;
+
+            case '{': {
+                p->at++;
+                if (!regex_parse_number(p, &min)) {
+                    p->error = true;
+                    return 0;
+                }
+
+                max = min;
+                if (p->at < p->end && *p->at == ',') {
+                    p->at++;
+                    max = REGEX_REPEAT_INFINITE;
+                    if (p->at < p->end && *p->at != '}' && (!regex_parse_number(p, &max) || max < min)) {
+                        p->error = true;
+                        return 0;
+                    }
+                }
+
+                if (p->at == p->end || *p->at != '}') {
+                    p->error = true;
+                    return 0;
+                }
+
+                p->at++;
+            } break;
+
+            default: {
+                return node;
+            } break;
+        }
+
+        node = regex_node_repeat(p, node, min, max);
+    }
+
+    return node;
+}
+
+static u32 regex_parse_concat(regex_parser *p, u32 depth) {
+    u32 node = 0;
+
+    while (!p->error && p->at < p->end && *p->at != '|' && *p->at != ')') {
+        u32 item = regex_parse_repeat(p, depth);
+        node     = node ? regex_node_pair(p, REGEX_NODE_CONCAT, node, item) : item;
+    }
+
+    if (node == 0) {
+        node = regex_node_push(p, REGEX_NODE_EMPTY);
+    }
+
+    return node;
+}
+
+static u32 regex_parse_alt(regex_parser *p, u32 depth) {
+    // NOTE(rune): Limit nesting, since parsing, literal extraction and compilation all recurse.
+    if (depth > 64) {
+        p->error = true;
+        return 0;
+    }
+
+    u32 node = regex_parse_concat(p, depth);
+
+    while (!p->error && p->at < p->end && *p->at == '|') {
+        p->at++;
+        node = regex_node_pair(p, REGEX_NODE_ALT, node, regex_parse_concat(p, depth));
+    }
+
+    return node;
+}
+
+static void regex_commit_literal(regex *re, char *run, usize *run_length) {
+    if (*run_length > re->literal_length) {
+        memcpy(re->literal, run, *run_length);
+        re->literal_length = *run_length;
+    }
+
+    *run_length = 0;
+}
+
+// NOTE(rune): Collects runs of exact bytes which every match must contain, and keeps the longest
+// in re->literal. Optional parts, alternations and classes end the current run.
+static void regex_collect_literal(regex_parser *p, u32 node_index, char *run, usize *run_length) {
+    regex_node *node = &p->nodes[node_index];
+
+    switch (node->kind) {
+        case REGEX_NODE_RANGE: {
+            if (node->lo == node->hi && *run_length < DB_MAX_NAME_LENGTH) {
+                run[(*run_length)++] = (char)node->lo;
+            } else {
+                regex_commit_literal(p->re, run, run_length);
+            }
+        } break;
+
+        case REGEX_NODE_CONCAT: {
+            regex_collect_literal(p, node->a, run, run_length);
+            regex_collect_literal(p, node->b, run, run_length);
+        } break;
+
+        case REGEX_NODE_EMPTY:
+        case REGEX_NODE_BOL:
+        case REGEX_NODE_EOL: {
+            // NOTE(rune): Zero width, so the run continues.
+        } break;
+
+        // NOTE(rune): The run is empty after committing, so the inner run can use the same buffer,
+        // and the recursion does not need a buffer per level.
+        case REGEX_NODE_REPEAT: {
+            regex_commit_literal(p->re, run, run_length);
+
+            if (node->min >= 1) {
+                regex_collect_literal(p, node->a, run, run_length);
+                regex_commit_literal(p->re, run, run_length);
+            }
+        } break;
+
+        default: {
+            regex_commit_literal(p->re, run, run_length);
+        } break;
+    }
+}
+
+static u32 regex_emit_inst(regex_parser *p, regex_op op) {
+    regex *re = p->re;
+    if (re->inst_count == REGEX_MAX_INSTS) {
+        p->error = true;
+        return 0;
+    }
+
+    u32 pc = re->inst_count++;
+    zero_struct(&re->insts[pc]);
+    re->insts[pc].op  = (u8)op;
+    re->insts[pc].out = pc + 1;
+    return pc;
+}
+
+static void regex_emit(regex_parser *p, u32 node_index) {
+    if (p->error) {
+        return;
+    }
+
+    regex *re        = p->re;
+    regex_node *node = &p->nodes[node_index];
+
+    switch (node->kind) {
+        case REGEX_NODE_EMPTY: {
+        } break;
+
+        case REGEX_NODE_RANGE: {
+            u32 pc = regex_emit_inst(p, REGEX_OP_RANGE);
+            re->insts[pc].lo = node->lo;
+            re->insts[pc].hi = node->hi;
+        } break;
+
+        case REGEX_NODE_SET: {
+            u32 pc = regex_emit_inst(p, REGEX_OP_SET);
+            re->insts[pc].set = node->set;
+        } break;
+
+        case REGEX_NODE_BOL: {
+            regex_emit_inst(p, REGEX_OP_BOL);
+        } break;
+
+        case REGEX_NODE_EOL: {
+            regex_emit_inst(p, REGEX_OP_EOL);
+        } break;
+
+        case REGEX_NODE_CONCAT: {
+            regex_emit(p, node->a);
+            regex_emit(p, node->b);
+        } break;
+
+        case REGEX_NODE_ALT: {
+            u32 split = regex_emit_inst(p, REGEX_OP_SPLIT);
+            regex_emit(p, node->a);
+            u32 jump = regex_emit_inst(p, REGEX_OP_JUMP);
+            re->insts[split].out1 = re->inst_count;
+            regex_emit(p, node->b);
+            re->insts[jump].out = re->inst_count;
+        } break;
+
+        case REGEX_NODE_REPEAT: {
+            for (u32 i = 0; i < node->min && !p->error; i++) {
+                regex_emit(p, node->a);
+            }
+
+            if (node->max == REGEX_REPEAT_INFINITE) {
+                u32 split = regex_emit_inst(p, REGEX_OP_SPLIT);
+                regex_emit(p, node->a);
+                u32 jump = regex_emit_inst(p, REGEX_OP_JUMP);
+                re->insts[jump].out   = split;
+                re->insts[split].out1 = re->inst_count;
+            } else {
+                u32 splits[REGEX_MAX_REPEAT];
+                u32 split_count = node->max - node->min;
+
+                for (u32 i = 0; i < split_count && !p->error; i++) {
+                    splits[i] = regex_emit_inst(p, REGEX_OP_SPLIT);
+                    regex_emit(p, node->a);
+                }
+
+                for (u32 i = 0; i < split_count && !p->error; i++) {
+                    re->insts[splits[i]].out1 = re->inst_count;
+                }
+            }
+        } break;
+
+        default: {
+            assert(false);
+            p->error = true;
+        } break;
+    }
+}
+
+static bool regex_compile(regex *re, char *pattern, usize pattern_length, quickfind_flags flags) {
+    re->inst_count     = 0;
+    re->set_count      = 0;
+    re->literal_length = 0;
+    re->dfas           = null;
+    re->dfa_count      = 0;
+
+    regex_parser p;
+    p.re         = re;
+    p.at         = pattern;
+    p.end        = pattern + pattern_length;
+    p.flags      = flags;
+    p.error      = false;
+    p.node_count = 0;
+
+    // NOTE(rune): Node 0 is never referenced, so 0 can mean no node.
+    regex_node_push(&p, REGEX_NODE_EMPTY);
+
+    u32 root = regex_parse_alt(&p, 0);
+    if (p.at != p.end) {
+        p.error = true;
+    }
+
+    if (flags & QUICKFIND_FLAG_FULLNAME) {
+        u32 bol = regex_node_push(&p, REGEX_NODE_BOL);
+        u32 eol = regex_node_push(&p, REGEX_NODE_EOL);
+        root = regex_node_pair(&p, REGEX_NODE_CONCAT, bol, regex_node_pair(&p, REGEX_NODE_CONCAT, root, eol));
+    }
+
+    if (!p.error) {
+        char run[DB_MAX_NAME_LENGTH];
+        usize run_length = 0;
+        regex_collect_literal(&p, root, run, &run_length);
+        regex_commit_literal(re, run, &run_length);
+    }
+
+    regex_emit(&p, root);
+    regex_emit_inst(&p, REGEX_OP_MATCH);
+
+    return !p.error;
+}
+
+static void regex_dfa_init(regex_dfa *dfa, regex *re) {
+    dfa->regex           = re;
+    dfa->state_count     = 0;
+    dfa->start_state     = 0;
+    dfa->set_pool_count  = 0;
+    dfa->flush_count     = 0;
+    dfa->mark_generation = 1;
+    dfa->closure_count   = 0;
+
+    memset(dfa->buckets, 0, sizeof(dfa->buckets));
+    memset(dfa->marks, 0, sizeof(dfa->marks));
+}
+
+static void regex_dfa_begin_closure(regex_dfa *dfa) {
+    dfa->closure_count = 0;
+    dfa->mark_generation++;
+
+    if (dfa->mark_generation == 0) {
+        memset(dfa->marks, 0, sizeof(dfa->marks));
+        dfa->mark_generation = 1;
+    }
+}
+
+// NOTE(rune): Adds all instructions reachable from pc without consuming a byte to the closure.
+// Only instructions that consume a byte, EOL and MATCH are kept in the closure, since the
+// others are fully described by where they lead.
+static void regex_dfa_add_closure(regex_dfa *dfa, u32 pc, bool at_begin, bool at_end) {
+    regex *re       = dfa->regex;
+    u32 stack_count = 0;
+
+    if (dfa->marks[pc] == dfa->mark_generation) {
+        return;
+    }
+
+    dfa->marks[pc]            = dfa->mark_generation;
+    dfa->stack[stack_count++] = pc;
+
+    while (stack_count > 0) {
+        u32 at           = dfa->stack[--stack_count];
+        regex_inst *inst = &re->insts[at];
+
+        u32 outs[2];
+        u32 out_count = 0;
+
+        switch (inst->op) {
+            case REGEX_OP_SPLIT: {
+                outs[out_count++] = inst->out;
+                outs[out_count++] = inst->out1;
+            } break;
+
+            case REGEX_OP_JUMP: {
+                outs[out_count++] = inst->out;
+            } break;
+
+            case REGEX_OP_BOL: {
+                if (at_begin) {
+                    outs[out_count++] = inst->out;
+                }
+            } break;
+
+            case REGEX_OP_EOL: {
+                if (at_end) {
+                    outs[out_count++] = inst->out;
+                } else {
+                    dfa->closure[dfa->closure_count++] = at;
+                }
+            } break;
+
+            default: {
+                dfa->closure[dfa->closure_count++] = at;
+            } break;
+        }
+
+        // NOTE(rune): Marking on push means each instruction is pushed at most once, so the
+        // stack can never hold more than REGEX_MAX_INSTS entries.
+        for (u32 i = 0; i < out_count; i++) {
+            if (dfa->marks[outs[i]] != dfa->mark_generation) {
+                dfa->marks[outs[i]]       = dfa->mark_generation;
+                dfa->stack[stack_count++] = outs[i];
+            }
+        }
+    }
+}
+
+// NOTE(rune): Returns the index of the state for the current closure, or REGEX_DFA_FULL if the
+// cache is full.
+static u32 regex_dfa_intern(regex_dfa *dfa) {
+    regex *re = dfa->regex;
+    u32 *set  = dfa->closure;
+    u32 count = dfa->closure_count;
+
+    // NOTE(rune): Sort, so that equal sets have equal representations. Closures are almost
+    // always small, so insertion sort is fine.
+    for (u32 i = 1; i < count; i++) {
+        u32 value = set[i];
+        u32 j     = i;
+        while (j > 0 && set[j - 1] > value) {
+            set[j] = set[j - 1];
+            j--;
+        }
+
+        set[j] = value;
+    }
+
+    u32 hash = 2166136261u;
+    for (u32 i = 0; i < count; i++) {
+        hash = (hash ^ set[i]) * 16777619u;
+    }
+
+    u32 bucket = hash % REGEX_DFA_BUCKET_COUNT;
+    for (u16 it = dfa->buckets[bucket]; it != 0; it = dfa->states[it - 1].hash_next) {
+        regex_dfa_state *state = &dfa->states[it - 1];
+        if (state->hash == hash &&
+            state->set_count == count &&
+            memcmp(&dfa->set_pool[state->set_offset], set, count * sizeof(u32)) == 0) {
+            return it - 1;
+        }
+    }
+
+    if (dfa->state_count == REGEX_DFA_MAX_STATES || dfa->set_pool_count + count > REGEX_DFA_SET_POOL_SIZE) {
+        return REGEX_DFA_FULL;
+    }
+
+    u32 index              = dfa->state_count++;
+    regex_dfa_state *state = &dfa->states[index];
+    memset(state->next, 0, sizeof(state->next));
+    state->set_offset = dfa->set_pool_count;
+    state->set_count  = count;
+    state->hash       = hash;
+    state->hash_next  = dfa->buckets[bucket];
+    state->flags      = 0;
+
+    dfa->buckets[bucket] = (u16)(index + 1);
+    memcpy(&dfa->set_pool[dfa->set_pool_count], set, count * sizeof(u32));
+    dfa->set_pool_count += count;
+
+    if (count == 0) {
+        state->flags |= REGEX_DFA_STATE_DEAD;
+    }
+
+    // NOTE(rune): The state matches at the end of a name, if MATCH is reachable by passing EOL's.
+    // This overwrites the closure, which has already been copied to the set pool.
+    u32 *stored = &dfa->set_pool[state->set_offset];
+    regex_dfa_begin_closure(dfa);
+
+    for (u32 i = 0; i < count; i++) {
+        regex_inst *inst = &re->insts[stored[i]];
+        if (inst->op == REGEX_OP_MATCH) {
+            state->flags |= REGEX_DFA_STATE_MATCHED;
+        }
+
+        if (inst->op == REGEX_OP_EOL) {
+            regex_dfa_add_closure(dfa, inst->out, false, true);
+        }
+    }
+
+    for (u32 i = 0; i < dfa->closure_count; i++) {
+        if (re->insts[dfa->closure[i]].op == REGEX_OP_MATCH) {
+            state->flags |= REGEX_DFA_STATE_MATCHES_AT_END;
+        }
+    }
+
+    return index;
+}
+
+static u32 regex_dfa_intern_or_flush(regex_dfa *dfa) {
+    u32 index = regex_dfa_intern(dfa);
+
+    if (index == REGEX_DFA_FULL) {
+        dfa->flush_count   += 1;
+        dfa->state_count    = 0;
+        dfa->start_state    = 0;
+        dfa->set_pool_count = 0;
+        memset(dfa->buckets, 0, sizeof(dfa->buckets));
+
+        index = regex_dfa_intern(dfa);
+        assert(index != REGEX_DFA_FULL);
+    }
+
+    return index;
+}
+
+static u32 regex_dfa_compute_next(regex_dfa *dfa, u32 state_index, u8 byte) {
+    regex *re = dfa->regex;
+
+    regex_dfa_begin_closure(dfa);
+
+    regex_dfa_state *state = &dfa->states[state_index];
+    u32 *set               = &dfa->set_pool[state->set_offset];
+
+    for (u32 i = 0; i < state->set_count; i++) {
+        regex_inst *inst = &re->insts[set[i]];
+
+        if ((inst->op == REGEX_OP_RANGE && byte >= inst->lo && byte <= inst->hi) ||
+            (inst->op == REGEX_OP_SET && regex_byte_set_has(&re->sets[inst->set], byte))) {
+            regex_dfa_add_closure(dfa, inst->out, false, false);
+        }
+    }
+
+    // NOTE(rune): The regex can match anywhere in the name, so a new match can start at every byte.
+    regex_dfa_add_closure(dfa, 0, false, false);
+
+    u32 flush_count_before = dfa->flush_count;
+    u32 next               = regex_dfa_intern_or_flush(dfa);
+
+    // NOTE(rune): If the cache was flushed, state no longer refers to the same state.
+    if (dfa->flush_count == flush_count_before) {
+        state->next[byte] = (u16)(next + 1);
+    }
+
+    return next;
+}
+
+static bool regex_dfa_match(regex_dfa *dfa, char *name, usize name_length) {
+    if (dfa->start_state == 0) {
+        regex_dfa_begin_closure(dfa);
+        regex_dfa_add_closure(dfa, 0, true, false);
+        dfa->start_state = regex_dfa_intern_or_flush(dfa) + 1;
+    }
+
+    u32 state_index = dfa->start_state - 1;
+
+    for (usize i = 0; i < name_length; i++) {
+        regex_dfa_state *state = &dfa->states[state_index];
+        if (state->flags & (REGEX_DFA_STATE_MATCHED | REGEX_DFA_STATE_DEAD)) {
+            break;
+        }
+
+        u8 byte  = (u8)name[i];
+        u16 next = state->next[byte];
+        state_index = next ? next - 1 : regex_dfa_compute_next(dfa, state_index, byte);
+    }
+
+    return (dfa->states[state_index].flags & (REGEX_DFA_STATE_MATCHED | REGEX_DFA_STATE_MATCHES_AT_END)) != 0;
+}
+
+static quickfind_error regex_create_for_query(quickfind_params *params, u32 dfa_count, regex **re) {
+    *re = null;
+
+    if (!(params->flags & QUICKFIND_FLAG_REGEX)) {
+        return QUICKFIND_OK;
+    }
+
+    dfa_count = max(dfa_count, 1);
+
+    regex *result = heap_alloc(sizeof(regex) + dfa_count * sizeof(regex_dfa), false);
+    if (!result) {
+        return QUICKFIND_ERROR_OUT_OF_MEMORY;
+    }
+
+    if (!regex_compile(result, params->text, params->text_length, params->flags)) {
+        heap_free(result);
+        return QUICKFIND_ERROR_INVALID_REQUEST;
+    }
+
+    result->dfas      = (regex_dfa *)(result + 1);
+    result->dfa_count = dfa_count;
+
+    for (u32 i = 0; i < dfa_count; i++) {
+        regex_dfa_init(&result->dfas[i], result);
+    }
+
+    *re = result;
+    return QUICKFIND_OK;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Fuzzy matching
+
+static inline bool fuzzy_is_lower(char c) { return c >= 'a' && c <= 'z'; }
+static inline bool fuzzy_is_upper(char c) { return c >= 'A' && c <= 'Z'; }
+static inline bool fuzzy_is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static i32 fuzzy_bonus(char *original_name, usize at) {
+    if (at == 0) {
+        return FUZZY_BONUS_BOUNDARY;
+    }
+
+    char prev = original_name[at - 1];
+    char curr = original_name[at];
+
+    switch (prev) {
+        case ' ':
+        case '_':
+        case '-':
+        case '.':
+        case '(':
+        case ')':
+        case '[':
+        case ']': {
+            return FUZZY_BONUS_BOUNDARY;
+        } break;
+    }
+
+    if ((fuzzy_is_lower(prev) && fuzzy_is_upper(curr)) ||
+        (!fuzzy_is_digit(prev) && fuzzy_is_digit(curr))) {
+        return FUZZY_BONUS_CAMEL_CASE;
+    }
+
+    return 0;
+}
+
+static usize fuzzy_char_length(char c) {
+    u8 lead = (u8)c;
+    if ((lead & 0xe0) == 0xc0) return 2;
+    if ((lead & 0xf0) == 0xe0) return 3;
+    if ((lead & 0xf8) == 0xf0) return 4;
+    return 1;
+}
+
+static bool fuzzy_match(char *pattern, usize pattern_length, char *name, usize name_length, char *original_name, i32 *score) {
+    *score = 0;
+
+    if (pattern_length == 0) {
+        return true;
+    }
+
+    if (pattern_length > FUZZY_MAX_PATTERN_LENGTH) {
+        return false;
+    }
+
+    // NOTE(rune): Split the pattern into utf8 characters, so multibyte characters are always
+    // matched as a whole.
+    usize char_offsets[FUZZY_MAX_PATTERN_LENGTH];
+    usize char_lengths[FUZZY_MAX_PATTERN_LENGTH];
+    usize char_count = 0;
+
+    for (usize i = 0; i < pattern_length; i += char_lengths[char_count++]) {
+        char_offsets[char_count] = i;
+        char_lengths[char_count] = min(fuzzy_char_length(pattern[i]), pattern_length - i);
+    }
+
+    // NOTE(rune): Greedy forward pass, which rejects names that don't contain the pattern as
+    // a subsequence, and finds where the first character can first match.
+    usize first = 0;
+    usize at    = 0;
+
+    for (usize i = 0; i < char_count; i++) {
+        char *c  = pattern + char_offsets[i];
+        usize cl = char_lengths[i];
+
+        while (true) {
+            if (at >= name_length) {
+                return false;
+            }
+
+            char *found = simd_memchr(name + at, name_length - at, c[0]);
+            if (found == null || found >= name + name_length) {
+                return false;
+            }
+
+            usize found_at = found - name;
+            at = found_at + 1;
+
+            if (found_at + cl <= name_length && memcmp(found, c, cl) == 0) {
+                at = found_at + cl;
+                if (i == 0) {
+                    first = found_at;
+                }
+
+                break;
+            }
+        }
+    }
+
+    // NOTE(rune): curr[t] is the best score where the current pattern character matches at
+    // name[first + t], or FUZZY_SCORE_NONE if it can't.
+    i32 rows[2][DB_MAX_NAME_LENGTH];
+    i32 *prev = rows[0];
+    i32 *curr = rows[1];
+
+    char *window        = name + first;
+    usize window_length = min(name_length - first, DB_MAX_NAME_LENGTH);
+
+    for (usize t = 0; t < window_length; t++) {
+        if (t + char_lengths[0] <= window_length && memcmp(window + t, pattern, char_lengths[0]) == 0) {
+            prev[t] = FUZZY_SCORE_MATCH + fuzzy_bonus(original_name, first + t) * FUZZY_BONUS_FIRST_CHAR_MUL;
+        } else {
+            prev[t] = FUZZY_SCORE_NONE;
+        }
+    }
+
+    for (usize i = 1; i < char_count; i++) {
+        char *c       = pattern + char_offsets[i];
+        usize cl      = char_lengths[i];
+        usize prev_cl = char_lengths[i - 1];
+
+        // NOTE(rune): gap is the best score of the previous character ending before name[first + t - 1],
+        // with the gap penalty for the skipped bytes already applied.
+        i32 gap = FUZZY_SCORE_NONE;
+
+        for (usize t = 0; t < window_length; t++) {
+            if (t >= prev_cl + 1) {
+                gap = max(gap - FUZZY_SCORE_GAP_EXTENSION, prev[t - prev_cl - 1] - FUZZY_SCORE_GAP_START);
+            }
+
+            curr[t] = FUZZY_SCORE_NONE;
+
+            if (t + cl <= window_length && memcmp(window + t, c, cl) == 0) {
+                i32 best = gap;
+                if (t >= prev_cl && prev[t - prev_cl] > FUZZY_SCORE_NONE / 2) {
+                    best = max(best, prev[t - prev_cl] + FUZZY_BONUS_CONSECUTIVE);
+                }
+
+                if (best > FUZZY_SCORE_NONE / 2) {
+                    curr[t] = best + FUZZY_SCORE_MATCH + fuzzy_bonus(original_name, first + t);
+                }
+            }
+        }
+
+        i32 *swap = prev;
+        prev      = curr;
+        curr      = swap;
+    }
+
+    i32 best = FUZZY_SCORE_NONE;
+    for (usize t = 0; t < window_length; t++) {
+        best = max(best, prev[t]);
+    }
+
+    if (best <= FUZZY_SCORE_NONE / 2) {
+        assert(false);
+        return false;
+    }
+
+    *score = best;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Approximate matching
+
+static void approx_compile(approx_pattern *pattern, char *text, usize text_length) {
+    assert(text_length <= APPROX_MAX_PATTERN_LENGTH);
+    text_length = min(text_length, APPROX_MAX_PATTERN_LENGTH);
+
+    memset(pattern->peq, 0, sizeof(pattern->peq));
+    for (usize i = 0; i < text_length; i++) {
+        pattern->peq[(u8)text[i]] |= (u64)1 << i;
+    }
+
+    pattern->length   = (u32)text_length;
+    pattern->last_bit = text_length ? (u64)1 << (text_length - 1) : 0;
+}
+
+static bool approx_match(approx_pattern *pattern, char *name, usize name_length, u32 max_distance, bool whole_name) {
+    u32 m = pattern->length;
+
+    if (whole_name) {
+        // NOTE(rune): The edit distance is at least the difference in length.
+        if (name_length + max_distance < m || m + max_distance < name_length) {
+            return false;
+        }
+
+        if (m == 0) {
+            return true;
+        }
+    } else {
+        // NOTE(rune): Deleting every byte of the pattern is within max_distance edits.
+        if (m <= max_distance) {
+            return true;
+        }
+    }
+
+    // NOTE(rune): pv/mv hold the +1/-1 vertical deltas of the current DP column, and score is
+    // the value of the last row. For substring matching the first row is all zeroes, so the
+    // horizontal delta shifted into the first row is 0. For whole name matching the first row
+    // counts up by one per name byte instead.
+    u64 pv    = ~(u64)0;
+    u64 mv    = 0;
+    u32 score = m;
+    u64 carry = whole_name ? 1 : 0;
+
+    for (usize j = 0; j < name_length; j++) {
+        u64 eq = pattern->peq[(u8)name[j]];
+        u64 xv = eq | mv;
+        u64 xh = (((eq & pv) + pv) ^ pv) | eq;
+        u64 ph = mv | ~(xh | pv);
+        u64 mh = pv & xh;
+
+        if (ph & pattern->last_bit) {
+            score++;
+        } else if (mh & pattern->last_bit) {
+            score--;
+        }
+
+        ph = (ph << 1) | carry;
+        mh = (mh << 1);
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        if (!whole_name && score <= max_distance) {
+            return true;
+        }
+    }
+
+    return whole_name && score <= max_distance;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Query
+
+static bool walk_ancestors_is_child_of_root(record *record, db *database, u32 max_depth) {
+    while (max_depth--) {
+        bool is_root = record->id.id64 == record->parent_id.id64;
+        if (is_root) {
+            return true;
+        }
+
+        record = db_get_record_parent(database, record);
+        if (!record) {
+            // TODO(rune): Mark as orphan?
+            return false;
+        }
+    }
+
+    assert(true);
+    return false;
+}
+
+static u32 walk_ancestors_build_path(record *child, db *database,
+                                     record **ancestor_buffer, u32 ancestor_buffer_count,
+                                     char *path_buffer, usize path_buffer_size) {
+    // NOTE(rune): The child record itself also counts as an ancestor
+    u32 ancestor_count = 1;
+
+    while (true) {
+        ancestor_buffer[ancestor_count - 1] = child;
+
+        bool is_root = child->id.id64 == child->parent_id.id64;
+        if (is_root) {
+            break;
+        }
+
+        child = db_get_record_parent(database, child);
+        if (!child) {
+            // TODO(rune): Mark as orphan?
+            return 0;
+        }
+
+        ancestor_count++;
+
+        if (ancestor_count > ancestor_buffer_count) {
+            assert(false);
+            return 0;
+        }
+    }
+
+    path_buffer[0] = 'C';
+    path_buffer[1] = ':';
+    path_buffer[2] = '\0';
+
+    usize path_length = 2;
+
+    // NOTE(rune): Start at ancestor_count - 2 to skip root record since its name just "."
+    for (i32 ancestor_index = ancestor_count - 2;
+         ancestor_index >= 0;
+         ancestor_index--) {
+        char *name        = db_get_record_name(database, ancestor_buffer[ancestor_index]);
+        usize name_length = ancestor_buffer[ancestor_index]->name_length;
+
+        // NOTE(rune): Room for the separator, the name and the null terminator.
+        if (path_length + 1 + name_length + 1 > path_buffer_size) {
+            assert(false);
+            return 0;
+        }
+
+        path_buffer[path_length] = '\\';
+        memcpy(path_buffer + path_length + 1, name, name_length);
+        path_length += 1 + name_length;
+        path_buffer[path_length] = '\0';
+    }
+
+    return ancestor_count;
+}
+
+static bool matches_query_flags(record *record, quickfind_flags flags,
+                                char *query, usize query_len,
+                                char *match, usize match_len) {
+    if (record->attributes & FILE_ATTRIBUTE_NOT_IN_USE) {
+        return false;
+    }
+
+    if ((flags & QUICKFIND_FLAG_ONLY_FILES) && (record->attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return false;
+    }
+
+    if ((flags & QUICKFIND_FLAG_ONLY_DIRECTORIES) && !(record->attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return false;
+    }
+
+    if ((flags & QUICKFIND_FLAG_FULLNAME) && (query_len != match_len)) {
+        return false;
+    }
+
+    return true;
+}
+
+static char *find_first_occurrence_and_count_nulls(char *buffer, usize buffer_length, char *look_for, usize look_for_length, quickfind_flags flags, usize *null_count) {
+    if (flags & QUICKFIND_FLAG_CASE_SENSITIVE) {
+        if (look_for_length == 1) {
+            return simd_memchr_count_zeroes(buffer, buffer_length, *look_for, null_count);
+        } else {
+            return simd_memmem_count_zeroes(buffer, buffer_length, look_for, look_for_length, null_count);
+        }
+    } else {
+        if (look_for_length == 1) {
+            return simd_memchr_count_zeroes_nocase(buffer, buffer_length, *look_for, null_count);
+        } else {
+            return simd_memmem_count_zeroes_nocase(buffer, buffer_length, look_for, look_for_length, null_count);
+        }
+    }
+}
+
+static bool query_split_terms(char *text, usize text_length, quickfind_flags flags, query_term *terms, u32 *term_count, query_term *exts, u32 *ext_count, query_term *scope) {
+    *term_count   = 0;
+    *ext_count    = 0;
+    scope->text   = null;
+    scope->length = 0;
+
+    if (flags & (QUICKFIND_FLAG_GLOB | QUICKFIND_FLAG_REGEX)) {
+        if (text_length > DB_MAX_NAME_LENGTH) {
+            return false;
+        }
+    }
+
+    if (flags & QUICKFIND_FLAG_FUZZY) {
+        if (text_length > FUZZY_MAX_PATTERN_LENGTH || (flags & (QUICKFIND_FLAG_GLOB | QUICKFIND_FLAG_REGEX))) {
+            return false;
+        }
+    }
+
+    if (flags & (QUICKFIND_FLAG_TYPOS_1 | QUICKFIND_FLAG_TYPOS_2)) {
+        if (text_length > APPROX_MAX_PATTERN_LENGTH || (flags & (QUICKFIND_FLAG_GLOB | QUICKFIND_FLAG_REGEX | QUICKFIND_FLAG_FUZZY))) {
+            return false;
+        }
+    }
+
+    if (flags & QUICKFIND_FLAG_GLOB) {
+        glob_longest_literal(text, text_length, &terms[0].text, &terms[0].length);
+        *term_count = 1;
+        return true;
+    }
+
+    if (!(flags & (QUICKFIND_FLAG_FULLNAME | QUICKFIND_FLAG_REGEX | QUICKFIND_FLAG_FUZZY | QUICKFIND_FLAG_TYPOS_1 | QUICKFIND_FLAG_TYPOS_2))) {
+        usize i = 0;
+        while (i < text_length) {
+            while (i < text_length && (text[i] == ' ' || text[i] == '\t')) {
+                i++;
+            }
+
+            // NOTE(rune): Paths in in: terms can be quoted, since they often contain spaces.
+            if (text_length - i > 4 && memcmp(text + i, "in:\"", 4) == 0) {
+                usize path_begin = i + 4;
+                usize path_end   = path_begin;
+                while (path_end < text_length && text[path_end] != '"') {
+                    path_end++;
+                }
+
+                if (path_end == text_length || path_end == path_begin || scope->length > 0) {
+                    return false;
+                }
+
+                scope->text   = text + path_begin;
+                scope->length = path_end - path_begin;
+                i             = path_end + 1;
+                continue;
+            }
+
+            usize term_begin = i;
+            while (i < text_length && !(text[i] == ' ' || text[i] == '\t')) {
+                i++;
+            }
+
+            // NOTE(rune): Extensions in ext: terms are separated by ';'.
+            if (i - term_begin > 4 && memcmp(text + term_begin, "ext:", 4) == 0) {
+                usize j = term_begin + 4;
+                while (j < i) {
+                    usize ext_begin = j;
+                    while (j < i && text[j] != ';') {
+                        j++;
+                    }
+
+                    if (j > ext_begin) {
+                        if (*ext_count == QUERY_MAX_EXTS) {
+                            return false;
+                        }
+
+                        exts[*ext_count].text   = text + ext_begin;
+                        exts[*ext_count].length = j - ext_begin;
+                        *ext_count += 1;
+                    }
+
+                    j++;
+                }
+            } else if (i - term_begin > 3 && memcmp(text + term_begin, "in:", 3) == 0) {
+                if (scope->length > 0) {
+                    return false;
+                }
+
+                scope->text   = text + term_begin + 3;
+                scope->length = i - term_begin - 3;
+            } else if (i > term_begin) {
+                if (*term_count == QUERY_MAX_TERMS) {
+                    return false;
+                }
+
+                terms[*term_count].text   = text + term_begin;
+                terms[*term_count].length = i - term_begin;
+                *term_count += 1;
+            }
+        }
+    }
+
+    if (*term_count == 0 && *ext_count == 0 && scope->length == 0) {
+        terms[0].text   = text;
+        terms[0].length = text_length;
+        *term_count     = 1;
+    }
+
+    return true;
+}
+
+// NOTE(rune): iter->text and iter->terms may point into iter->folded_text, so a query_iter must not be copied after init.
+static void query_iter_init_text(query_iter *iter, db *database, quickfind_params *params, regex_dfa *dfa) {
+    zero_struct(iter);
+    iter->database    = database;
+    iter->names       = database->name_buffer.elems;
+    iter->text        = params->text;
+    iter->text_length = params->text_length;
+    iter->flags       = params->flags;
+    iter->intervals   = dir_tree_is_valid(database) ? database->dir_tree.intervals.elems : null;
+
+    // NOTE(rune): The regex was folded while compiling, and already handles QUICKFIND_FLAG_FULLNAME.
+    if (iter->flags & QUICKFIND_FLAG_REGEX) {
+        if (!dfa) {
+            assert(false);
+            return;
+        }
+
+        if (!(iter->flags & QUICKFIND_FLAG_CASE_SENSITIVE)) {
+            iter->names  = database->folded_name_buffer.elems;
+            iter->flags |= QUICKFIND_FLAG_CASE_SENSITIVE;
+        }
+
+        iter->dfa             = dfa;
+        iter->text            = dfa->regex->literal;
+        iter->text_length     = dfa->regex->literal_length;
+        iter->terms[0].text   = iter->text;
+        iter->terms[0].length = iter->text_length;
+        iter->term_count      = 1;
+        iter->flags          &= ~QUICKFIND_FLAG_FULLNAME;
+        iter->scan_all_names  = iter->text_length == 0;
+        return;
+    }
+
+    if (!(iter->flags & QUICKFIND_FLAG_CASE_SENSITIVE) && iter->text_length <= DB_MAX_NAME_LENGTH) {
+        fold_utf8(params->text, params->text_length, iter->folded_text);
+
+        iter->names  = database->folded_name_buffer.elems;
+        iter->text   = iter->folded_text;
+        iter->flags |= QUICKFIND_FLAG_CASE_SENSITIVE;
+    }
+
+    // NOTE(rune): run_query rejects invalid texts, so here it just means no results.
+    query_term ext_terms[QUERY_MAX_EXTS];
+    query_term scope;
+    if (!query_split_terms(iter->text, iter->text_length, iter->flags, iter->terms, &iter->term_count, ext_terms, &iter->ext_count, &scope)) {
+        iter->invalid = true;
+    }
+
+    // NOTE(rune): Paths which do not name a directory have no descendants, so nothing is found.
+    if (scope.length > 0 && !iter->invalid) {
+        iter->has_scope = dir_tree_find_path(database, scope.text, scope.length, &iter->scope_record_index);
+        iter->invalid   = !iter->has_scope;
+    }
+
+    usize folded_exts_length = 0;
+    for (u32 i = 0; i < iter->ext_count && !iter->invalid; i++) {
+        if (folded_exts_length + ext_terms[i].length > sizeof(iter->folded_exts)) {
+            iter->invalid = true;
+            break;
+        }
+
+        query_ext *ext = &iter->exts[i];
+        ext->text      = iter->folded_exts + folded_exts_length;
+        ext->length    = ext_terms[i].length;
+
+        fold_utf8(ext_terms[i].text, ext_terms[i].length, ext->text);
+        ext->id = ext_index_find(&database->ext_index, ext->text, ext->length);
+
+        folded_exts_length += ext->length;
+    }
+
+    // NOTE(rune): Glob patterns always match the whole name, so QUICKFIND_FLAG_FULLNAME has no extra meaning.
+    if (iter->flags & QUICKFIND_FLAG_GLOB) {
+        iter->glob        = iter->text;
+        iter->glob_length = iter->text_length;
+        iter->flags      &= ~QUICKFIND_FLAG_FULLNAME;
+    }
+
+    if (iter->flags & QUICKFIND_FLAG_FUZZY) {
+        iter->fuzzy  = true;
+        iter->flags &= ~QUICKFIND_FLAG_FULLNAME;
+    }
+
+    if (iter->term_count == 1) {
+        iter->text        = iter->terms[0].text;
+        iter->text_length = iter->terms[0].length;
+    }
+
+    // NOTE(rune): Queries with only ext: and in: terms have nothing to scan for.
+    if (iter->term_count == 0) {
+        iter->text           = iter->folded_exts;
+        iter->text_length    = 0;
+        iter->scan_all_names = true;
+    }
+
+    if ((iter->glob || iter->fuzzy) && iter->text_length == 0) {
+        iter->scan_all_names = true;
+    }
+
+    if (iter->term_count > 1) {
+        char *patterns[QUERY_MAX_TERMS];
+        usize pattern_lengths[QUERY_MAX_TERMS];
+
+        for (u32 i = 0; i < iter->term_count; i++) {
+            patterns[i]        = iter->terms[i].text;
+            pattern_lengths[i] = iter->terms[i].length;
+        }
+
+        teddy_compile(&iter->teddy, patterns, pattern_lengths, iter->term_count);
+    }
+
+    if ((iter->flags & (QUICKFIND_FLAG_TYPOS_1 | QUICKFIND_FLAG_TYPOS_2)) && iter->term_count == 1) {
+        iter->typo_distance   = (iter->flags & QUICKFIND_FLAG_TYPOS_2) ? 2 : 1;
+        iter->typo_whole_name = (iter->flags & QUICKFIND_FLAG_FULLNAME) != 0;
+        iter->flags          &= ~QUICKFIND_FLAG_FULLNAME;
+
+        approx_compile(&iter->approx, iter->text, iter->text_length);
+
+        // NOTE(rune): Each edit can destroy at most one piece, so with typo_distance + 1 pieces,
+        // at least one piece is left unchanged. Texts too short to split visit every name.
+        if (iter->text_length > iter->typo_distance) {
+            char *pieces[APPROX_MAX_DISTANCE + 1];
+            usize piece_lengths[APPROX_MAX_DISTANCE + 1];
+            u32 piece_count = iter->typo_distance + 1;
+
+            for (u32 i = 0; i < piece_count; i++) {
+                usize piece_begin = iter->text_length * i / piece_count;
+                usize piece_end   = iter->text_length * (i + 1) / piece_count;
+
+                pieces[i]        = iter->text + piece_begin;
+                piece_lengths[i] = piece_end - piece_begin;
+            }
+
+            teddy_compile(&iter->teddy, pieces, piece_lengths, piece_count);
+        } else {
+            iter->scan_all_names = true;
+        }
+    }
+}
+
+static bool query_iter_name_contains_terms(query_iter *iter, char *name, usize name_length) {
+    for (u32 i = 0; i < iter->term_count; i++) {
+        usize null_count = 0;
+        char *match      = find_first_occurrence_and_count_nulls(name,
+                                                                 name_length,
+                                                                 iter->terms[i].text,
+                                                                 iter->terms[i].length,
+                                                                 iter->flags,
+                                                                 &null_count);
+
+        if (match == null || match >= name + name_length) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool query_iter_matches_exts(query_iter *iter, usize record_index) {
+    if (iter->ext_count == 0) {
+        return true;
+    }
+
+    db *database     = iter->database;
+    ext_index *index = &database->ext_index;
+
+    // NOTE(rune): Records missing from the extension index are checked against their name, like EXT_ID_OVERFLOW.
+    u16 id = record_index < index->ids.count ? index->ids.elems[record_index] : EXT_ID_OVERFLOW;
+    if (id == EXT_ID_NONE) {
+        return false;
+    }
+
+    for (u32 i = 0; i < iter->ext_count; i++) {
+        query_ext *ext = &iter->exts[i];
+        if (ext->id != id) {
+            continue;
+        }
+
+        if (id != EXT_ID_OVERFLOW) {
+            return true;
+        }
+
+        record *record    = &database->record_array.elems[record_index];
+        char *folded_name = database->folded_name_buffer.elems + record->name_offset;
+
+        char *name_ext        = null;
+        usize name_ext_length = 0;
+        if (!(record->attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+            ext_from_name(folded_name, record->name_length, &name_ext, &name_ext_length) &&
+            name_ext_length == ext->length &&
+            memcmp(name_ext, ext->text, ext->length) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool query_iter_is_reachable(query_iter *iter, usize record_index) {
+    if (iter->intervals) {
+        return iter->intervals[record_index].reachable;
+    }
+
+    record *record = &iter->database->record_array.elems[record_index];
+    return walk_ancestors_is_child_of_root(record, iter->database, WALK_ANCESTORS_MAX_DEPTH);
+}
+
+static bool query_iter_matches_scope(query_iter *iter, usize record_index) {
+    if (!iter->has_scope) {
+        return true;
+    }
+
+    record *record = &iter->database->record_array.elems[record_index];
+    return dir_tree_is_below(iter->database, record, iter->scope_record_index);
+}
+
+static bool query_iter_verify_name(query_iter *iter, char *name, usize name_length) {
+    if (iter->glob && !glob_match(iter->glob, iter->glob_length, name, name_length)) {
+        return false;
+    }
+
+    if (iter->dfa && !regex_dfa_match(iter->dfa, name, name_length)) {
+        return false;
+    }
+
+    if (iter->fuzzy) {
+        char *original_name = iter->database->name_buffer.elems + (name - iter->names);
+
+        i32 score = 0;
+        if (!fuzzy_match(iter->text, iter->text_length, name, name_length, original_name, &score)) {
+            return false;
+        }
+
+        // NOTE(rune): Equal scores prefer shorter names.
+        iter->rank = ((u64)(u32)(score - FUZZY_SCORE_NONE) << 16) | (0xffff - min(name_length, 0xffff));
+    }
+
+    if (iter->typo_distance && !approx_match(&iter->approx, name, name_length, iter->typo_distance, iter->typo_whole_name)) {
+        return false;
+    }
+
+    return true;
+}
+
+static void query_iter_init(query_iter *iter, db *database, quickfind_params *params, regex_dfa *dfa, usize begin_record_index, usize end_record_index) {
+    assert(begin_record_index <= end_record_index);
+    assert(end_record_index <= database->record_array.count);
+
+    query_iter_init_text(iter, database, params, dfa);
+    iter->record_index = begin_record_index;
+
+    char *names = iter->names;
+
+    iter->at  = names + (begin_record_index < database->record_array.count
+                         ? database->record_array.elems[begin_record_index].name_offset
+                         : database->name_buffer.count);
+
+    iter->end = names + (end_record_index < database->record_array.count
+                         ? database->record_array.elems[end_record_index].name_offset
+                         : database->name_buffer.count);
+
+    // NOTE(rune): Needles longer than any name can never match, and would make the SIMD kernels read past the padding.
+    if (iter->text_length > DB_MAX_NAME_LENGTH || iter->invalid) {
+        iter->at = iter->end;
+    }
+
+    if ((iter->flags & QUICKFIND_FLAG_CASE_SENSITIVE) && iter->text_length >= 2 && iter->text_length <= DB_MAX_NAME_LENGTH) {
+        bool folded      = iter->names == database->folded_name_buffer.elems;
+        u64 *byte_counts = folded ? database->folded_byte_counts : database->byte_counts;
+        if (iter->flags & QUERY_FLAG_NO_RARE_ANCHORS) {
+            iter->anchor_a = 0;
+            iter->anchor_b = iter->text_length - 1;
+        } else {
+            query_pick_anchors(byte_counts, iter->text, iter->text_length, &iter->anchor_a, &iter->anchor_b);
+        }
+
+        iter->anchored = true;
+
+        // NOTE(rune): Only a scan for the whole text can skip blocks, since names matched by multiple
+        // terms, typos or fuzzy matching need not contain every bigram of the text.
+        if (!(iter->flags & QUERY_FLAG_NO_BIGRAM_FILTERS) &&
+            iter->term_count == 1 &&
+            !iter->fuzzy &&
+            !iter->typo_distance &&
+            !iter->scan_all_names &&
+            database->bigram_filter_array.count == database->checkpoint_array.count) {
+            bigram_filter_add_needle(&iter->bigrams, iter->text, iter->text_length, !folded);
+            iter->has_bigrams = true;
+        }
+    }
+
+    iter->scan = query_scan_select(iter);
+}
+
+static void query_iter_init_candidates(query_iter *iter, db *database, quickfind_params *params, regex_dfa *dfa, u32 *candidates, usize candidate_count) {
+    query_iter_init_text(iter, database, params, dfa);
+    iter->candidates      = candidates;
+    iter->candidate_count = candidate_count;
+
+    // NOTE(rune): Needles longer than any name can never match, and would make the SIMD kernels read past the padding.
+    if (iter->text_length > DB_MAX_NAME_LENGTH || iter->invalid) {
+        iter->candidate_count = 0;
+    }
+}
+
+static bool query_iter_advance_candidates(query_iter *iter, record **found) {
+    db *database = iter->database;
+
+    while (iter->candidate_index < iter->candidate_count) {
+        u32 record_index = iter->candidates[iter->candidate_index++];
+        if (record_index >= database->record_array.count) {
+            assert(false);
+            continue;
+        }
+
+        record *candidate = &database->record_array.elems[record_index];
+        if (candidate->attributes & FILE_ATTRIBUTE_NOT_IN_USE) {
+            continue;
+        }
+
+        if (!query_iter_matches_exts(iter, record_index) || !query_iter_matches_scope(iter, record_index)) {
+            continue;
+        }
+
+        char *name        = iter->names + candidate->name_offset;
+        usize name_length = candidate->name_length;
+
+        // NOTE(rune): Fuzzy and typo tolerant matches need not contain the text itself.
+        if (!iter->fuzzy && !iter->typo_distance && !query_iter_name_contains_terms(iter, name, name_length)) {
+            continue;
+        }
+
+        if (!query_iter_verify_name(iter, name, name_length)) {
+            continue;
+        }
+
+        if (matches_query_flags(candidate, iter->flags, iter->text, iter->text_length, name, name_length)) {
+            if (query_iter_is_reachable(iter, record_index)) {
+                iter->record_index = record_index;
+                *found = candidate;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool query_iter_advance_all_names(query_iter *iter, record **found) {
+    db *database = iter->database;
+
+    // NOTE(rune): Unlike the scanning path, at always points to the beginning of the name
+    // of the record at record_index, since we step over one name at a time.
+    while (iter->at < iter->end) {
+        char *name     = iter->at;
+        char *name_end = simd_memchr(name, iter->end - name, '\0');
+        if (name_end == null || name_end >= iter->end || iter->record_index >= database->record_array.count) {
+            assert(false);
+            iter->at = iter->end;
+            break;
+        }
+
+        record *candidate = &database->record_array.elems[iter->record_index];
+        usize name_length = name_end - name;
+        bool matches_exts  = query_iter_matches_exts(iter, iter->record_index);
+        bool matches_scope = matches_exts && query_iter_matches_scope(iter, iter->record_index);
+
+        iter->at            = name_end + 1;
+        iter->record_index += 1;
+
+        if (!matches_scope || !query_iter_verify_name(iter, name, name_length)) {
+            continue;
+        }
+
+        if (matches_query_flags(candidate, iter->flags, iter->text, iter->text_length, name, name_length)) {
+            if (query_iter_is_reachable(iter, iter->record_index - 1)) {
+                *found = candidate;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool query_iter_advance(query_iter *iter, record **found) {
+    db *database = iter->database;
+
+    if (iter->candidates) {
+        return query_iter_advance_candidates(iter, found);
+    }
+
+    if (iter->scan_all_names) {
+        return query_iter_advance_all_names(iter, found);
+    }
+
+    if (iter->scan) {
+        return iter->scan(iter, found);
+    }
+
+    while (iter->at < iter->end) {
+        char *run_end = query_iter_next_run(iter, &iter->at, &iter->record_index);
+        if (iter->at >= iter->end) {
+            break;
+        }
+
+        usize null_count = 0;
+        char *match      = null;
+
+        if (iter->term_count > 1 || iter->typo_distance) {
+            match = simd_teddy_count_zeroes(iter->at, run_end - iter->at, &iter->teddy, &null_count);
+        } else if (iter->fuzzy) {
+            match = find_first_occurrence_and_count_nulls(iter->at,
+                                                          run_end - iter->at,
+                                                          iter->text,
+                                                          1,
+                                                          iter->flags,
+                                                          &null_count);
+        } else if (iter->anchored) {
+            match = simd_memmem_anchored_count_zeroes(iter->at,
+                                                      run_end - iter->at,
+                                                      iter->text,
+                                                      iter->text_length,
+                                                      iter->anchor_a,
+                                                      iter->anchor_b,
+                                                      &null_count);
+        } else {
+            match = find_first_occurrence_and_count_nulls(iter->at,
+                                                          run_end - iter->at,
+                                                          iter->text,
+                                                          iter->text_length,
+                                                          iter->flags,
+                                                          &null_count);
+        }
+
+        // NOTE(rune): The SIMD kernels read in whole blocks, so they can report a match
+        // past the end of the range. Names never straddle the end of the range, so a
+        // match past the end always belongs to the next range. Runs end on a block boundary,
+        // where the checkpoint gives the record index, so the next run continues from there.
+        if (match == null || match >= run_end) {
+            if (run_end == iter->end) {
+                iter->at = iter->end;
+                break;
+            }
+
+            iter->at           = run_end;
+            iter->record_index = db_get_record_index_by_offset(database, run_end - iter->names);
+            continue;
+        }
+
+        char *name_end = simd_memchr(match, iter->end - match, '\0');
+        if (name_end == null || name_end >= iter->end) {
+            assert(false);
+            iter->at = iter->end;
+            break;
+        }
+
+        // NOTE(rune): Names in the name buffer are always stored in the exact same order
+        // as records in the record array, so we can just use the number of names searched
+        // as an index into the record array.
+        iter->record_index += null_count;
+        iter->at = name_end;
+
+        if (iter->record_index >= database->record_array.count) {
+            assert(false);
+            iter->at = iter->end;
+            break;
+        }
+
+        record *candidate = &database->record_array.elems[iter->record_index];
+        char *name        = iter->names + candidate->name_offset;
+        usize name_length = name_end - name;
+
+        if (!query_iter_matches_exts(iter, iter->record_index) || !query_iter_matches_scope(iter, iter->record_index)) {
+            continue;
+        }
+
+        // NOTE(rune): With multiple terms, the scan only found one of them.
+        if (iter->term_count > 1 && !query_iter_name_contains_terms(iter, name, name_length)) {
+            continue;
+        }
+
+        if (!query_iter_verify_name(iter, name, name_length)) {
+            continue;
+        }
+
+        if (!(candidate->attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
+            if (matches_query_flags(candidate, iter->flags, iter->text, iter->text_length, name, name_length)) {
+                if (query_iter_is_reachable(iter, iter->record_index)) {
+                    *found = candidate;
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Rare byte anchors
+
+static void query_pick_anchors(u64 *byte_counts, char *needle, usize needle_length, usize *anchor_a, usize *anchor_b) {
+    assert(needle_length >= 2);
+
+    usize rarest = 0;
+    for (usize i = 1; i < needle_length; i++) {
+        if (byte_counts[(u8)needle[i]] < byte_counts[(u8)needle[rarest]]) {
+            rarest = i;
+        }
+    }
+
+    // NOTE(rune): A second copy of the rarest byte says little more than the first, so it is only
+    // picked if the needle has no other bytes.
+    usize second     = rarest == 0 ? 1 : 0;
+    u64 second_count = UINT64_MAX;
+    for (usize i = 0; i < needle_length; i++) {
+        u64 count = needle[i] == needle[rarest] ? UINT64_MAX : byte_counts[(u8)needle[i]];
+        if (i != rarest && count < second_count) {
+            second       = i;
+            second_count = count;
+        }
+    }
+
+    *anchor_a = min(rarest, second);
+    *anchor_b = max(rarest, second);
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Bigram filters
+
+static void bigram_filter_add(bigram_filter *filter, char a, char b) {
+    u32 bigram = ((u32)(u8)a << 8) | (u32)(u8)b;
+
+    // NOTE(rune): Fibonacci hashing, like trigram_hash.
+    u32 bit = (bigram * 2654435769u) >> (32 - 10);
+    static_assert(DB_BIGRAM_FILTER_BITS == 1 << 10, "Hash must give one bit per filter bit.");
+
+    filter->words[bit / 64] |= 1ull << (bit % 64);
+}
+
+static void bigram_filter_add_needle(bigram_filter *filter, char *needle, usize needle_length, bool case_sensitive) {
+    for (usize i = 0; i + 1 < needle_length; i++) {
+        char a = needle[i];
+        char b = needle[i + 1];
+
+        if (!case_sensitive) {
+            bigram_filter_add(filter, a, b);
+        } else if ((u8)a < 0x80 && (u8)b < 0x80) {
+            bigram_filter_add(filter, ascii_tolower(a), ascii_tolower(b));
+        }
+    }
+}
+
+static bool bigram_filter_may_match(db *db, usize block, bigram_filter *needle_filter) {
+    bigram_filter *filters = db->bigram_filter_array.elems;
+    usize filter_count     = db->bigram_filter_array.count;
+
+    for (u32 i = 0; i < countof(needle_filter->words); i++) {
+        u64 words = filters[block].words[i];
+        if (block + 1 < filter_count) {
+            words |= filters[block + 1].words[i];
+        }
+
+        if (needle_filter->words[i] & ~words) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static char *query_iter_next_run(query_iter *iter, char **at, usize *record_index) {
+    if (!iter->has_bigrams) {
+        return iter->end;
+    }
+
+    db *database = iter->database;
+    usize begin  = *at - iter->names;
+    usize end    = iter->end - iter->names;
+    usize block  = begin / DB_CHECKPOINT_BLOCK_SIZE;
+
+    while (block * DB_CHECKPOINT_BLOCK_SIZE < end && !bigram_filter_may_match(database, block, &iter->bigrams)) {
+        block++;
+    }
+
+    usize run_begin = block * DB_CHECKPOINT_BLOCK_SIZE;
+    if (run_begin >= end) {
+        *at = iter->end;
+        return iter->end;
+    }
+
+    // NOTE(rune): The checkpoint of the block has the record index, so the skipped blocks are never read.
+    if (run_begin > begin) {
+        *at           = iter->names + run_begin;
+        *record_index = db_get_record_index_by_offset(database, run_begin);
+    }
+
+    block++;
+    while (block * DB_CHECKPOINT_BLOCK_SIZE < end && bigram_filter_may_match(database, block, &iter->bigrams)) {
+        block++;
+    }
+
+    return iter->names + min(block * DB_CHECKPOINT_BLOCK_SIZE, end);
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Specialized scans
+
+static __forceinline bool query_scan(query_iter *iter, record **found, bool single_byte, bool fullname, query_scan_only only) {
+    record *records    = iter->database->record_array.elems;
+    usize record_count = iter->database->record_array.count;
+    char *names        = iter->names;
+    char *text         = iter->text;
+    usize text_length  = iter->text_length;
+    char *at           = iter->at;
+    char *end          = iter->end;
+    usize record_index = iter->record_index;
+    usize anchor_a     = iter->anchor_a;
+    usize anchor_b     = iter->anchor_b;
+    bool result        = false;
+
+    while (at < end) {
+        char *run_end = query_iter_next_run(iter, &at, &record_index);
+        if (at >= end) {
+            break;
+        }
+
+        usize null_count = 0;
+        char *match      = single_byte
+            ? simd_memchr_count_zeroes(at, run_end - at, text[0], &null_count)
+            : simd_memmem_anchored_count_zeroes(at, run_end - at, text, text_length, anchor_a, anchor_b, &null_count);
+
+        // NOTE(rune): Same as query_iter_advance, a match past the end of the run belongs to the next run or range.
+        if (match == null || match >= run_end) {
+            if (run_end == end) {
+                at = end;
+                break;
+            }
+
+            at           = run_end;
+            record_index = db_get_record_index_by_offset(iter->database, run_end - names);
+            continue;
+        }
+
+        record_index += null_count;
+        if (record_index >= record_count) {
+            assert(false);
+            at = end;
+            break;
+        }
+
+        // NOTE(rune): The record knows its name length, so we can skip to the end of the name without
+        // searching for the null, and the attribute filter never touches the name.
+        record *candidate = &records[record_index];
+        at                = names + candidate->name_offset + candidate->name_length;
+
+        u32 attributes = candidate->attributes;
+        if (attributes & FILE_ATTRIBUTE_NOT_IN_USE) {
+            continue;
+        }
+
+        if (only == QUERY_SCAN_ONLY_FILES && (attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            continue;
+        }
+
+        if (only == QUERY_SCAN_ONLY_DIRECTORIES && !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            continue;
+        }
+
+        if (fullname && candidate->name_length != text_length) {
+            continue;
+        }
+
+        if (query_iter_is_reachable(iter, record_index)) {
+            *found = candidate;
+            result = true;
+            break;
+        }
+    }
+
+    iter->at           = at;
+    iter->record_index = record_index;
+    return result;
+}
+
+#define QUERY_SCAN_VARIANT(name, single_byte, fullname, only) \
+    static bool name(query_iter *iter, record **found) { return query_scan(iter, found, single_byte, fullname, only); }
+
+QUERY_SCAN_VARIANT(query_scan_memmem,                     false, false, QUERY_SCAN_ONLY_ANY)
+QUERY_SCAN_VARIANT(query_scan_memmem_files,               false, false, QUERY_SCAN_ONLY_FILES)
+QUERY_SCAN_VARIANT(query_scan_memmem_directories,         false, false, QUERY_SCAN_ONLY_DIRECTORIES)
+QUERY_SCAN_VARIANT(query_scan_memmem_fullname,            false, true,  QUERY_SCAN_ONLY_ANY)
+QUERY_SCAN_VARIANT(query_scan_memmem_fullname_files,      false, true,  QUERY_SCAN_ONLY_FILES)
+QUERY_SCAN_VARIANT(query_scan_memmem_fullname_directories, false, true, QUERY_SCAN_ONLY_DIRECTORIES)
+QUERY_SCAN_VARIANT(query_scan_memchr,                     true,  false, QUERY_SCAN_ONLY_ANY)
+QUERY_SCAN_VARIANT(query_scan_memchr_files,               true,  false, QUERY_SCAN_ONLY_FILES)
+QUERY_SCAN_VARIANT(query_scan_memchr_directories,         true,  false, QUERY_SCAN_ONLY_DIRECTORIES)
+QUERY_SCAN_VARIANT(query_scan_memchr_fullname,            true,  true,  QUERY_SCAN_ONLY_ANY)
+QUERY_SCAN_VARIANT(query_scan_memchr_fullname_files,      true,  true,  QUERY_SCAN_ONLY_FILES)
+QUERY_SCAN_VARIANT(query_scan_memchr_fullname_directories, true,  true, QUERY_SCAN_ONLY_DIRECTORIES)
+
+#undef QUERY_SCAN_VARIANT
+
+// NOTE(rune): Indexed by [single_byte][fullname][only].
+static query_scan_func *g_query_scan_variants[2][2][QUERY_SCAN_ONLY_COUNT] = {
+    {
+        { query_scan_memmem,          query_scan_memmem_files,          query_scan_memmem_directories },
+        { query_scan_memmem_fullname, query_scan_memmem_fullname_files, query_scan_memmem_fullname_directories },
+    },
+    {
+        { query_scan_memchr,          query_scan_memchr_files,          query_scan_memchr_directories },
+        { query_scan_memchr_fullname, query_scan_memchr_fullname_files, query_scan_memchr_fullname_directories },
+    },
+};
+
+static query_scan_func *query_scan_select(query_iter *iter) {
+    quickfind_flags flags = iter->flags;
+
+    // NOTE(rune): Everything but a single case sensitive substring, which case insensitive queries
+    // become after query_iter_init_text folds them, needs the generic loop.
+    if ((flags & QUERY_FLAG_NO_SCAN_VARIANTS) ||
+        !(flags & QUICKFIND_FLAG_CASE_SENSITIVE) ||
+        iter->term_count != 1 ||
+        iter->text_length == 0 ||
+        iter->text_length > DB_MAX_NAME_LENGTH ||
+        iter->ext_count > 0 ||
+        iter->has_scope ||
+        iter->glob ||
+        iter->dfa ||
+        iter->fuzzy ||
+        iter->typo_distance ||
+        iter->scan_all_names ||
+        iter->invalid) {
+        return null;
+    }
+
+    query_scan_only only = QUERY_SCAN_ONLY_ANY;
+    switch (flags & (QUICKFIND_FLAG_ONLY_FILES | QUICKFIND_FLAG_ONLY_DIRECTORIES)) {
+        case QUICKFIND_FLAG_ONLY_FILES:       only = QUERY_SCAN_ONLY_FILES;       break;
+        case QUICKFIND_FLAG_ONLY_DIRECTORIES: only = QUERY_SCAN_ONLY_DIRECTORIES; break;
+        case 0:                               only = QUERY_SCAN_ONLY_ANY;         break;
+        default:                              return null;
+    }
+
+    // NOTE(rune): query_iter_init always anchors texts of 2 bytes or more, which the memmem variants rely on.
+    assert(iter->text_length == 1 || iter->anchored);
+
+    bool single_byte = iter->text_length == 1;
+    bool fullname    = (flags & QUICKFIND_FLAG_FULLNAME) != 0;
+    return g_query_scan_variants[single_byte][fullname][only];
 }
 
-static void file_read(file *file, void *buffer, usize size) {
-    if (file->ok) {
-        u32 bytes_read;
-        if (ReadFile(file->handle, buffer, (u32)size, &bytes_read, null)) {
-            if (bytes_read == size) {
-                // All good
-            } else {
-                file->ok = false;
-                debug_log_error("ReadFile read %i bytes but wanted to read %i", bytes_read, (u32)size);
-                assert(false);
+static void path_cache_init(path_cache *cache) {
+    for (u32 i = 0; i < PATH_CACHE_SLOT_COUNT; i++) {
+        cache->slots[i].dir_record_index_plus_one = 0;
+    }
+}
+
+static bool path_cache_get(path_cache *cache, db *database, record *dir, char *path_buffer, usize path_buffer_size, char **path, usize *path_length) {
+    u32 dir_record_index  = (u32)(dir - database->record_array.elems);
+    path_cache_slot *slot = &cache->slots[dir_record_index % PATH_CACHE_SLOT_COUNT];
+
+    if (slot->dir_record_index_plus_one == dir_record_index + 1) {
+        *path        = slot->path;
+        *path_length = slot->path_length;
+        return true;
+    }
+
+    // NOTE(rune): One less ancestor than walk_ancestors_build_path allows, since the child is one level further down.
+    record *ancestor_buffer[WALK_ANCESTORS_MAX_DEPTH - 1];
+    if (!walk_ancestors_build_path(dir, database, ancestor_buffer, countof(ancestor_buffer), path_buffer, path_buffer_size)) {
+        return false;
+    }
+
+    *path        = path_buffer;
+    *path_length = strlen(path_buffer);
+
+    if (*path_length < PATH_CACHE_MAX_PATH_LENGTH) {
+        memcpy(slot->path, path_buffer, *path_length + 1);
+        slot->path_length               = (u32)*path_length;
+        slot->dir_record_index_plus_one = dir_record_index + 1;
+    }
+
+    return true;
+}
+
+static quickfind_error query_push_result_item(record *found, db *database, buffer *result_buffer, path_cache *paths) {
+    char path_buffer[256 * 256];
+    record *ancestor_buffer[WALK_ANCESTORS_MAX_DEPTH];
+
+    char *name        = db_get_record_name(database, found);
+    usize name_length = found->name_length;
+
+    // NOTE(rune): The root has no parent to look up, and its path is just "C:".
+    char *parent_path        = null;
+    usize parent_path_length = 0;
+    bool is_root             = found->id.id64 == found->parent_id.id64;
+    bool append_name         = paths && !is_root;
+
+    if (append_name) {
+        record *parent = db_get_record_parent(database, found);
+        if (!parent || !path_cache_get(paths, database, parent, path_buffer, sizeof(path_buffer), &parent_path, &parent_path_length)) {
+            return QUICKFIND_OK;
+        }
+
+        // NOTE(rune): Same limit as walk_ancestors_build_path.
+        if (parent_path_length + 1 + name_length + 1 > sizeof(path_buffer)) {
+            assert(false);
+            return QUICKFIND_OK;
+        }
+    } else {
+        if (!walk_ancestors_build_path(found, database, ancestor_buffer, countof(ancestor_buffer), path_buffer, sizeof(path_buffer))) {
+            return QUICKFIND_OK;
+        }
+
+        parent_path        = path_buffer;
+        parent_path_length = strlen(path_buffer);
+    }
+
+    u32 path_size             = (u32)(parent_path_length + (append_name ? 1 + name_length : 0) + 1);
+    u32 result_size           = sizeof(query_result_item) + path_size;
+    query_result_item *result = buffer_append(result_buffer, result_size);
+    if (!result) {
+        return QUICKFIND_ERROR_OUT_OF_MEMORY;
+    }
+
+    result->id                = found->id.id64;
+    result->attributes        = found->attributes;
+    result->size              = found->size;
+    result->modification_time = found->modification_time;
+    result->path_size         = path_size;
+
+    memcpy(result->path, parent_path, parent_path_length);
+    if (append_name) {
+        result->path[parent_path_length] = '\\';
+        memcpy(result->path + parent_path_length + 1, name, name_length);
+    }
+
+    result->path[path_size - 1] = '\0';
+
+    return QUICKFIND_OK;
+}
+
+static query_result run_query_serial(quickfind_params params, buffer *result_buffer, db *database, regex *re, usize begin_record_index) {
+    query_iter iter;
+    query_iter_init(&iter, database, &params, re ? &re->dfas[0] : null, begin_record_index, database->record_array.count);
+
+    return run_query_iter(params, result_buffer, database, &iter);
+}
+
+static query_result run_query_iter(quickfind_params params, buffer *result_buffer, db *database, query_iter *iter) {
+    query_result result = { QUICKFIND_OK };
+
+    path_cache paths;
+    path_cache_init(&paths);
+
+    record *found = null;
+    while (result.found_count < params.stop_count && query_iter_advance(iter, &found)) {
+        if ((result.found_count >= params.skip_count) && (result.return_count < params.return_count)) {
+            u64 size_before = result_buffer->size;
+
+            quickfind_error error = query_push_result_item(found, database, result_buffer, &paths);
+            if (error) {
+                query_result error_result = { error };
+                return error_result;
+            }
+
+            if (result_buffer->size != size_before) {
+                result.return_count++;
+                result.next_found_count  = result.found_count + 1;
+                result.next_record_index = (u64)(found - database->record_array.elems) + 1;
             }
+        }
+
+        result.found_count++;
+    }
+
+    return result;
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Query top-k
+
+static bool query_sort_is_valid(quickfind_sort sort) {
+    quickfind_sort key = sort & ~QUICKFIND_SORT_DESCENDING;
+    switch (key) {
+        case QUICKFIND_SORT_NONE: return sort == QUICKFIND_SORT_NONE;
+        case QUICKFIND_SORT_NAME: return true;
+        case QUICKFIND_SORT_PATH: return true;
+        case QUICKFIND_SORT_SIZE: return true;
+        case QUICKFIND_SORT_DATE: return true;
+        case QUICKFIND_SORT_RELEVANCE: return true;
+        default:                  return false;
+    }
+}
+
+static inline bool query_match_is_alnum(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (u8)c >= 0x80;
+}
+
+static query_match_class query_match_class_of_term(char *name, char *original_name, usize name_length, char *term, usize term_length) {
+    if (term_length == 0 || term_length > name_length) {
+        return QUERY_MATCH_CLASS_INFIX;
+    }
+
+    if (memcmp(name, term, term_length) == 0) {
+        if (term_length == name_length ||
+            (name[term_length] == '.' && !memchr(name + term_length + 1, '.', name_length - term_length - 1))) {
+            return QUERY_MATCH_CLASS_FULLNAME;
         } else {
-            file->ok = false;
-            debug_log_error_win32("ReadFile");
-            assert(false);
+            return QUERY_MATCH_CLASS_PREFIX;
+        }
+    }
+
+    for (usize i = 1; i + term_length <= name_length; i++) {
+        if (name[i] == term[0] && memcmp(name + i, term, term_length) == 0) {
+            char before = original_name[i - 1];
+            char first  = original_name[i];
+            if (!query_match_is_alnum(before) || (before >= 'a' && before <= 'z' && first >= 'A' && first <= 'Z')) {
+                return QUERY_MATCH_CLASS_WORD_START;
+            }
         }
     }
+
+    return QUERY_MATCH_CLASS_INFIX;
 }
 
-static void file_write(file *file, void *buffer, usize size) {
-    if (file->ok) {
-        u32 bytes_written;
-        if (WriteFile(file->handle, buffer, (u32)size, &bytes_written, null)) {
-            if (bytes_written == size) {
-                // All good
+static u64 query_sort_rank(query_iter *iter, record *record, quickfind_sort sort) {
+    db *database = iter->database;
+    u64 key      = 0;
+
+    switch (sort & ~QUICKFIND_SORT_DESCENDING) {
+        // NOTE(rune): The first 8 bytes of the folded name in big endian, so keys order like names.
+        case QUICKFIND_SORT_NAME: {
+            u8 *folded_name = (u8 *)database->folded_name_buffer.elems + record->name_offset;
+            for (u32 i = 0; i < 8 && folded_name[i]; i++) {
+                key |= (u64)folded_name[i] << (56 - i * 8);
+            }
+        } break;
+
+        // NOTE(rune): Records without a parent path order get the worst key in either direction, so they
+        // sort after the numbered records, and are ordered among themselves by query_sort_compare.
+        case QUICKFIND_SORT_PATH: {
+            u32 path_order = dir_tree_get_parent_path_order(database, record);
+            if (path_order != 0) {
+                u8 *folded_name = (u8 *)database->folded_name_buffer.elems + record->name_offset;
+                key = (u64)path_order << 32;
+                for (u32 i = 0; i < 4 && folded_name[i]; i++) {
+                    key |= (u64)folded_name[i] << (24 - i * 8);
+                }
+            } else if (!(sort & QUICKFIND_SORT_DESCENDING)) {
+                key = UINT64_MAX;
+            }
+        } break;
+
+        case QUICKFIND_SORT_SIZE: {
+            key = record->size;
+        } break;
+
+        case QUICKFIND_SORT_DATE: {
+            key = record->modification_time;
+        } break;
+
+        // NOTE(rune): Relevance keys are smallest for the best match, so the natural ascending order is best first.
+        // Terms are in the same case as iter->names, but word starts are found from case changes in the original name.
+        case QUICKFIND_SORT_RELEVANCE: {
+            char *name          = iter->names + record->name_offset;
+            char *original_name = database->name_buffer.elems + record->name_offset;
+            usize name_length   = record->name_length;
+            u32 record_index    = (u32)(record - database->record_array.elems);
+
+            u32 score = 0;
+            if (iter->fuzzy) {
+                score = (u32)(iter->rank >> 16);
             } else {
-                file->ok = false;
-                debug_log_error("WriteFile wrote %i bytes but wanted to write %i", bytes_written, (u32)size);
+                for (u32 i = 0; i < iter->term_count; i++) {
+                    score += query_match_class_of_term(name, original_name, name_length, iter->terms[i].text, iter->terms[i].length);
+                }
+            }
+
+            key = (((u64)~score) << 32 |
+                   (u64)min(dir_tree_get_depth(database, record_index), 0xffff) << 16 |
+                   (u64)min(name_length, 0xffff));
+        } break;
+    }
+
+    // NOTE(rune): Higher ranks come first, so ascending order needs the smallest key to have the highest rank.
+    return (sort & QUICKFIND_SORT_DESCENDING) ? key : ~key;
+}
+
+// NOTE(rune): Collects the ancestors of a record, starting with its parent and ending with the root.
+static u32 query_sort_collect_ancestors(db *database, record *record, struct record **ancestors, u32 ancestor_capacity) {
+    u32 ancestor_count = 0;
+
+    while (ancestor_count < ancestor_capacity && record->id.id64 != record->parent_id.id64) {
+        record = db_get_record_parent(database, record);
+        if (!record) {
+            break;
+        }
+
+        ancestors[ancestor_count++] = record;
+    }
+
+    return ancestor_count;
+}
+
+static i32 query_sort_compare(db *database, record *a, record *b, quickfind_sort sort) {
+    char *folded_names = database->folded_name_buffer.elems;
+    i32 compare        = 0;
+
+    switch (sort & ~QUICKFIND_SORT_DESCENDING) {
+        case QUICKFIND_SORT_NAME:
+        case QUICKFIND_SORT_RELEVANCE: {
+            compare = strcmp(folded_names + a->name_offset, folded_names + b->name_offset);
+        } break;
+
+        // NOTE(rune): Paths of parent directories are compared one component at a time from the root,
+        // so a directory comes right before its subdirectories. Hits with the same parent path order
+        // have the same parent, so the ancestors are only walked if the path order could not be used.
+        case QUICKFIND_SORT_PATH: {
+            if (a->parent_id.id64 != b->parent_id.id64) {
+                record *a_ancestors[256];
+                record *b_ancestors[256];
+                u32 a_count = query_sort_collect_ancestors(database, a, a_ancestors, countof(a_ancestors));
+                u32 b_count = query_sort_collect_ancestors(database, b, b_ancestors, countof(b_ancestors));
+
+                for (u32 i = 1; i <= a_count && i <= b_count && compare == 0; i++) {
+                    record *a_ancestor = a_ancestors[a_count - i];
+                    record *b_ancestor = b_ancestors[b_count - i];
+                    if (a_ancestor != b_ancestor) {
+                        compare = strcmp(folded_names + a_ancestor->name_offset, folded_names + b_ancestor->name_offset);
+                    }
+                }
+
+                if (compare == 0) {
+                    compare = (i32)a_count - (i32)b_count;
+                }
+            }
+
+            if (compare == 0) {
+                compare = strcmp(folded_names + a->name_offset, folded_names + b->name_offset);
+            }
+        } break;
+    }
+
+    return (sort & QUICKFIND_SORT_DESCENDING) ? -compare : compare;
+}
+
+static inline bool query_ranked_hit_is_better(query_top_k *top_k, query_ranked_hit *a, query_ranked_hit *b) {
+    if (a->rank != b->rank) {
+        return a->rank > b->rank;
+    }
+
+    if (top_k->sort != QUICKFIND_SORT_NONE) {
+        record *records = top_k->database->record_array.elems;
+        i32 compare     = query_sort_compare(top_k->database, &records[a->record_index], &records[b->record_index], top_k->sort);
+        if (compare != 0) {
+            return compare < 0;
+        }
+    }
+
+    return a->record_index < b->record_index;
+}
+
+static void query_top_k_sift_down(query_top_k *top_k, u64 count, u64 at) {
+    query_ranked_hit *hits = top_k->hits;
+
+    while (true) {
+        u64 worst = at;
+        u64 left  = at * 2 + 1;
+        u64 right = at * 2 + 2;
+
+        if (left < count && query_ranked_hit_is_better(top_k, &hits[worst], &hits[left])) {
+            worst = left;
+        }
+
+        if (right < count && query_ranked_hit_is_better(top_k, &hits[worst], &hits[right])) {
+            worst = right;
+        }
+
+        if (worst == at) {
+            break;
+        }
+
+        query_ranked_hit temp = hits[at];
+        hits[at]              = hits[worst];
+        hits[worst]           = temp;
+        at                    = worst;
+    }
+}
+
+// NOTE(rune): The heap root is the worst hit, so a new hit only has to beat the root to get in.
+static void query_top_k_push(query_top_k *top_k, u64 rank, u32 record_index) {
+    query_ranked_hit hit = { rank, record_index };
+
+    if (top_k->count < top_k->capacity) {
+        u64 at = top_k->count++;
+        while (at > 0) {
+            u64 parent = (at - 1) / 2;
+            if (!query_ranked_hit_is_better(top_k, &top_k->hits[parent], &hit)) {
+                break;
             }
+
+            top_k->hits[at] = top_k->hits[parent];
+            at              = parent;
+        }
+
+        top_k->hits[at] = hit;
+    } else if (top_k->capacity > 0 && query_ranked_hit_is_better(top_k, &hit, &top_k->hits[0])) {
+        top_k->hits[0] = hit;
+        query_top_k_sift_down(top_k, top_k->count, 0);
+    }
+}
+
+static void query_top_k_sort(query_top_k *top_k) {
+    for (u64 end = top_k->count; end > 1; end--) {
+        query_ranked_hit temp = top_k->hits[0];
+        top_k->hits[0]        = top_k->hits[end - 1];
+        top_k->hits[end - 1]  = temp;
+        query_top_k_sift_down(top_k, end - 1, 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// rune: Query worker pool
+
+static u32 query_pool_default_thread_count(void) {
+    SYSTEM_INFO system_info = { 0 };
+    GetSystemInfo(&system_info);
+
+    u32 thread_count = system_info.dwNumberOfProcessors;
+    thread_count = max(thread_count, 1);
+    thread_count = min(thread_count, QUERY_POOL_MAX_THREADS);
+    return thread_count;
+}
+
+// NOTE(rune): thread_count includes the thread calling run_query, which also works on the
+// chunks while it waits, so a pool with a thread_count of 1 does not start any threads.
+static bool query_pool_create(query_pool *pool, u32 thread_count) {
+    zero_struct(pool);
+
+    thread_count = max(thread_count, 1);
+    thread_count = min(thread_count, QUERY_POOL_MAX_THREADS);
+
+    pool->work_semaphore = CreateSemaphoreA(null, 0, QUERY_POOL_MAX_THREADS, null);
+    if (pool->work_semaphore == null) {
+        debug_log_error_win32("CreateSemaphoreA");
+        return false;
+    }
+
+    pool->done_event = CreateEventA(null, false, false, null);
+    if (pool->done_event == null) {
+        debug_log_error_win32("CreateEventA");
+        CloseHandle(pool->work_semaphore);
+        return false;
+    }
+
+    pool->thread_count = 1;
+    for (u32 i = 0; i < thread_count - 1; i++) {
+        HANDLE thread = CreateThread(0, 0, query_pool_thread_proc, pool, 0, 0);
+        if (thread == null) {
+            debug_log_error_win32("CreateThread");
+            break;
+        }
+
+        pool->threads[pool->thread_count - 1] = thread;
+        pool->thread_count++;
+    }
+
+    return true;
+}
+
+static void query_pool_destroy(query_pool *pool) {
+    u32 worker_count = pool->thread_count - 1;
+
+    pool->shutdown = true;
+    if (worker_count > 0) {
+        ReleaseSemaphore(pool->work_semaphore, worker_count, null);
+        WaitForMultipleObjects(worker_count, pool->threads, true, INFINITE);
+    }
+
+    for (u32 i = 0; i < worker_count; i++) {
+        CloseHandle(pool->threads[i]);
+    }
+
+    CloseHandle(pool->work_semaphore);
+    CloseHandle(pool->done_event);
+    zero_struct(pool);
+}
+
+static DWORD WINAPI query_pool_thread_proc(LPVOID lpParameter) {
+    query_pool *pool = lpParameter;
+
+    while (true) {
+        WaitForSingleObject(pool->work_semaphore, INFINITE);
+        if (pool->shutdown) {
+            break;
+        }
+
+        query_job_work(pool->job);
+
+        if (InterlockedDecrement(&pool->pending_count) == 0) {
+            SetEvent(pool->done_event);
+        }
+    }
+
+    return 0;
+}
+
+static void query_pool_run(query_pool *pool, query_job *job) {
+    u32 worker_count = pool->thread_count - 1;
+
+    pool->job           = job;
+    pool->pending_count = worker_count;
+
+    if (worker_count > 0) {
+        ReleaseSemaphore(pool->work_semaphore, worker_count, null);
+    }
+
+    query_job_work(job);
+
+    if (worker_count > 0) {
+        WaitForSingleObject(pool->done_event, INFINITE);
+    }
+
+    pool->job = null;
+}
+
+// NOTE(rune): Chunks are handed out in order. Before searching a chunk, we check if the
+// chunks before it have already found stop_count results, in which case the chunk can
+// not contribute to the result.
+static bool query_job_can_skip_chunk(query_job *job, u32 chunk_index) {
+    u64 found_before = 0;
+    for (u32 i = 0; i < chunk_index; i++) {
+        query_chunk *chunk = &job->chunks[i];
+        if (!chunk->done) {
+            return false;
+        }
+
+        found_before += chunk->found_count;
+        if (found_before >= job->params.stop_count) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void query_job_work(query_job *job) {
+    regex_dfa *dfa = null;
+    if (job->regex) {
+        u32 dfa_index = (u32)(InterlockedIncrement(&job->next_dfa) - 1);
+        if (dfa_index >= job->regex->dfa_count) {
+            assert(false);
+            return;
+        }
+
+        dfa = &job->regex->dfas[dfa_index];
+    }
+
+    while (true) {
+        u32 chunk_index = (u32)(InterlockedIncrement(&job->next_chunk) - 1);
+        if (chunk_index >= job->chunk_count) {
+            break;
+        }
+
+        query_chunk *chunk     = &job->chunks[chunk_index];
+        query_collect *collect = job->collect;
+        bool whole_chunk       = job->ranked || collect;
+
+        if (collect && collect->overflow && !job->ranked) {
+            chunk->skipped = true;
+        } else if (!whole_chunk && query_job_can_skip_chunk(job, chunk_index)) {
+            chunk->skipped = true;
         } else {
-            file->ok = false;
-            debug_log_error_win32("WriteFile");
+            query_iter iter;
+            query_iter_init(&iter, job->database, &job->params, dfa, chunk->begin_record_index, chunk->end_record_index);
+
+            // NOTE(rune): Only the first and last word of the bitmap can be shared with neighbouring chunks.
+            usize first_word = chunk->begin_record_index / 32;
+            usize last_word  = chunk->end_record_index / 32;
+            LONG collected   = 0;
+
+            record *found = null;
+            while ((whole_chunk || chunk->found_count < job->params.stop_count) && query_iter_advance(&iter, &found)) {
+                u32 record_index = (u32)(found - job->database->record_array.elems);
+
+                if (collect && !collect->overflow) {
+                    usize word_index = record_index / 32;
+                    LONG bit         = (LONG)(1u << (record_index % 32));
+                    if (word_index == first_word || word_index == last_word) {
+                        InterlockedOr(&collect->bitmap[word_index], bit);
+                    } else {
+                        collect->bitmap[word_index] |= bit;
+                    }
+
+                    collected++;
+                    if (collected == QUERY_COLLECT_STEP) {
+                        query_collect_add(collect, collected);
+                        collected = 0;
+                    }
+                } else if (collect && !job->ranked) {
+                    break;
+                }
+
+                if (job->ranked) {
+                    u64 rank = job->params.sort ? query_sort_rank(&iter, found, job->params.sort) : iter.rank;
+                    query_top_k_push(&chunk->top_k, rank, record_index);
+                } else if (chunk->hits_count < chunk->hits_capacity) {
+                    chunk->hits[chunk->hits_count++] = record_index;
+                }
+
+                chunk->found_count++;
+            }
+
+            if (collect && collected) {
+                query_collect_add(collect, collected);
+            }
         }
+
+        MemoryBarrier();
+        chunk->done = true;
+    }
+}
+
+static void query_collect_add(query_collect *collect, LONG count) {
+    LONG total = InterlockedExchangeAdd(&collect->count, count) + count;
+    if (total > QUERY_SESSION_MAX_MATCHES) {
+        collect->overflow = true;
+    }
+}
+
+static void query_split_chunks(db *database, query_chunk *chunks, u32 chunk_count) {
+    usize name_buffer_size = database->name_buffer.count;
+    usize record_count     = database->record_array.count;
+
+    for (u32 i = 0; i < chunk_count; i++) {
+        query_chunk *chunk = &chunks[i];
+
+        usize begin_offset = (name_buffer_size / chunk_count) * i;
+        usize end_offset   = (name_buffer_size / chunk_count) * (i + 1);
+
+        chunk->begin_record_index = (i == 0)               ? 0            : db_find_record_index_by_name_offset(database, begin_offset);
+        chunk->end_record_index   = (i == chunk_count - 1) ? record_count : db_find_record_index_by_name_offset(database, end_offset);
     }
 }
 
-static void file_read_u8(file *file, u8 *buffer) { file_read(file, buffer, sizeof(*buffer)); }
-static void file_read_u16(file *file, u16 *buffer) { file_read(file, buffer, sizeof(*buffer)); }
-static void file_read_u32(file *file, u32 *buffer) { file_read(file, buffer, sizeof(*buffer)); }
-static void file_read_u64(file *file, u64 *buffer) { file_read(file, buffer, sizeof(*buffer)); }
-static void file_read_usize(file *file, usize *buffer) { file_read(file, buffer, sizeof(buffer)); }
+static query_result run_query_parallel(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool, regex *re) {
+    usize name_buffer_size = database->name_buffer.count;
 
-static void file_write_u8(file *file, u8 buffer) { file_write(file, &buffer, sizeof(buffer)); }
-static void file_write_u16(file *file, u16 buffer) { file_write(file, &buffer, sizeof(buffer)); }
-static void file_write_u32(file *file, u32 buffer) { file_write(file, &buffer, sizeof(buffer)); }
-static void file_write_u64(file *file, u64 buffer) { file_write(file, &buffer, sizeof(buffer)); }
-static void file_write_usize(file *file, usize buffer) { file_write(file, &buffer, sizeof(buffer)); }
+    u32 chunk_count = pool->thread_count * QUERY_CHUNKS_PER_THREAD;
+    chunk_count = (u32)min(chunk_count, name_buffer_size / QUERY_MIN_CHUNK_SIZE);
+    chunk_count = max(chunk_count, 1);
 
-static void file_read_array(file *file, array *array) {
-    file_read(file, array, sizeof(*array));
-    file_read_and_allocate(file, &array->elems, array->count_allocated * array->elem_size);
-}
+    // NOTE(rune): Each chunk can hold the hits of the whole returned page, since we don't
+    // know which chunks the page lies in before all chunks are done.
+    u64 hits_per_chunk = params.skip_count + params.return_count;
+    hits_per_chunk = min(hits_per_chunk, params.stop_count);
 
-static void file_write_array(file *file, array array) {
-    file_write(file, &array, sizeof(array));
-    file_write(file, array.elems, array.count_allocated * array.elem_size);
-}
+    if (hits_per_chunk > QUERY_MAX_CHUNK_HITS_TOTAL / chunk_count) {
+        return run_query_serial(params, result_buffer, database, re, 0);
+    }
 
-////////////////////////////////////////////////////////////////
-// rune: Database
+    usize alloc_size = chunk_count * (sizeof(query_chunk) + hits_per_chunk * sizeof(u32));
+    query_chunk *chunks = heap_alloc(alloc_size, true);
+    if (!chunks) {
+        query_result result = { QUICKFIND_ERROR_OUT_OF_MEMORY };
+        return result;
+    }
 
+    query_split_chunks(database, chunks, chunk_count);
 
-static void db_create(db *db) {
-    db->latest_journal_id = 0;
-    db->latest_usn = 0;
-    db->records_not_in_use_count = 0;
+    u32 *hits_storage = (u32 *)(chunks + chunk_count);
+    for (u32 i = 0; i < chunk_count; i++) {
+        query_chunk *chunk = &chunks[i];
+        chunk->hits          = hits_storage + hits_per_chunk * i;
+        chunk->hits_capacity = hits_per_chunk;
+    }
 
-    array_create_size(&db->name_buffer, KILOBYTES(64), true);
-    array_create_size(&db->lookup_array, KILOBYTES(64), true);
-    array_create_size(&db->record_array, KILOBYTES(64), true);
-}
+    query_job job = { 0 };
+    job.database    = database;
+    job.params      = params;
+    job.chunks      = chunks;
+    job.chunk_count = chunk_count;
+    job.regex       = re;
 
-static void db_destroy(db *db) {
-    array_destroy(&db->name_buffer);
-    array_destroy(&db->record_array);
-    array_destroy(&db->lookup_array);
-}
+    query_pool_run(pool, &job);
 
-static bool db_write_to_file(db *db, char *file_path) {
-    // TODO(rune): This should be a transaction, to avoid partial writes.
+    // NOTE(rune): Merge hits in chunk order, which is the same as record order.
+    query_result result = { QUICKFIND_OK };
 
-    file file;
-    file_open(&file, file_path, FILE_ACCESS_WRITE);
-    file_write_u64(&file, db->latest_journal_id);
-    file_write_u64(&file, db->latest_usn);
-    file_write_u32(&file, db->records_not_in_use_count);
-    file_write_array(&file, db->name_buffer.as_void);
-    file_write_array(&file, db->record_array.as_void);
-    file_write_array(&file, db->lookup_array.as_void);
-    file_close(&file);
+    path_cache paths;
+    path_cache_init(&paths);
+    for (u32 i = 0; i < chunk_count && result.found_count < params.stop_count; i++) {
+        query_chunk *chunk = &chunks[i];
+        assert(!chunk->skipped);
 
-    if (file.ok) {
-        return true;
-    } else {
-        assert(false);
-        return false;
+        for (u64 j = 0; j < chunk->hits_count; j++) {
+            u64 found_index = result.found_count + j;
+
+            if (found_index >= params.stop_count) {
+                break;
+            }
+
+            if ((found_index >= params.skip_count) && (result.return_count < params.return_count)) {
+                record *found = &database->record_array.elems[chunk->hits[j]];
+                u64 size_before = result_buffer->size;
+
+                result.error = query_push_result_item(found, database, result_buffer, &paths);
+                if (result.error) {
+                    break;
+                }
+
+                if (result_buffer->size != size_before) {
+                    result.return_count++;
+                    result.next_found_count  = found_index + 1;
+                    result.next_record_index = chunk->hits[j] + 1;
+                }
+            }
+        }
+
+        if (result.error) {
+            break;
+        }
+
+        result.found_count += chunk->found_count;
     }
-}
 
-static bool db_create_from_file(db *db, char *file_path) {
-    file file;
-    file_open(&file, file_path, FILE_ACCESS_READ);
-    file_read_u64(&file, &db->latest_journal_id);
-    file_read_u64(&file, &db->latest_usn);
-    file_read_u32(&file, &db->records_not_in_use_count);
-    file_read_array(&file, &db->name_buffer.as_void);
-    file_read_array(&file, &db->record_array.as_void);
-    file_read_array(&file, &db->lookup_array.as_void);
-    file_close(&file);
+    result.found_count = min(result.found_count, params.stop_count);
 
-    if (file.ok) {
-        return true;
-    } else {
-        db_destroy(db);
-        return false;
+    heap_free(chunks);
+
+    if (result.error) {
+        query_result error_result = { result.error };
+        return error_result;
     }
-}
 
-static char *db_get_record_name(db *db, record *record) {
-    assert(record->name_offset < db->name_buffer.count);
-    return &db->name_buffer.elems[record->name_offset];
+    return result;
 }
 
-static record *db_get_record_parent(db *db, record *record) {
-    return db_get_record_by_id(db, record->parent_id);
-}
+static query_result run_query_top_k_results(quickfind_params params, buffer *result_buffer, db *database, query_top_k *top_k, u64 found_count) {
+    query_top_k_sort(top_k);
 
-static record *db_get_record_by_id(db *db, record_id id) {
-    usize lookup_count = db->lookup_array.count_allocated;
+    query_result result = { QUICKFIND_OK };
 
-    // NOTE(rune): The lookup always expands to fit the max record_id_t added, so if we're
-    // asking for fild_id_t that doesn't fit in the lookup, the new_record was never added
-    // to the database.
-    if (id.record_number >= lookup_count) {
-        assert(false);
-        return null;
+    path_cache paths;
+    path_cache_init(&paths);
+    for (u64 i = params.skip_count; i < top_k->count && result.return_count < params.return_count; i++) {
+        record *found   = &database->record_array.elems[top_k->hits[i].record_index];
+        u64 size_before = result_buffer->size;
+
+        result.error = query_push_result_item(found, database, result_buffer, &paths);
+        if (result.error) {
+            query_result error_result = { result.error };
+            return error_result;
+        }
+
+        if (result_buffer->size != size_before) {
+            result.return_count++;
+        }
     }
 
-    // NOTE(rune): Assert that the lookup does not point outside the new_record buffer
-    u64 index_from_lookup = db->lookup_array.elems[id.record_number];
-    if (index_from_lookup >= db->record_array.count) {
-        assert(false);
-        return null;
+    result.found_count = min(found_count, params.stop_count);
+    return result;
+}
+
+static query_result run_query_ranked_iter(quickfind_params params, buffer *result_buffer, db *database, query_iter *iter, u32 *found_indices, usize *found_index_count) {
+    usize record_count = database->record_array.count;
+
+    u64 top_k_capacity = min(params.skip_count, record_count) + params.return_count;
+    top_k_capacity = min(top_k_capacity, record_count);
+    top_k_capacity = min(top_k_capacity, params.stop_count);
+
+    query_top_k top_k = { 0 };
+    top_k.hits        = heap_alloc(max(top_k_capacity, 1) * sizeof(query_ranked_hit), false);
+    top_k.capacity    = top_k_capacity;
+    top_k.database    = database;
+    top_k.sort        = params.sort;
+
+    if (!top_k.hits) {
+        query_result result = { QUICKFIND_ERROR_OUT_OF_MEMORY };
+        return result;
     }
 
-    if (index_from_lookup == 0) {
-        return null;
+    u64 found_count = 0;
+    record *found   = null;
+    while (query_iter_advance(iter, &found)) {
+        u32 record_index = (u32)(found - database->record_array.elems);
+        u64 rank         = params.sort ? query_sort_rank(iter, found, params.sort) : iter->rank;
+        query_top_k_push(&top_k, rank, record_index);
+
+        if (found_indices) {
+            found_indices[found_count] = record_index;
+        }
+
+        found_count++;
     }
 
-    record *record_from_lookup = (record *)db->record_array.elems + index_from_lookup;
-    if (record_from_lookup) {
-        assert(record_from_lookup->id.record_number == id.record_number);
+    if (found_index_count) {
+        *found_index_count = (usize)found_count;
     }
 
-    return record_from_lookup;
+    query_result result = run_query_top_k_results(params, result_buffer, database, &top_k, found_count);
+    heap_free(top_k.hits);
+    return result;
 }
 
-static void db_mark_record_not_in_use(db *db, record *record) {
-    if (!(record->attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
-        record->attributes |= FILE_ATTRIBUTE_NOT_IN_USE;
-        db->records_not_in_use_count++;
+static query_result run_query_ranked(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool, regex *re, query_collect *collect) {
+    usize name_buffer_size = database->name_buffer.count;
+    usize record_count     = database->record_array.count;
+
+    u64 top_k_capacity = min(params.skip_count, record_count) + params.return_count;
+    top_k_capacity = min(top_k_capacity, record_count);
+    top_k_capacity = min(top_k_capacity, params.stop_count);
+
+    u32 chunk_count = 1;
+    if (pool != null && pool->thread_count > 1 && name_buffer_size >= QUERY_MIN_CHUNK_SIZE * 2) {
+        chunk_count = pool->thread_count * QUERY_CHUNKS_PER_THREAD;
+        chunk_count = (u32)min(chunk_count, name_buffer_size / QUERY_MIN_CHUNK_SIZE);
+        chunk_count = max(chunk_count, 1);
     }
-}
 
-static bool db_refresh_lookup(db *db, record *new_record) {
-    if (!array_reserve(&db->lookup_array, new_record->id.record_number + 1, true)) {
-        assert(false);
-        return false;
+    if (top_k_capacity > QUERY_MAX_CHUNK_HITS_TOTAL / chunk_count) {
+        chunk_count = 1;
     }
 
-    // NOTE(rune): Record indices are not pushed in order onto the database->lookup array, like
-    // records are pushed onto the database->records array, so we always mark the whole lookup
-    // lookup buffer as used.
-    db->lookup_array.count = db->lookup_array.count_allocated;
+    // NOTE(rune): One top-k per chunk, plus one for merging the chunks.
+    usize alloc_size = chunk_count * sizeof(query_chunk) + (chunk_count + 1) * top_k_capacity * sizeof(query_ranked_hit);
+    query_chunk *chunks = heap_alloc(alloc_size, true);
+    if (!chunks) {
+        query_result result = { QUICKFIND_ERROR_OUT_OF_MEMORY };
+        return result;
+    }
 
-    record *records = db->record_array.elems;
-    u32      *lookup  = db->lookup_array.elems;
+    query_split_chunks(database, chunks, chunk_count);
 
-    // NOTE(rune): If the lookup previously pointed to another new_record, we mark the previous
-    // record as no longer in use, so that it can be pruned later.
-    u64 prev_record_index = lookup[new_record->id.record_number];
-    if (prev_record_index != 0) {
-        assert(prev_record_index < db->record_array.count);
-        record *prev_record = &records[prev_record_index];
+    query_ranked_hit *hits_storage = (query_ranked_hit *)(chunks + chunk_count);
+    for (u32 i = 0; i < chunk_count; i++) {
+        chunks[i].top_k.hits     = hits_storage + top_k_capacity * i;
+        chunks[i].top_k.capacity = top_k_capacity;
+        chunks[i].top_k.database = database;
+        chunks[i].top_k.sort     = params.sort;
+    }
 
-        if (new_record != prev_record) {
-            db_mark_record_not_in_use(db, prev_record);
-        }
+    query_job job = { 0 };
+    job.database     = database;
+    job.params       = params;
+    job.chunks       = chunks;
+    job.chunk_count  = chunk_count;
+    job.regex        = re;
+    job.ranked       = true;
+    job.collect      = collect;
+
+    if (chunk_count > 1) {
+        query_pool_run(pool, &job);
+    } else {
+        query_job_work(&job);
     }
 
-    u32 new_record_index = (u32)(new_record - records);
-    lookup[new_record->id.record_number] = new_record_index;
+    query_top_k merged = { 0 };
+    merged.hits     = hits_storage + top_k_capacity * chunk_count;
+    merged.capacity = top_k_capacity;
+    merged.database = database;
+    merged.sort     = params.sort;
+
+    u64 found_count = 0;
+    for (u32 i = 0; i < chunk_count; i++) {
+        query_chunk *chunk = &chunks[i];
+        for (u64 j = 0; j < chunk->top_k.count; j++) {
+            query_top_k_push(&merged, chunk->top_k.hits[j].rank, chunk->top_k.hits[j].record_index);
+        }
 
-    return true;
+        found_count += chunk->found_count;
+    }
+
+    query_result result = run_query_top_k_results(params, result_buffer, database, &merged, found_count);
+    heap_free(chunks);
+    return result;
 }
 
+// NOTE(rune): query_result_item_t's are pushed to result_buffer.
+static query_result run_query(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool) {
+    query_term terms[QUERY_MAX_TERMS];
+    query_term exts[QUERY_MAX_EXTS];
+    query_term scope;
+    u32 term_count = 0;
+    u32 ext_count  = 0;
+
+    if (!query_split_terms(params.text, params.text_length, params.flags, terms, &term_count, exts, &ext_count, &scope) ||
+        !query_sort_is_valid(params.sort)) {
+        query_result result = { QUICKFIND_ERROR_INVALID_REQUEST };
+        return result;
+    }
 
-static uint32_t length_of_utf16_as_utf8(wchar *wstring, uint32_t wstring_len) {
-    uint32_t utf8_length = WideCharToMultiByte(CP_UTF8, 0, wstring, wstring_len, null, 0, null, null);
-    return utf8_length;
-}
+    bool ranked = (params.flags & QUICKFIND_FLAG_FUZZY) || params.sort != QUICKFIND_SORT_NONE;
 
-static bool convert_utf16_to_utf8(wchar *wstring, uint32_t wstring_len, char *utf8_buffer, uint32_t utf8_buffer_size) {
-    bool result = false;
+    if ((params.sort & ~QUICKFIND_SORT_DESCENDING) == QUICKFIND_SORT_PATH) {
+        dir_tree_prepare_path_order(database);
+    }
 
-    result = WideCharToMultiByte(CP_UTF8, 0, wstring, wstring_len, utf8_buffer, utf8_buffer_size, null, null) > 0;
-    return result;
-}
+    // NOTE(rune): All terms must occur in a name, so the candidates for the longest term are enough.
+    char *literal        = null;
+    usize literal_length = 0;
+    for (u32 i = 0; i < term_count; i++) {
+        if (!literal || terms[i].length > literal_length) {
+            literal        = terms[i].text;
+            literal_length = terms[i].length;
+        }
+    }
 
-static record *db_insert(db *db, record_id id, record_id parent_id, uint32_t attributes, wchar *wname, uint32_t wname_len) {
-    uint32_t name_len  = length_of_utf16_as_utf8(wname, wname_len);
+    char *ext_texts[QUERY_MAX_EXTS];
+    usize ext_lengths[QUERY_MAX_EXTS];
+    for (u32 i = 0; i < ext_count; i++) {
+        ext_texts[i]   = exts[i].text;
+        ext_lengths[i] = exts[i].length;
+    }
 
-    char *name = array_push_count(&db->name_buffer, name_len + 1, false);
-    if (!name) {
-        assert(false);
-        return null;
+    // NOTE(rune): Fuzzy and typo tolerant matches need not contain any trigram of the text.
+    if (params.flags & (QUICKFIND_FLAG_FUZZY | QUICKFIND_FLAG_TYPOS_1 | QUICKFIND_FLAG_TYPOS_2)) {
+        literal_length = 0;
     }
 
-    bool converted = convert_utf16_to_utf8(wname, wname_len, name, name_len);
-    if (!converted) {
-        assert(false);
-        return null;
+    regex *re = null;
+    quickfind_error error = regex_create_for_query(&params, pool ? pool->thread_count : 1, &re);
+    if (error) {
+        query_result result = { error };
+        return result;
     }
 
-    name[name_len] = '\0';
+    if (re) {
+        literal        = re->literal;
+        literal_length = re->literal_length;
+    }
 
-    record *record = array_push(&db->record_array, false);
-    if (!record) {
-        assert(false);
-        return null;
+    query_result result   = { 0 };
+    u32 *candidates       = null;
+    usize candidate_count = 0;
+
+    // NOTE(rune): Resumed queries only need the hits between the cursor and the end of the page,
+    // which are usually close to the cursor, so they never run in parallel.
+    u64 resume_found_count    = 0;
+    usize resume_record_index = 0;
+    if (!ranked && query_cursor_can_resume(&params, database)) {
+        resume_found_count  = params.cursor.found_count;
+        resume_record_index = (usize)params.cursor.record_index;
+        params.skip_count  -= resume_found_count;
+        params.stop_count  -= resume_found_count;
     }
 
-    record->id          = id;
-    record->parent_id   = parent_id;
-    record->attributes  = attributes;
-    record->name_offset = name - db->name_buffer.elems;
+    bool parallel = (pool != null &&
+                     pool->thread_count > 1 &&
+                     resume_found_count == 0 &&
+                     database->name_buffer.count >= QUERY_MIN_CHUNK_SIZE * 2);
+
+    // NOTE(rune): Without any terms, the extension postings are all we need. With terms, common
+    // extensions are cheaper to check while scanning for the terms.
+    usize max_ext_candidates = term_count > 0 ? database->record_array.count / EXT_MAX_POSTING_RATIO : database->record_array.count;
+
+    // NOTE(rune): Plain full name queries match the whole folded name, so the name index has the exact candidates.
+    bool exact_name = (params.text_length > 0 &&
+                       !(params.flags & QUERY_FLAG_NO_NAME_INDEX) &&
+                       (params.flags & QUICKFIND_FLAG_FULLNAME) &&
+                       !(params.flags & (QUICKFIND_FLAG_GLOB | QUICKFIND_FLAG_REGEX | QUICKFIND_FLAG_FUZZY | QUICKFIND_FLAG_TYPOS_1 | QUICKFIND_FLAG_TYPOS_2)));
+
+    // NOTE(rune): Directory only queries which no index narrows down, scan just the directory names.
+    bool only_dirs = (params.flags & QUICKFIND_FLAG_ONLY_DIRECTORIES) && !(params.flags & QUERY_FLAG_NO_DIR_NAMES);
+    bool trigrams  = !(params.flags & QUERY_FLAG_NO_TRIGRAMS);
+
+    if ((exact_name && name_index_find_candidates(database, params.text, params.text_length, &candidates, &candidate_count)) ||
+        (ext_count > 0 && ext_index_find_candidates(database, ext_texts, ext_lengths, ext_count, max_ext_candidates, &candidates, &candidate_count)) ||
+        (trigrams && trigram_index_find_candidates(database, literal, literal_length, &candidates, &candidate_count)) ||
+        (only_dirs && dir_names_find_candidates(database, literal, literal_length, params.flags, &candidates, &candidate_count))) {
+        query_iter iter;
+        query_iter_init_candidates(&iter, database, &params, re ? &re->dfas[0] : null, candidates, candidate_count);
+
+        // NOTE(rune): Candidates are sorted by record index, so we can skip to the cursor.
+        usize lo = 0;
+        usize hi = candidate_count;
+        while (lo < hi) {
+            usize mid = lo + (hi - lo) / 2;
+            if (candidates[mid] < resume_record_index) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        iter.candidate_index = lo;
 
-    db_refresh_lookup(db, record);
+        if (ranked) {
+            result = run_query_ranked_iter(params, result_buffer, database, &iter, null, null);
+        } else {
+            result = run_query_iter(params, result_buffer, database, &iter);
+        }
 
-    return record;
-}
+        heap_free(candidates);
+    } else if (ranked) {
+        result = run_query_ranked(params, result_buffer, database, pool, re, null);
+    } else if (parallel) {
+        result = run_query_parallel(params, result_buffer, database, pool, re);
+    } else {
+        result = run_query_serial(params, result_buffer, database, re, resume_record_index);
+    }
 
+    if (!result.error && resume_found_count > 0) {
+        result.found_count += resume_found_count;
+        if (result.return_count > 0) {
+            result.next_found_count += resume_found_count;
+        }
+    }
 
-static record *db_update(db *db, record_id id, record_id parent_id, u32 attributes, wchar *wname, u32 wname_len) {
-    db_delete(db, id);
+    if (re) {
+        heap_free(re);
+    }
 
-    return db_insert(db, id, parent_id, attributes, wname, wname_len);
+    return result;
 }
 
-static void db_delete(db *db, record_id id) {
-    record *record = db_get_record_by_id(db, id);
-    if (record) {
-        db_mark_record_not_in_use(db, record);
-    }
+////////////////////////////////////////////////////////////////
+// rune: Query cursors
+
+static u64 query_cursor_hash(quickfind_params *params) {
+    u64 hash = ext_hash(params->text, params->text_length);
+    hash ^= (u64)params->flags * 0x9E3779B97F4A7C15ull;
+    return hash;
 }
 
-static void db_apply_changes(db *db, change_list changes) {
-#if 1
-    printf("================================\n");
-    for (change *change = changes.first; change; change = change->next) {
-        if (change->ignore) {
-            printf(ANSI_BG_DARK_GRAY);
-        }
+static bool query_cursor_can_resume(quickfind_params *params, db *database) {
+    quickfind_cursor *cursor = &params->cursor;
+    if (cursor->found_count == 0 ||
+        cursor->found_count > params->skip_count ||
+        cursor->found_count > params->stop_count ||
+        cursor->generation != database->generation ||
+        cursor->query_hash != query_cursor_hash(params) ||
+        cursor->record_index > database->record_array.count) {
+        return false;
+    }
 
-        printf("%16llx", change->usn);
+    // NOTE(rune): Checked as well, in case the cursor is from a database with the same generation,
+    // e.g. before the server restarted.
+    u64 name_offset = (cursor->record_index < database->record_array.count
+                       ? database->record_array.elems[cursor->record_index].name_offset
+                       : database->name_buffer.count);
 
-        switch (change->type) {
-            case CHANGE_TYPE_INSERT: printf(ANSI_FG_GREEN "INSERT " ANSI_RESET); break;
-            case CHANGE_TYPE_UPDATE: printf(ANSI_FG_CYAN  "UPDATE " ANSI_RESET); break;
-            case CHANGE_TYPE_DELETE: printf(ANSI_FG_RED   "DELETE " ANSI_RESET); break;
-        }
+    return cursor->name_offset == name_offset;
+}
 
-        printf("%16llx %16llx %.*ls\n",
-               change->id.id64,
-               change->parent_id.id64,
-               change->wname_length,
-               change->wname);
+static quickfind_cursor query_cursor_next(quickfind_params *params, query_result *result, db *database) {
+    quickfind_cursor cursor = { 0 };
+
+    if (!result->error &&
+        result->return_count > 0 &&
+        !(params->flags & QUICKFIND_FLAG_FUZZY) &&
+        params->sort == QUICKFIND_SORT_NONE) {
+        cursor.record_index = result->next_record_index;
+        cursor.name_offset  = (result->next_record_index < database->record_array.count
+                               ? database->record_array.elems[result->next_record_index].name_offset
+                               : database->name_buffer.count);
+        cursor.found_count  = result->next_found_count;
+        cursor.generation   = database->generation;
+        cursor.query_hash   = query_cursor_hash(params);
     }
-#endif
 
-    for (change *change = changes.first; change; change = change->next) {
-        if (!change->ignore) {
-            switch (change->type) {
-                case CHANGE_TYPE_INSERT: {
-                    db_insert(db,
-                              change->id,
-                              change->parent_id,
-                              change->attributes,
-                              change->wname,
-                              change->wname_length);
-                } break;
+    return cursor;
+}
 
-                case CHANGE_TYPE_UPDATE: {
-                    db_update(db,
-                              change->id,
-                              change->parent_id,
-                              change->attributes,
-                              change->wname,
-                              change->wname_length);
-                } break;
+////////////////////////////////////////////////////////////////
+// rune: Query sessions
+
+static query_session *query_session_find(query_session *sessions, u32 session_count, u32 client_id, u64 now) {
+    if (client_id == 0) {
+        return null;
+    }
 
-                case CHANGE_TYPE_DELETE: {
-                    db_delete(db, change->id);
-                } break;
+    query_session *found = null;
+    for (u32 i = 0; i < session_count; i++) {
+        if (sessions[i].client_id == client_id) {
+            found = &sessions[i];
+            break;
+        }
+    }
+
+    // NOTE(rune): Unused sessions have last_used = 0, so they are taken first.
+    if (!found) {
+        found = &sessions[0];
+        for (u32 i = 1; i < session_count; i++) {
+            if (sessions[i].last_used < found->last_used) {
+                found = &sessions[i];
             }
         }
 
-        db->latest_usn = max(db->latest_usn, change->usn);
+        query_session_reset(found);
+        found->client_id = client_id;
     }
+
+    found->last_used = now;
+    return found;
 }
 
-static uint32_t db_prune(db *db) {
-    // TODO(rune): Implement
+static void query_session_reset(query_session *session) {
+    if (session->matches) {
+        heap_free(session->matches);
+    }
+
+    session->has_matches = false;
+    session->matches     = null;
+    session->match_count = 0;
+    session->text_length = 0;
 }
 
-////////////////////////////////////////////////////////////////
-// rune: Sanity checks
+static bool query_session_is_refinable(quickfind_params *params) {
+    if (params->flags & (QUICKFIND_FLAG_FULLNAME | QUICKFIND_FLAG_GLOB | QUICKFIND_FLAG_REGEX)) {
+        return false;
+    }
 
-// NOTE(rune): Counts the number of names in the database's name buffer, and compares
-// it to the number of records in the database. When the run_query static searches
-// the name buffer, it uses the number of null chars encountered the determine the
-// matched record's index. Therefore its important that the number of null chars in
-// the name buffer always matches the number of records in the record buffer.
-static bool debug_sanity_check_names(db *db) {
-    usize n = 0;
+    if (params->text_length == 0 || params->text_length > QUERY_SESSION_MAX_TEXT_LENGTH) {
+        return false;
+    }
 
-    for (usize i = 0; i < db->name_buffer.count; i++) {
-        char c = db->name_buffer.elems[i];
-        if (c == '\0') {
-            n++;
+    // NOTE(rune): Text of only whitespace falls back to a single term of the whole text, which the
+    // terms of a longer text need not contain, e.g. " r" has the single term "r".
+    bool only_whitespace = true;
+    for (usize i = 0; i < params->text_length; i++) {
+        if (params->text[i] != ' ' && params->text[i] != '\t') {
+            only_whitespace = false;
+            break;
         }
     }
 
-    u64 record_count = db->record_array.count;
-    if (n == record_count) {
-        return true;
-    } else {
-        assert(!"Number of null-chars in name_buffer does not match number of records.");
+    if (only_whitespace) {
+        return false;
+    }
+
+    query_term terms[QUERY_MAX_TERMS];
+    query_term exts[QUERY_MAX_EXTS];
+    query_term scope;
+    u32 term_count = 0;
+    u32 ext_count  = 0;
+
+    if (!query_split_terms(params->text, params->text_length, params->flags, terms, &term_count, exts, &ext_count, &scope)) {
         return false;
     }
+
+    return ext_count == 0 && scope.length == 0;
 }
 
-static bool debug_sanity_check_lookup(db *db) {
-    record *records      = db->record_array.elems;
-    usize   record_count = db->record_array.count;
+// NOTE(rune): The text must not extend the last character of the previous text, since folding
+// a whole character can change bytes that belonged to the incomplete character before.
+static bool query_session_can_refine(query_session *session, db *database, quickfind_params *params) {
+    return (session->has_matches &&
+            session->generation == database->generation &&
+            session->flags == params->flags &&
+            session->text_length < params->text_length &&
+            memcmp(session->text, params->text, session->text_length) == 0 &&
+            (params->text[session->text_length] & 0xC0) != 0x80);
+}
 
-    u32  *lookup        = db->lookup_array.elems;
-    usize lookup_count  = db->lookup_array.count;
+static query_result run_query_session_candidates(quickfind_params params, buffer *result_buffer, db *database, u32 *candidates, usize candidate_count, u32 **matches, usize *match_count) {
+    u32 *found_indices = heap_alloc(max(candidate_count, 1) * sizeof(u32), false);
+    if (!found_indices) {
+        query_result result = { QUICKFIND_ERROR_OUT_OF_MEMORY };
+        return result;
+    }
 
-    // NOTE(rune): Check lookup_array -> record_array.
-    for (usize record_number = 0; record_number < lookup_count; record_number++) {
-        u32 idx_from_lookup = lookup[record_number];
+    query_iter iter;
+    query_iter_init_candidates(&iter, database, &params, null, candidates, candidate_count);
 
-        if (idx_from_lookup == 0) {
-            continue;
+    query_result result = { 0 };
+    usize found_count   = 0;
+    if ((params.flags & QUICKFIND_FLAG_FUZZY) || params.sort != QUICKFIND_SORT_NONE) {
+        result = run_query_ranked_iter(params, result_buffer, database, &iter, found_indices, &found_count);
+    } else {
+        // NOTE(rune): Past QUERY_SESSION_MAX_MATCHES the matches are not kept, so there is no need to look beyond stop_count.
+        record *found = null;
+        while ((found_count <= QUERY_SESSION_MAX_MATCHES || found_count < params.stop_count) && query_iter_advance(&iter, &found)) {
+            found_indices[found_count++] = (u32)(found - database->record_array.elems);
         }
 
-        if (idx_from_lookup > record_count) {
-            assert(!"Lookup points to record outside record buffer.");
-            return false;
-        }
+        result = run_query_matches(params, result_buffer, database, found_indices, found_count);
+    }
 
-        record *record = records + idx_from_lookup;
+    if (result.error || found_count > QUERY_SESSION_MAX_MATCHES) {
+        heap_free(found_indices);
+        found_indices = null;
+        found_count   = 0;
+    }
 
-        if (record->id.record_number != record_number) {
-            assert(!"Lookup does not match record_number of record.");
-            return false;
-        }
+    *matches     = found_indices;
+    *match_count = found_count;
+    return result;
+}
+
+static query_result run_query_session_scan(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool, u32 **matches, usize *match_count) {
+    usize name_buffer_size = database->name_buffer.count;
+    usize record_count     = database->record_array.count;
+    usize word_count       = record_count / 32 + 1;
+
+    query_collect collect = { 0 };
+    collect.bitmap = heap_alloc(word_count * sizeof(LONG), true);
+    if (!collect.bitmap) {
+        query_result result = { QUICKFIND_ERROR_OUT_OF_MEMORY };
+        return result;
     }
 
-    // NOTE(rune): Check record_array -> lookup_array.
-    for (usize record_idx = 0; record_idx < record_count; record_idx++) {
-        record *it = records + record_idx;
+    query_result result = { QUICKFIND_OK };
+    bool ranked         = (params.flags & QUICKFIND_FLAG_FUZZY) || params.sort != QUICKFIND_SORT_NONE;
 
-        if (it->id.record_number >= lookup_count) {
-            assert(!"Lookup does not contain all record numbers.");
-            return false;
+    if (ranked) {
+        result = run_query_ranked(params, result_buffer, database, pool, null, &collect);
+    } else {
+        u32 chunk_count = 1;
+        if (pool != null && pool->thread_count > 1 && name_buffer_size >= QUERY_MIN_CHUNK_SIZE * 2) {
+            chunk_count = pool->thread_count * QUERY_CHUNKS_PER_THREAD;
+            chunk_count = (u32)min(chunk_count, name_buffer_size / QUERY_MIN_CHUNK_SIZE);
+            chunk_count = max(chunk_count, 1);
         }
 
-        u32 idx_from_lookup = lookup[it->id.record_number];
-        record *record_from_lookup = records + idx_from_lookup;
+        query_chunk *chunks = heap_alloc(chunk_count * sizeof(query_chunk), true);
+        if (chunks) {
+            query_split_chunks(database, chunks, chunk_count);
 
-        if (idx_from_lookup == 0 && it->id.record_number != 0) {
-            assert(!"Lookup does not contain all record numbers.");
-            return false;
+            query_job job = { 0 };
+            job.database    = database;
+            job.params      = params;
+            job.chunks      = chunks;
+            job.chunk_count = chunk_count;
+            job.collect     = &collect;
+
+            if (chunk_count > 1) {
+                query_pool_run(pool, &job);
+            } else {
+                query_job_work(&job);
+            }
+
+            heap_free(chunks);
+        } else {
+            result.error = QUICKFIND_ERROR_OUT_OF_MEMORY;
         }
 
-        if (it->id.record_number != it->id.record_number) {
-            assert(!"Lookup does not match record_number of record.");
-            return false;
+        // NOTE(rune): Too many matches to keep, so the scan was given up. Scanning again without
+        // collecting can stop at stop_count, and skip chunks after the returned page.
+        if (!result.error && collect.overflow) {
+            heap_free((void *)collect.bitmap);
+            *matches     = null;
+            *match_count = 0;
+            return run_query(params, result_buffer, database, pool);
         }
+    }
 
-        u32 parent_idx_from_lookup = lookup[it->parent_id.record_number];
-        if (parent_idx_from_lookup == 0 && it->parent_id.record_number != 0) {
-            assert(!"Lookup does not contain parent record.");
-            return false;
+    u32 *found_indices = null;
+    usize found_count  = 0;
+    if (!result.error && !collect.overflow) {
+        found_indices = heap_alloc(max(collect.count, 1) * sizeof(u32), false);
+        if (found_indices) {
+            for (usize word_index = 0; word_index < word_count; word_index++) {
+                u32 word = (u32)collect.bitmap[word_index];
+                while (word) {
+                    found_indices[found_count++] = (u32)(word_index * 32 + count_trailing_zeroes(word));
+                    word = clear_leftmost_set(word);
+                }
+            }
+
+            assert(found_count == (usize)collect.count);
+        } else {
+            result.error = QUICKFIND_ERROR_OUT_OF_MEMORY;
         }
     }
 
-    return true;
-}
+    heap_free((void *)collect.bitmap);
 
-////////////////////////////////////////////////////////////////
-// rune: Query
+    if (!result.error && !ranked) {
+        result = run_query_matches(params, result_buffer, database, found_indices, found_count);
+    }
 
-static bool walk_ancestors_is_child_of_root(record *record, db *database, u32 max_depth) {
-    while (max_depth--) {
-        bool is_root = record->id.id64 == record->parent_id.id64;
-        if (is_root) {
-            return true;
+    if (result.error) {
+        if (found_indices) {
+            heap_free(found_indices);
+            found_indices = null;
+            found_count   = 0;
         }
 
-        record = db_get_record_parent(database, record);
-        if (!record) {
-            // TODO(rune): Mark as orphan?
-            return false;
-        }
+        query_result error_result = { result.error };
+        result = error_result;
     }
 
-    assert(true);
-    return false;
+    *matches     = found_indices;
+    *match_count = found_count;
+    return result;
 }
 
-static u32 walk_ancestors_build_path(record *child, db *database,
-                                     record **ancestor_buffer, u32 ancestor_buffer_count,
-                                     char *path_buffer, usize path_buffer_size) {
-    // NOTE(rune): The child record itself also counts as an ancestor
-    u32 ancestor_count = 1;
+static query_result run_query_matches(quickfind_params params, buffer *result_buffer, db *database, u32 *matches, usize match_count) {
+    query_result result = { QUICKFIND_OK };
+    result.found_count  = min(match_count, params.stop_count);
 
-    while (true) {
-        ancestor_buffer[ancestor_count - 1] = child;
+    path_cache paths;
+    path_cache_init(&paths);
 
-        bool is_root = child->id.id64 == child->parent_id.id64;
-        if (is_root) {
-            break;
+    for (u64 i = params.skip_count; i < result.found_count && result.return_count < params.return_count; i++) {
+        record *found   = &database->record_array.elems[matches[i]];
+        u64 size_before = result_buffer->size;
+
+        result.error = query_push_result_item(found, database, result_buffer, &paths);
+        if (result.error) {
+            query_result error_result = { result.error };
+            return error_result;
         }
 
-        child = db_get_record_parent(database, child);
-        if (!child) {
-            // TODO(rune): Mark as orphan?
-            return 0;
+        if (result_buffer->size != size_before) {
+            result.return_count++;
+            result.next_found_count  = i + 1;
+            result.next_record_index = matches[i] + 1;
         }
+    }
 
-        ancestor_count++;
+    return result;
+}
 
-        if (ancestor_count > ancestor_buffer_count) {
-            assert(false);
-            return 0;
+static query_result run_query_session(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool, query_session *session) {
+    // NOTE(rune): Resuming from a cursor is cheaper than even the matches of the session, which are kept as they are.
+    if (query_cursor_can_resume(&params, database) && !(params.flags & QUICKFIND_FLAG_FUZZY) && params.sort == QUICKFIND_SORT_NONE) {
+        return run_query(params, result_buffer, database, pool);
+    }
+
+    if (!session || !query_session_is_refinable(&params) || !query_sort_is_valid(params.sort)) {
+        if (session) {
+            query_session_reset(session);
         }
+
+        return run_query(params, result_buffer, database, pool);
     }
 
-    path_buffer[0] = 'C';
-    path_buffer[1] = ':';
-    path_buffer[2] = '\0';
+    if ((params.sort & ~QUICKFIND_SORT_DESCENDING) == QUICKFIND_SORT_PATH) {
+        dir_tree_prepare_path_order(database);
+    }
 
-    // TODO(rune): String concatenation optimization. StringCbCatA presumably checks length of pszDest
-    // each time it is called, which is not neccassary, when we are concatenating multiple strings.
+    u32 *matches        = null;
+    usize match_count   = 0;
+    query_result result = { 0 };
 
-    // NOTE(rune): Start at ancestor_count - 2 to skip root record since its name just "."
-    for (i32 ancestor_index = ancestor_count - 2;
-         ancestor_index >= 0;
-         ancestor_index--) {
-        char *name = db_get_record_name(database, ancestor_buffer[ancestor_index]);
+    if (query_session_can_refine(session, database, &params)) {
+        result = run_query_session_candidates(params, result_buffer, database, session->matches, session->match_count, &matches, &match_count);
+    } else {
+        // NOTE(rune): Without matches from the session, the trigram index may still narrow down the candidates.
+        query_term terms[QUERY_MAX_TERMS];
+        query_term exts[QUERY_MAX_EXTS];
+        query_term scope;
+        u32 term_count = 0;
+        u32 ext_count  = 0;
+        query_split_terms(params.text, params.text_length, params.flags, terms, &term_count, exts, &ext_count, &scope);
+
+        char *literal        = null;
+        usize literal_length = 0;
+        for (u32 i = 0; i < term_count; i++) {
+            if (!literal || terms[i].length > literal_length) {
+                literal        = terms[i].text;
+                literal_length = terms[i].length;
+            }
+        }
 
-        if (StringCbCatA(path_buffer, path_buffer_size, "\\")) {
-            assert(false);
-            return 0;
+        if (params.flags & (QUICKFIND_FLAG_FUZZY | QUICKFIND_FLAG_TYPOS_1 | QUICKFIND_FLAG_TYPOS_2)) {
+            literal_length = 0;
         }
 
-        if (StringCbCatA(path_buffer, path_buffer_size, name)) {
-            assert(false);
-            return 0;
+        bool only_dirs = (params.flags & QUICKFIND_FLAG_ONLY_DIRECTORIES) && !(params.flags & QUERY_FLAG_NO_DIR_NAMES);
+        bool trigrams  = !(params.flags & QUERY_FLAG_NO_TRIGRAMS);
+
+        u32 *candidates       = null;
+        usize candidate_count = 0;
+        if ((trigrams && trigram_index_find_candidates(database, literal, literal_length, &candidates, &candidate_count)) ||
+            (only_dirs && dir_names_find_candidates(database, literal, literal_length, params.flags, &candidates, &candidate_count))) {
+            result = run_query_session_candidates(params, result_buffer, database, candidates, candidate_count, &matches, &match_count);
+            heap_free(candidates);
+        } else {
+            result = run_query_session_scan(params, result_buffer, database, pool, &matches, &match_count);
         }
     }
 
-    return ancestor_count;
+    // NOTE(rune): The old matches may have been the candidates, so the session is only reset now.
+    query_session_reset(session);
+
+    if (matches && match_count <= QUERY_SESSION_MAX_MATCHES) {
+        memcpy(session->text, params.text, params.text_length);
+        session->text_length = params.text_length;
+        session->flags       = params.flags;
+        session->generation  = database->generation;
+        session->matches     = matches;
+        session->match_count = match_count;
+        session->has_matches = true;
+    } else if (matches) {
+        heap_free(matches);
+    }
+
+    return result;
 }
 
-static bool matches_query_flags(record *record, quickfind_flags flags,
-                                char *query, usize query_len,
-                                char *match, usize match_len) {
-    if (record->attributes & FILE_ATTRIBUTE_NOT_IN_USE) {
-        return false;
+////////////////////////////////////////////////////////////////
+// rune: Query cache
+
+static void query_cache_destroy(query_cache *cache) {
+    for (u32 i = 0; i < countof(cache->entries); i++) {
+        query_cache_entry_reset(cache, &cache->entries[i]);
     }
+}
 
-    if ((flags & QUICKFIND_FLAG_ONLY_FILES) && (record->attributes & FILE_ATTRIBUTE_DIRECTORY)) {
-        return false;
+static void query_cache_entry_reset(query_cache *cache, query_cache_entry *entry) {
+    if (entry->data) {
+        cache->size -= entry->text_length + entry->body_size;
+        heap_free(entry->data);
     }
 
-    if ((flags & QUICKFIND_FLAG_ONLY_DIRECTORIES) && !(record->attributes & FILE_ATTRIBUTE_DIRECTORY)) {
-        return false;
+    zero_struct(entry);
+}
+
+static query_cache_entry *query_cache_find(query_cache *cache, quickfind_params *params, u64 generation) {
+    query_cache_entry *found = null;
+
+    for (u32 i = 0; i < countof(cache->entries); i++) {
+        query_cache_entry *entry = &cache->entries[i];
+        if (!entry->last_used) {
+            continue;
+        }
+
+        if (entry->generation != generation) {
+            query_cache_entry_reset(cache, entry);
+            continue;
+        }
+
+        if (entry->text_length  == params->text_length &&
+            entry->flags        == params->flags &&
+            entry->sort         == params->sort &&
+            entry->return_count == params->return_count &&
+            entry->skip_count   == params->skip_count &&
+            entry->stop_count   == params->stop_count &&
+            memcmp(entry->text, params->text, params->text_length) == 0) {
+            found = entry;
+        }
     }
 
-    if ((flags & QUICKFIND_FLAG_FULLNAME) && (query_len != match_len)) {
-        return false;
+    if (found) {
+        found->last_used = ++cache->clock;
+        cache->hit_count++;
+    } else {
+        cache->miss_count++;
     }
 
-    return true;
+    return found;
 }
 
-static char *find_first_occurrence_and_count_nulls(char *buffer, usize buffer_length, char *look_for, usize look_for_length, quickfind_flags flags, usize *null_count) {
-    if (flags & QUICKFIND_FLAG_CASE_SENSITIVE) {
-        if (look_for_length == 1) {
-            return simd_memchr_count_zeroes(buffer, buffer_length, *look_for, null_count);
-        } else {
-            return simd_memmem_count_zeroes(buffer, buffer_length, look_for, look_for_length, null_count);
+static void query_cache_insert(query_cache *cache, quickfind_params *params, u64 generation, query_result *result, u8 *body, u32 body_size) {
+    usize entry_size = params->text_length + body_size;
+    if (body_size > QUERY_CACHE_MAX_ENTRY_SIZE || entry_size > QUERY_CACHE_MAX_SIZE) {
+        return;
+    }
+
+    // NOTE(rune): Evict until there is a free entry and the new entry fits within QUERY_CACHE_MAX_SIZE.
+    query_cache_entry *free_entry = null;
+    while (1) {
+        query_cache_entry *oldest = null;
+        free_entry = null;
+
+        for (u32 i = 0; i < countof(cache->entries); i++) {
+            query_cache_entry *entry = &cache->entries[i];
+            if (!entry->last_used) {
+                free_entry = entry;
+            } else if (!oldest || entry->last_used < oldest->last_used) {
+                oldest = entry;
+            }
         }
-    } else {
-        if (look_for_length == 1) {
-            return simd_memchr_count_zeroes_nocase(buffer, buffer_length, *look_for, null_count);
-        } else {
-            return simd_memmem_count_zeroes_nocase(buffer, buffer_length, look_for, look_for_length, null_count);
+
+        if (free_entry && cache->size + entry_size <= QUERY_CACHE_MAX_SIZE) {
+            break;
         }
+
+        query_cache_entry_reset(cache, oldest);
+    }
+
+    void *data = heap_alloc(max(entry_size, 1), false);
+    if (!data) {
+        return;
     }
+
+    memcpy(data, params->text, params->text_length);
+    memcpy((u8 *)data + params->text_length, body, body_size);
+
+    free_entry->last_used           = ++cache->clock;
+    free_entry->generation          = generation;
+    free_entry->text                = data;
+    free_entry->text_length         = params->text_length;
+    free_entry->flags               = params->flags;
+    free_entry->sort                = params->sort;
+    free_entry->return_count        = params->return_count;
+    free_entry->skip_count          = params->skip_count;
+    free_entry->stop_count          = params->stop_count;
+    free_entry->found_count         = result->found_count;
+    free_entry->result_return_count = (u32)result->return_count;
+    free_entry->next_found_count    = result->next_found_count;
+    free_entry->next_record_index   = result->next_record_index;
+    free_entry->body                = (u8 *)data + params->text_length;
+    free_entry->body_size           = body_size;
+    free_entry->data                = data;
+
+    cache->size += entry_size;
 }
 
-// NOTE(rune): query_result_item_t's are pushed to result_buffer.
-static query_result run_query(quickfind_params params, buffer *result_buffer, db *database) {
-    usize search_buffer_size       = database->name_buffer.count;
-    char *search_buffer_base       = database->name_buffer.elems;
-    char *current_search           = search_buffer_base;
+////////////////////////////////////////////////////////////////
+// rune: Synthetic database
+
+static u32 synthetic_random(u32 *state) {
+    // NOTE(rune): xorshift32
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
 
-    u64 found_count             = 0;
-    u32 return_count            = 0;
-    usize current_record_index  = 0;
+static u32 synthetic_append(wchar *dst, u32 dst_len, u32 dst_cap, wchar *src) {
+    while (*src && dst_len < dst_cap) {
+        dst[dst_len++] = *src++;
+    }
+    return dst_len;
+}
 
-    while (found_count < params.stop_count) {
-        usize null_count = 0;
-        char *match = find_first_occurrence_and_count_nulls(current_search,
-                                                            (search_buffer_base + search_buffer_size) - current_search,
-                                                            params.text,
-                                                            params.text_length,
-                                                            params.flags,
-                                                            &null_count);
-
-        if (match == null) {
-            break;
-        }
+static void db_fill_synthetic(db *db, u32 record_count, u32 seed) {
+    static wchar *words[] = {
+        L"report", L"invoice", L"backup", L"config", L"setup", L"readme", L"photo", L"image",
+        L"data", L"index", L"main", L"test", L"node", L"module", L"src", L"lib", L"build",
+        L"release", L"debug", L"project", L"quick", L"find", L"server", L"client", L"document",
+        L"music", L"video", L"archive", L"temp", L"cache", L"notes", L"draft", L"final",
+        L"\u00c6bler", L"K\u00f8benhavn", L"\u00e5rsregnskab", L"Stra\u00dfe", L"\u041c\u043e\u0441\u043a\u0432\u0430",
+    };
+
+    static wchar *extensions[] = {
+        L".txt", L".pdf", L".c", L".h", L".dll", L".exe", L".jpg", L".png", L".xlsx",
+        L".docx", L".js", L".json", L".md", L".zip", L".dwg", L".PDF", L".JPG",
+    };
+
+    u32 state = seed ? seed : 1;
+
+    array(record_id) directories = { 0 };
+    array_create(&directories, 1024, false);
+
+    // NOTE(rune): Mimic the master file table, where record 0 is $MFT and record 5 is the root directory.
+    record_id mft_id  = { 0, 1 };
+    record_id root_id = { 5, 5 };
+    db_insert(db, mft_id, root_id, 0, L"$MFT", 4, 0, 0);
+    db_insert(db, root_id, root_id, FILE_ATTRIBUTE_DIRECTORY, L".", 1, 0, 0);
+    *(record_id *)array_push(&directories, false) = root_id;
+
+    for (u32 i = 0; i < record_count; i++) {
+        bool is_directory = (synthetic_random(&state) % 10) == 0;
+
+        record_id id        = { 16 + i, 1 };
+        record_id parent_id = directories.elems[synthetic_random(&state) % directories.count];
+
+        wchar wname[256];
+        u32   wname_len = 0;
+
+        u32 word_count = 1 + synthetic_random(&state) % 3;
+        for (u32 j = 0; j < word_count; j++) {
+            if (j > 0) {
+                wname_len = synthetic_append(wname, wname_len, countof(wname), (synthetic_random(&state) % 2) ? L"_" : L" ");
+            }
 
-        if (match > database->name_buffer.elems + database->name_buffer.count) {
-            break;
+            u32 word_start = wname_len;
+            wname_len = synthetic_append(wname, wname_len, countof(wname), words[synthetic_random(&state) % countof(words)]);
+            if ((synthetic_random(&state) % 4) == 0 && wname[word_start] >= L'a' && wname[word_start] <= L'z') {
+                wname[word_start] -= L'a' - L'A';
+            }
         }
 
-        current_search = simd_memchr(match, (search_buffer_base + search_buffer_size) - match, '\0');
-        if (current_search == null) {
-            assert(false);
-            break;
+        if (synthetic_random(&state) % 2) {
+            wchar number[16];
+            swprintf(number, countof(number), L"%u", synthetic_random(&state) % 2030);
+            wname_len = synthetic_append(wname, wname_len, countof(wname), number);
         }
 
-        // NOTE(rune): Names in the name buffer are always stored in the exact same order
-        // as records in the record array, so we can just use the number of names searched
-        // as an index into the record array.
-        current_record_index += null_count;
-        if (current_record_index >= database->record_array.count) {
-            assert(false);
-            break;
+        if (!is_directory) {
+            wname_len = synthetic_append(wname, wname_len, countof(wname), extensions[synthetic_random(&state) % countof(extensions)]);
         }
 
-        record *found     = &database->record_array.elems[current_record_index];
-        char *name        = db_get_record_name(database, found);
-        usize name_length = current_search - name;
-
-        char path_buffer[256 * 256];
-        record *ancestor_buffer[256];
-
-        if (found && !(found->attributes & FILE_ATTRIBUTE_NOT_IN_USE)) {
-            if (matches_query_flags(found, params.flags, params.text, params.text_length, name, name_length)) {
-                if (walk_ancestors_is_child_of_root(found, database, 256)) {
-                    if ((found_count >= params.skip_count) && (return_count < params.return_count)) {
-                        if (walk_ancestors_build_path(found, database, ancestor_buffer, countof(ancestor_buffer), path_buffer, sizeof(path_buffer))) {
-                            u32 path_size             = (u32)(strnlen(path_buffer, sizeof(path_buffer)) + 1);
-                            u32 result_size           = sizeof(query_result_item) + path_size;
-                            query_result_item *result = buffer_append(result_buffer, result_size);
-                            if (!result) {
-                                query_result result = { QUICKFIND_ERROR_OUT_OF_MEMORY };
-                                return result;
-                            }
-
-                            result->id          = found->id.id64;
-                            result->attributes  = found->attributes;
-                            result->path_size   = path_size;
-                            memcpy(&result->path, path_buffer, path_size);
-
-                            return_count++;
-                        }
-                    }
+        // NOTE(rune): Sizes are spread over several orders of magnitude, and times over a few years from 2020.
+        u64 size              = is_directory ? 0 : (u64)synthetic_random(&state) >> (synthetic_random(&state) % 32);
+        u64 modification_time = 132223104000000000ull + (u64)synthetic_random(&state) * 250000ull;
 
-                    found_count++;
-                }
-            }
+        db_insert(db, id, parent_id, is_directory ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL, wname, wname_len, size, modification_time);
+
+        if (is_directory) {
+            *(record_id *)array_push(&directories, false) = id;
         }
     }
 
-    query_result result = { QUICKFIND_OK, found_count, return_count };
-    return result;
+    array_destroy(&directories);
 }
 
 ////////////////////////////////////////////////////////////////
@@ -1134,17 +7795,23 @@ static DWORD WINAPI server_worker_thread_proc(LPVOID lpParameter) {
                 while (ntfs_mft_iter_advance(&iterator, &parsed_record)) {
                     if (parsed_record.parse_error == NTFS_ERROR_NONE) {
                         db_insert(&server->database, parsed_record.id, parsed_record.parent_id,
-                                  parsed_record.attributes, parsed_record.name, parsed_record.name_len);
+                                  parsed_record.attributes, parsed_record.name, parsed_record.name_len,
+                                  parsed_record.size, parsed_record.modification_time);
                     }
                 }
 
                 ntfs_mft_iter_close(&iterator);
+                dir_tree_build(&server->database);
 
                 server->database_initialized = true;
             }
         }
     }
 
+    if (server->database_initialized && server->use_trigram_index) {
+        trigram_index_build(&server->database);
+    }
+
     server_release_write_lock(server);
 
     u32 i = 0;
@@ -1165,6 +7832,7 @@ static DWORD WINAPI server_worker_thread_proc(LPVOID lpParameter) {
 
             debug_sanity_check_names(&server->database);
             debug_sanity_check_lookup(&server->database);
+            debug_sanity_check_checkpoints(&server->database);
 #endif
 
             // Write database to disk every minute
@@ -1177,6 +7845,7 @@ static DWORD WINAPI server_worker_thread_proc(LPVOID lpParameter) {
 #if 1
             debug_sanity_check_names(&server->database);
             debug_sanity_check_lookup(&server->database);
+            debug_sanity_check_checkpoints(&server->database);
 #endif
         }
 
@@ -1313,23 +7982,56 @@ static void server_calculate_response(server *server) {
                 quickfind_params params = { 0 };
                 params.text         = req->body;
                 params.text_length  = req->head.body_size;
-                params.flags        = req->head.query_request.flags;
+                params.flags        = req->head.query_request.flags & ~QUERY_FLAG_INTERNAL;
+                params.sort         = req->head.query_request.sort;
                 params.return_count = req->head.query_request.return_count;
                 params.skip_count   = req->head.query_request.skip_count;
                 params.stop_count   = req->head.query_request.stop_count;
+                params.cursor       = req->head.query_request.cursor;
+
+                // NOTE(rune): Sessions are per client process, so refinement still works across connections.
+                DWORD client_id = 0;
+                if (!GetNamedPipeClientProcessId(server->pipe, &client_id)) {
+                    client_id = 0;
+                }
+
+                query_session *session = query_session_find(server->sessions, countof(server->sessions), client_id, ++server->session_clock);
+
+                server->query_count++;
 
                 server_acquire_read_lock(server);
                 buffer result_buffer = {
                     .data = res->body,
                     .capacity = sizeof(res->body),
                 };
-                query_result query_result = run_query(params, &result_buffer, &server->database);
+
+                query_result query_result = { 0 };
+                u64 generation            = server->database.generation;
+
+                query_cache_entry *cached = query_cache_find(&server->query_cache, &params, generation);
+                if (cached) {
+                    memcpy(result_buffer.data, cached->body, cached->body_size);
+                    result_buffer.size        = cached->body_size;
+                    query_result.found_count  = cached->found_count;
+                    query_result.return_count = cached->result_return_count;
+                    query_result.next_found_count  = cached->next_found_count;
+                    query_result.next_record_index = cached->next_record_index;
+                } else {
+                    dir_tree_prepare_intervals(&server->database);
+                    query_result = run_query_session(params, &result_buffer, &server->database, &server->query_pool, session);
+                    if (!query_result.error) {
+                        query_cache_insert(&server->query_cache, &params, generation, &query_result, result_buffer.data, (u32)result_buffer.size);
+                    }
+                }
+
+                quickfind_cursor next_cursor = query_cursor_next(&params, &query_result, &server->database);
                 server_release_read_lock(server);
 
                 if (!query_result.error) {
                     res->head.type                        = MSG_TYPE_QUERY_RESPONSE;
                     res->head.query_response.found_count  = query_result.found_count;
                     res->head.query_response.return_count = query_result.return_count;
+                    res->head.query_response.next_cursor  = next_cursor;
                     res->head.body_size                   = (u32)result_buffer.size;
                 } else {
                     res->head.error = query_result.error;
@@ -1339,6 +8041,20 @@ static void server_calculate_response(server *server) {
             }
         } break;
 
+        case MSG_TYPE_STATS_REQUEST: {
+            res->head.type = MSG_TYPE_STATS_RESPONSE;
+            res->head.stats_response.query_count            = server->query_count;
+            res->head.stats_response.query_cache_hit_count  = server->query_cache.hit_count;
+            res->head.stats_response.query_cache_miss_count = server->query_cache.miss_count;
+            res->head.stats_response.query_cache_size       = server->query_cache.size;
+
+            for (u32 i = 0; i < countof(server->query_cache.entries); i++) {
+                if (server->query_cache.entries[i].last_used) {
+                    res->head.stats_response.query_cache_entry_count++;
+                }
+            }
+        } break;
+
         default: {
             res->head.body_size = QUICKFIND_ERROR_INVALID_REQUEST;
         } break;
@@ -1354,12 +8070,27 @@ static bool server_create(server *server) {
     server->connection_event = server_create_event(false);
     server->shutdown_event   = server_create_event(true);
     server->pipe             = server_create_pipe();
+
+    // NOTE(rune): Costs roughly two bytes per distinct trigram in each name,
+    // but queries for selective needles only need to verify a few candidates.
+    server->use_trigram_index = true;
+
     server->worker_thread    = server_create_thread(server_worker_thread_proc, server);
 
+    query_pool_create(&server->query_pool, query_pool_default_thread_count());
+
     return true;
 }
 
 static void server_destroy(server *server) {
+    query_pool_destroy(&server->query_pool);
+
+    for (u32 i = 0; i < countof(server->sessions); i++) {
+        query_session_reset(&server->sessions[i]);
+    }
+
+    query_cache_destroy(&server->query_cache);
+
     CloseHandle(server->worker_thread);
     CloseHandle(server->pipe);
     CloseHandle(server->connection_event);
@@ -89,8 +89,74 @@ static void buffer_reset(buffer *b);
 
 static char *simd_memmem_count_zeroes(char *s, usize n, char *needle, usize k, usize *zero_count);
 static char *simd_memmem_count_zeroes_nocase(char *s, usize n, char *needle, usize k, usize *zero_count);
+
+// NOTE(rune): Like simd_memmem_count_zeroes, but the candidates are found by comparing the bytes at
+// needle offsets anchor_a < anchor_b, instead of the first and last byte. The query planner picks the
+// rarest bytes of the needle as anchors, which gives fewer false candidates to verify.
+static char *simd_memmem_anchored_count_zeroes(char *s, usize n, char *needle, usize k, usize anchor_a, usize anchor_b, usize *zero_count);
+
 static char *simd_memchr_count_zeroes(char *s, usize n, char c, usize *zero_count);
 static char *simd_memchr_count_zeroes_nocase(char *s, usize n, char c, usize *zero_count);
+static usize simd_count_zeroes(char *s, usize n);
+
+// NOTE(rune): Teddy multi-pattern prefilter, as used by Hyperscan and ripgrep. Each pattern is assigned
+// to one of TEDDY_BUCKET_COUNT buckets. For each of the first fingerprint_size bytes of the patterns,
+// the lo/hi tables map the low/high nibble of a byte to the set of buckets, which have a pattern with
+// that nibble at that position. One shuffle per table gives the candidate buckets for a whole block.
+#define TEDDY_BUCKET_COUNT          8
+#define TEDDY_MAX_PATTERNS          16
+#define TEDDY_MAX_FINGERPRINT_SIZE  3
+
+typedef struct teddy teddy;
+struct teddy {
+    u8    lo[TEDDY_MAX_FINGERPRINT_SIZE][16];
+    u8    hi[TEDDY_MAX_FINGERPRINT_SIZE][16];
+    u32   fingerprint_size;
+
+    char *patterns[TEDDY_MAX_PATTERNS];         // NOTE(rune): Pattern i is in bucket i % TEDDY_BUCKET_COUNT.
+    usize pattern_lengths[TEDDY_MAX_PATTERNS];
+    u32   pattern_count;
+};
+
+static void teddy_compile(teddy *t, char **patterns, usize *pattern_lengths, u32 pattern_count);
+
+// NOTE(rune): Returns the first position where any of the patterns matches.
+static char *simd_teddy_count_zeroes(char *s, usize n, teddy *t, usize *zero_count);
+
+// NOTE(rune): The kernels above dispatch to the widest instruction set supported by the CPU,
+// which is detected with cpuid once by simd_init. Every kernel may read up to 64 + k - 1 bytes
+// past n, so the searched buffer must have at least that much padding after it.
+typedef enum simd_level simd_level;
+enum simd_level {
+    SIMD_LEVEL_SCALAR,
+    SIMD_LEVEL_SSE2,
+    SIMD_LEVEL_AVX2,
+    SIMD_LEVEL_AVX512,
+
+    SIMD_LEVEL_COUNT
+};
+
+typedef struct simd_kernels simd_kernels;
+struct simd_kernels {
+    char *name;
+    char *(*memmem_count_zeroes)(char *s, usize n, char *needle, usize k, usize *zero_count);
+    char *(*memmem_count_zeroes_nocase)(char *s, usize n, char *needle, usize k, usize *zero_count);
+    char *(*memmem_anchored_count_zeroes)(char *s, usize n, char *needle, usize k, usize anchor_a, usize anchor_b, usize *zero_count);
+    char *(*memchr_count_zeroes)(char *s, usize n, char c, usize *zero_count);
+    char *(*memchr_count_zeroes_nocase)(char *s, usize n, char c, usize *zero_count);
+    char *(*memchr)(char *s, usize n, char c);
+    usize (*count_zeroes)(char *s, usize n);
+    usize (*decode_deltas)(u16 *deltas, usize delta_count, u32 base, u32 *out);
+    char *(*teddy_count_zeroes)(char *s, usize n, teddy *t, usize *zero_count);
+};
+
+static simd_level simd_detect_level(void);
+static void       simd_init(void);
+static bool       simd_set_level(simd_level level); // NOTE(rune): Fails if the CPU does not support level.
+
+// NOTE(rune): Decodes delta encoded record indices, starting from base, and returns the
+// number of record indices written to out. See TRIGRAM_DELTA_ESCAPE.
+static usize simd_decode_deltas(u16 *deltas, usize delta_count, u32 base, u32 *out);
 
 ////////////////////////////////////////////////////////////////
 // rune: File IO
@@ -131,6 +197,33 @@ static void file_write_array(file *file, array array);
 
 #define FILE_ATTRIBUTE_NOT_IN_USE (1 << 31)
 
+#define DB_FILE_MAGIC               0x42444651  // "QFDB" in ascii
+#define DB_FILE_VERSION             4
+
+// NOTE(rune): Granularity of the checkpoint table. A byte offset in the name buffer can be
+// mapped to a record index, by counting null chars from the nearest checkpoint before it.
+#define DB_CHECKPOINT_BLOCK_SIZE    KILOBYTES(4)
+
+// NOTE(rune): Every DB_CHECKPOINT_BLOCK_SIZE bytes of the folded name buffer have a hashed set of the
+// bigrams that start in the block. A match can only start in a block, if all bigrams of the needle are
+// in the block or the one after it, since no needle is longer than a block. Substring scans skip the
+// blocks which fail that test without reading them. A 64 bit set would be full after a few hundred
+// distinct bigrams, which any block of names has, so each set has DB_BIGRAM_FILTER_BITS bits, which
+// is about 3% of the size of the names.
+#define DB_BIGRAM_FILTER_BITS       1024
+
+typedef struct bigram_filter bigram_filter;
+struct bigram_filter {
+    u64 words[DB_BIGRAM_FILTER_BITS / 64];
+};
+
+// NOTE(rune): NTFS names are at most 255 UTF-16 code units, which is at most 765 bytes of UTF-8.
+#define DB_MAX_NAME_LENGTH          765
+
+// NOTE(rune): The SIMD kernels read whole blocks past the end of the searched range, so the name
+// buffer always has room for one more block plus the longest needle, that can match anything.
+#define DB_NAME_BUFFER_PADDING      (DB_MAX_NAME_LENGTH + 64)
+
 // NOTE(rune): Same file reference type as the NTFS Master File Table uses.
 typedef struct record_id record_id;
 struct record_id {
@@ -147,16 +240,23 @@ typedef struct record record;
 struct record {
     usize name_offset;
     u32 attributes;
+    u32 name_length; // NOTE(rune): In bytes of UTF-8, without the null terminator. Same in both name buffers.
 
     record_id id;
     record_id parent_id;
+
+    // NOTE(rune): Only used for sorting and returned with results. The journal does not carry
+    // sizes, so ntfs_usn_read_file_info reads them from the changed files instead.
+    u64 size;
+    u64 modification_time;
 };
 
 typedef enum change_type change_type;
 enum change_type {
     CHANGE_TYPE_INSERT,
     CHANGE_TYPE_UPDATE,
-    CHANGE_TYPE_DELETE
+    CHANGE_TYPE_DELETE,
+    CHANGE_TYPE_MODIFY  // NOTE(rune): Only the size or modification time changed, so the name is kept.
 };
 
 typedef struct change change;
@@ -170,8 +270,15 @@ struct change {
     wchar *wname;
     u32 wname_length;
     u32 attributes;
+    u64 timestamp;
     bool ignore;
 
+    // NOTE(rune): Read from the file after the journal, since the journal only has the time of the change.
+    // Not set if the file could not be opened, e.g. because it was deleted since.
+    bool has_file_info;
+    u64 size;
+    u64 modification_time;
+
     change *next;
     change *prev;
 };
@@ -183,14 +290,196 @@ struct change_list {
 };
 
 TYPEDEF_ARRAY(record);
+TYPEDEF_ARRAY(record_id);
+TYPEDEF_ARRAY(bigram_filter);
 TYPEDEF_ARRAY(u32);
 TYPEDEF_ARRAY(char);
 
+// NOTE(rune): Trigrams are taken from the folded_name_buffer and hashed into TRIGRAM_BUCKET_COUNT buckets,
+// so the same index serves both case sensitive and case insensitive queries. Hash collisions and
+// folding only add false candidates, since every candidate is verified against its name anyway.
+#define TRIGRAM_BUCKET_BITS         16
+#define TRIGRAM_BUCKET_COUNT        (1 << TRIGRAM_BUCKET_BITS)
+
+// NOTE(rune): Postings are stored as u16 deltas between ascending record indices. A delta which
+// does not fit is stored as TRIGRAM_DELTA_ESCAPE followed by the low and high halves of the delta.
+#define TRIGRAM_DELTA_ESCAPE        0xFFFF
+
+// NOTE(rune): Number of deltas in a trigram_block, chosen so that a block is 64 bytes.
+#define TRIGRAM_BLOCK_DELTAS        29
+
+// NOTE(rune): A trigram occurring in more than 1/TRIGRAM_MAX_POSTING_RATIO of all records is too
+// common to be worth decoding. If all trigrams of a query are that common, we do a linear scan instead.
+#define TRIGRAM_MAX_POSTING_RATIO   32
+
+// NOTE(rune): Deleted records stay in the postings until more than 1/TRIGRAM_MAX_STALE_RATIO
+// of all records are deleted, at which point the index is rebuilt.
+#define TRIGRAM_MAX_STALE_RATIO     8
+
+// NOTE(rune): Each posting is a linked list of blocks in a single pool, since one allocation
+// per posting would be far too many allocations. An escaped delta never straddles two blocks.
+typedef struct trigram_block trigram_block;
+struct trigram_block {
+    u32 next; // NOTE(rune): Index of next block in trigram_index.blocks, or 0 if this is the last block.
+    u16 count;
+    u16 deltas[TRIGRAM_BLOCK_DELTAS];
+};
+
+typedef struct trigram_posting trigram_posting;
+struct trigram_posting {
+    u32 first_block;
+    u32 last_block;
+    u32 record_count;
+    u32 last_record_index;
+};
+
+TYPEDEF_ARRAY(trigram_block);
+TYPEDEF_ARRAY(trigram_posting);
+
+typedef struct trigram_index trigram_index;
+struct trigram_index {
+    array(trigram_posting) postings; // NOTE(rune): One per bucket, or empty if the index is not built.
+    array(trigram_block)   blocks;   // NOTE(rune): Block 0 is never used, so 0 can mean no block.
+    u32 stale_count;
+};
+
+// NOTE(rune): File extensions are dictionary encoded, so each record has a u16 extension id.
+// Extensions are taken from the folded name, after the last '.'. Directories and names without
+// an extension get EXT_ID_NONE. When the dictionary is full, new extensions share EXT_ID_OVERFLOW,
+// and records with that id are checked against their name instead.
+#define EXT_ID_NONE                 0
+#define EXT_ID_OVERFLOW             1
+#define EXT_ID_FIRST                2
+#define EXT_MAX_IDS                 0x10000
+
+// NOTE(rune): Each extension has a postings bitmap over record indices, split into pages of
+// EXT_PAGE_RECORDS records, so that a page is 64 bytes. Only pages containing at least one
+// record with the extension are allocated, and like trigram postings, the pages of each
+// extension are a linked list in a single pool.
+#define EXT_PAGE_WORDS              7
+#define EXT_PAGE_RECORDS            (EXT_PAGE_WORDS * 64)
+
+// NOTE(rune): When a query also has terms to scan for, extensions occurring in more than
+// 1/EXT_MAX_POSTING_RATIO of all records are checked while scanning instead.
+#define EXT_MAX_POSTING_RATIO       16
+
+#define EXT_MIN_BUCKET_COUNT        512
+
+typedef struct ext_page ext_page;
+struct ext_page {
+    u32 next; // NOTE(rune): Index of next page in ext_index.pages, or 0 if this is the last page.
+    u32 first_record_index;
+    u64 words[EXT_PAGE_WORDS];
+};
+
+typedef struct ext_entry ext_entry;
+struct ext_entry {
+    u32 name_offset; // NOTE(rune): Offset of the folded extension in ext_index.names.
+    u32 name_length;
+    u32 record_count;
+    u32 first_page;
+    u32 last_page;
+};
+
+TYPEDEF_ARRAY(u16);
+TYPEDEF_ARRAY(ext_page);
+TYPEDEF_ARRAY(ext_entry);
+
+typedef struct ext_index ext_index;
+struct ext_index {
+    array(u16)       ids;     // NOTE(rune): Extension id of each record, stored in same order as record_array.
+    array(ext_entry) entries; // NOTE(rune): Indexed by extension id.
+    array(char)      names;
+    array(u16)       buckets; // NOTE(rune): Open addressing hash table of extension ids, where EXT_ID_NONE is an empty bucket.
+    array(ext_page)  pages;   // NOTE(rune): Page 0 is never used, so 0 can mean no page.
+};
+
+// NOTE(rune): Full name queries look up the folded name in a chained hash table instead of scanning.
+// Each bucket holds the highest record index + 1 with a folded name of that hash, and next links each
+// record to the previous record in the same bucket. Deleted records stay in their chains, and are
+// skipped by the lookup.
+#define NAME_INDEX_MIN_BUCKET_COUNT 1024
+
+typedef struct name_index name_index;
+struct name_index {
+    array(u32) buckets;
+    array(u32) next; // NOTE(rune): One per record, stored in same order as record_array.
+};
+
+// NOTE(rune): Directories are only a small part of all records, so directory only queries scan a
+// separate copy of the directory names, instead of the whole name buffer. The names are stored in
+// record order, with the same layout as name_buffer, and records maps the n'th name to its record
+// index. Deleted directories stay in the copy until more than 1/DIR_NAMES_MAX_STALE_RATIO of its
+// names are deleted, and are skipped by the lookup until then.
+#define DIR_NAMES_MAX_STALE_RATIO   8
+
+typedef struct dir_names dir_names;
+struct dir_names {
+    array(char) names;
+    array(char) folded_names;
+    array(u32)  records;
+    u32         stale_count;
+};
+
+// NOTE(rune): Directories are numbered in depth first order, so each directory gets an interval
+// [enter, exit], which contains the enter numbers of all its descendant directories. A record is
+// below directory X, if the enter number of the record, or of its parent for files, is in the
+// interval of X. Every interval ends with up to DIR_TREE_MAX_SPARE unused numbers, from which new
+// subdirectories get their interval without renumbering. Moved directories, or new directories
+// which do not fit, mark the tree as dirty, and it is rebuilt before the next query.
+//
+// The tree also caches the depth of every record, file or directory, which relevance ranking
+// uses to prefer shallow paths, and whether the record can be reached from the root, which every
+// query checks for each hit. Like the intervals, depths and reachability below a moved directory
+// are only correct again after the tree is renumbered. Until then, queries walk the ancestors.
+//
+// Sorting by path uses a second, dense numbering of the directories in depth first order, where
+// the children of each directory are visited in folded name order, so the path order of the
+// parent orders records like their paths. New and renamed directories change the order among
+// their siblings, so they mark the path order as stale, and it is renumbered by the next path sorted query.
+#define DIR_TREE_MAX_SPARE          65536
+#define DIR_TREE_MIN_BUCKET_COUNT   1024
+
+// NOTE(rune): Records more than this many levels below the root are never found, since
+// walk_ancestors_build_path could not build their path.
+#define WALK_ANCESTORS_MAX_DEPTH    256
+
+typedef struct dir_interval dir_interval;
+struct dir_interval {
+    u32  enter;     // NOTE(rune): 0 if the record is not a numbered directory.
+    u32  exit;
+    u32  next_free;
+    u32  path_order; // NOTE(rune): 0 if the record is not a numbered directory.
+    u16  depth;      // NOTE(rune): Number of ancestors between the record and the root, which has depth 0.
+    bool reachable;  // NOTE(rune): Same as walk_ancestors_is_child_of_root with WALK_ANCESTORS_MAX_DEPTH.
+};
+
+TYPEDEF_ARRAY(dir_interval);
+
+typedef struct dir_tree dir_tree;
+struct dir_tree {
+    array(dir_interval) intervals; // NOTE(rune): One per record, or empty if the tree is not built.
+
+    // NOTE(rune): Open addressing hash table of directory record indices + 1, keyed on parent
+    // record number and folded name, used to resolve paths. Entries are never removed, so deleted
+    // directories are skipped when probing.
+    array(u32) buckets;
+    u32 bucket_used_count;
+
+    u32 root_record_index;
+    bool dirty;
+    bool path_order_stale;
+};
+
 typedef struct db db;
 struct db {
     // rune: All file/directory names in null terminated utf8
     array(char) name_buffer;
 
+    // rune: Same names as name_buffer, but case folded with fold_utf16. Has the exact same
+    // byte layout as name_buffer, so name offsets and checkpoints apply to both buffers.
+    array(char) folded_name_buffer;
+
     // rune: Stored in same order as name_buffer
     array(record) record_array;
 
@@ -198,9 +487,47 @@ struct db {
     // in the record_array, with the most recent sequence_number for that record_number.
     array(u32) lookup_array;
 
+    // rune: Array of u32s. One checkpoint per DB_CHECKPOINT_BLOCK_SIZE bytes of name_buffer,
+    // holding the index of the record whose name contains the first byte of the block.
+    array(u32) checkpoint_array;
+
+    // rune: One bigram_filter per DB_CHECKPOINT_BLOCK_SIZE bytes of folded_name_buffer, kept in sync
+    // by db_insert. Not stored in the database file, but built with db_build_bigram_filters when it is loaded.
+    array(bigram_filter) bigram_filter_array;
+
+    // rune: Optional trigram posting lists over the name_buffer. Not stored in the database file,
+    // but built with trigram_index_build after the database is loaded.
+    trigram_index trigram_index;
+
+    // rune: Extension id column and postings, kept in sync by db_insert/db_update/db_delete.
+    // Not stored in the database file, but rebuilt with ext_index_build when the database is loaded.
+    ext_index ext_index;
+
+    // rune: Folded name hash table for full name queries, kept in sync by db_insert. Not stored in
+    // the database file, but rebuilt with name_index_build when the database is loaded.
+    name_index name_index;
+
+    // rune: Copy of the directory names for directory only queries, kept in sync by db_insert. Not
+    // stored in the database file, but rebuilt with dir_names_build when the database is loaded.
+    dir_names dir_names;
+
+    // rune: Directory intervals for subtree scoped queries. Not stored in the database file,
+    // but built with dir_tree_build after the database is loaded.
+    dir_tree dir_tree;
+
+    // rune: Number of times each byte occurs in name_buffer and folded_name_buffer, which the query
+    // planner uses to anchor substring searches on the rarest bytes of the needle. Kept in sync by
+    // db_insert. Not stored in the database file, but counted with db_count_bytes when it is loaded.
+    u64 byte_counts[256];
+    u64 folded_byte_counts[256];
+
     u64 latest_usn;
     u64 latest_journal_id;
     u32 records_not_in_use_count;
+
+    // rune: Incremented whenever a record is inserted, deleted or modified, e.g. by db_apply_changes, so
+    // anything derived from query results can tell that it is stale. Not stored in the database file.
+    u64 generation;
 };
 
 static void         db_create(db *db);
@@ -211,27 +538,378 @@ static bool         db_write_to_file(db *db, char *file_path);
 static record *     db_get_record_by_id(db *db, record_id id);
 static record *     db_get_record_parent(db *db, record *record);
 static char *       db_get_record_name(db *db, record *record);
-
-static record *     db_insert(db *db, record_id id, record_id parent_id, u32 attributes, wchar *wname, u32 wname_len);
-static record *     db_update(db *db, record_id id, record_id parent_id, u32 attributes, wchar *wname, u32 wname_len);
+static usize        db_get_record_index_by_offset(db *db, usize offset);
+static usize        db_find_record_index_by_name_offset(db *db, usize offset);
+
+static void         db_count_bytes(db *db);
+static bool         db_build_bigram_filters(db *db);
+static record *     db_insert(db *db, record_id id, record_id parent_id, u32 attributes, wchar *wname, u32 wname_len, u64 size, u64 modification_time);
+static record *     db_update(db *db, record_id id, record_id parent_id, u32 attributes, wchar *wname, u32 wname_len, u64 size, u64 modification_time);
+static void         db_modify(db *db, record_id id, u64 size, u64 modification_time);
 static void         db_delete(db *db, record_id id);
 static void         db_apply_changes(db *db, change_list changes);
 static uint32_t     db_prune(db *db);
 
+////////////////////////////////////////////////////////////////
+// rune: Case folding
+
+// NOTE(rune): Simple case folding, which never changes the UTF-8 length of a name.
+static void fold_utf16(wchar *wtext, u32 wtext_len);
+
+// NOTE(rune): Folds text exactly like names in folded_name_buffer are folded. folded must have room for
+// text_length bytes. Returns false if text is not valid UTF-8, in which case only ASCII is folded.
+static bool fold_utf8(char *text, usize text_length, char *folded);
+
+////////////////////////////////////////////////////////////////
+// rune: Trigram index
+
+static u32  trigram_hash(char a, char b, char c);
+static bool trigram_index_build(db *db);
+static void trigram_index_destroy(trigram_index *index);
+static bool trigram_index_add(trigram_index *index, u32 record_index, char *name, usize name_length);
+static void trigram_index_remove(db *db, record *record);
+static usize trigram_index_decode_posting(trigram_index *index, trigram_posting *posting, u32 *out);
+
+// NOTE(rune): Intersects the postings of the needle's trigrams, and returns the ascending record
+// indices of all records whose names may contain the needle. Returns false if the index is not
+// built, the needle is too short, or all its trigrams are too common to narrow down the search.
+// The candidates must be freed with heap_free.
+static bool trigram_index_find_candidates(db *db, char *needle, usize needle_length, u32 **candidates, usize *candidate_count);
+
+////////////////////////////////////////////////////////////////
+// rune: Extension index
+
+// NOTE(rune): Returns false if the name has no extension. name should be folded.
+static bool ext_from_name(char *name, usize name_length, char **ext, usize *ext_length);
+
+static bool ext_index_create(ext_index *index);
+static void ext_index_destroy(ext_index *index);
+static bool ext_index_build(db *db);
+
+// NOTE(rune): Must be called for every record in the record array, in order. name must be folded.
+static bool ext_index_add(ext_index *index, u32 record_index, u32 attributes, char *name, usize name_length);
+static void ext_index_remove(ext_index *index, u32 record_index);
+
+// NOTE(rune): ext must be folded. Returns EXT_ID_OVERFLOW for extensions which are not in the
+// dictionary, since only records with that id can have them.
+static u16 ext_index_find(ext_index *index, char *ext, usize ext_length);
+static usize ext_index_decode_posting(ext_index *index, ext_entry *entry, u32 *out);
+
+// NOTE(rune): Returns the ascending record indices of all records which have one of the extensions,
+// or may have it in case of EXT_ID_OVERFLOW. The extensions are folded first. Returns false if there are more than max_candidate_count.
+// The candidates must be freed with heap_free.
+static bool ext_index_find_candidates(db *db, char **exts, usize *ext_lengths, u32 ext_count, usize max_candidate_count, u32 **candidates, usize *candidate_count);
+
+////////////////////////////////////////////////////////////////
+// rune: Name index
+
+static bool name_index_create(name_index *index);
+static void name_index_destroy(name_index *index);
+static bool name_index_build(db *db);
+
+// NOTE(rune): Must be called for every record in the record array, in order.
+static bool name_index_add(db *db, u32 record_index);
+
+// NOTE(rune): Returns the ascending record indices of all records in use, whose folded name is
+// the folded text. Returns false if the index is not built. The candidates must be freed with heap_free.
+static bool name_index_find_candidates(db *db, char *text, usize text_length, u32 **candidates, usize *candidate_count);
+
+////////////////////////////////////////////////////////////////
+// rune: Directory names
+
+static bool dir_names_create(dir_names *names);
+static void dir_names_destroy(dir_names *names);
+static bool dir_names_build(db *db);
+
+// NOTE(rune): Called by db_insert for every record, but only directories are added. Returns false if the copy is not built.
+static bool dir_names_add(db *db, u32 record_index);
+static void dir_names_remove(db *db, record *record);
+
+// NOTE(rune): Returns the ascending record indices of all directories in use, whose name contains the
+// needle, or of all directories in use if needle_length is 0. Case insensitive queries scan the folded
+// names. Returns false if the copy is not built. The candidates must be freed with heap_free.
+static bool dir_names_find_candidates(db *db, char *needle, usize needle_length, quickfind_flags flags, u32 **candidates, usize *candidate_count);
+
+////////////////////////////////////////////////////////////////
+// rune: Directory tree
+
+static bool dir_tree_build(db *db);
+static void dir_tree_destroy(dir_tree *tree);
+
+// NOTE(rune): Called by db_insert after the record is added. replaced_record_index is the index of
+// the previous record with the same record number, or 0, so renamed directories keep their interval.
+static void dir_tree_add(db *db, record *record, u32 replaced_record_index);
+
+// NOTE(rune): Renumbers only the path order, which is cheaper than dir_tree_build.
+static bool dir_tree_number_paths(db *db);
+
+// NOTE(rune): Rebuilds the tree if it is dirty. Called by the server before a query, since
+// db_apply_changes leaves a dirty tree to be rebuilt later.
+static void dir_tree_prepare_intervals(db *db);
+
+// NOTE(rune): Renumbers the path order if it is stale. Called before path sorted queries.
+static void dir_tree_prepare_path_order(db *db);
+
+// NOTE(rune): True if the intervals can be used, otherwise we have to walk the ancestors instead.
+static bool dir_tree_is_valid(db *db);
+
+// NOTE(rune): Returns 0 if the path order cannot be used, or the parent is not a numbered directory.
+static u32  dir_tree_get_parent_path_order(db *db, record *record);
+
+// NOTE(rune): Resolves a path like C:\foo\bar or \foo\bar to a directory record index. Components
+// are separated by '\\' or '/', and compared case insensitively.
+static bool dir_tree_find_path(db *db, char *path, usize path_length, u32 *record_index);
+
+// NOTE(rune): True if the record is below the directory at dir_record_index, but not the directory itself.
+static bool dir_tree_is_below(db *db, record *record, u32 dir_record_index);
+
+// NOTE(rune): Returns 0 if the tree is not built.
+static u32  dir_tree_get_depth(db *db, u32 record_index);
+
+// NOTE(rune): True if parent_index is the parent of the record, and not the 0 returned for a missing parent.
+static bool dir_tree_has_parent(db *db, record *record, u32 parent_index);
+
 ////////////////////////////////////////////////////////////////
 // rune: Sanity checks
 
 static bool debug_sanity_check_names(db *db);
 static bool debug_sanity_check_lookup(db *db);
+static bool debug_sanity_check_checkpoints(db *db);
+static bool debug_sanity_check_ext_index(db *db);
+static bool debug_sanity_check_dir_tree(db *db);
+
+////////////////////////////////////////////////////////////////
+// rune: Glob matching
+
+// NOTE(rune): Matches the whole name against the pattern, where '*' matches any run of
+// characters and '?' matches a single utf8 character. Everything else matches bytewise.
+static bool glob_match(char *pattern, usize pattern_length, char *name, usize name_length);
+
+// NOTE(rune): Every name which matches the pattern contains each run of non-wildcard characters,
+// so we scan for the longest run with the SIMD kernels, and only match the pattern against hits.
+static void glob_longest_literal(char *pattern, usize pattern_length, char **literal, usize *literal_length);
+
+////////////////////////////////////////////////////////////////
+// rune: Regex
+
+// NOTE(rune): Supported syntax is literals, '.', classes like [a-z_] and [^0-9], the escapes
+// \d \w \s \D \W \S, '^', '$', groups, '|', and the quantifiers * + ? {m} {m,} {m,n}.
+// Everything works on utf8 bytes, where '.' and negated classes match a whole utf8 character.
+// Negated classes can only contain ascii characters.
+//
+// The pattern is parsed to an AST, from which we take the longest literal which must occur in
+// every match. The AST is then compiled to a Thompson NFA, which is matched with a lazily built
+// DFA. The literal is scanned for with the SIMD kernels, so only names containing the literal
+// are run through the DFA.
+
+#define REGEX_MAX_NODES             2048
+#define REGEX_MAX_INSTS             4096
+#define REGEX_MAX_SETS              256
+#define REGEX_MAX_REPEAT            256
+#define REGEX_REPEAT_INFINITE       0xffffffff
+
+#define REGEX_DFA_MAX_STATES        256
+#define REGEX_DFA_SET_POOL_SIZE     16384
+#define REGEX_DFA_BUCKET_COUNT      512
+#define REGEX_DFA_FULL              0xffffffff
+
+typedef enum regex_node_kind {
+    REGEX_NODE_EMPTY,
+    REGEX_NODE_RANGE,       // Matches one byte in [lo, hi].
+    REGEX_NODE_SET,         // Matches one byte in sets[set].
+    REGEX_NODE_BOL,
+    REGEX_NODE_EOL,
+    REGEX_NODE_CONCAT,
+    REGEX_NODE_ALT,
+    REGEX_NODE_REPEAT,
+} regex_node_kind;
+
+typedef struct regex_node regex_node;
+struct regex_node {
+    u8  kind;
+    u8  lo;
+    u8  hi;
+    u16 set;
+    u32 a;
+    u32 b;
+    u32 min;
+    u32 max;
+};
+
+typedef enum regex_op {
+    REGEX_OP_RANGE,
+    REGEX_OP_SET,
+    REGEX_OP_SPLIT,
+    REGEX_OP_JUMP,
+    REGEX_OP_BOL,
+    REGEX_OP_EOL,
+    REGEX_OP_MATCH,
+} regex_op;
+
+typedef struct regex_inst regex_inst;
+struct regex_inst {
+    u8  op;
+    u8  lo;
+    u8  hi;
+    u16 set;
+    u32 out;
+    u32 out1;
+};
+
+typedef struct regex_byte_set regex_byte_set;
+struct regex_byte_set {
+    u8 bits[32];
+};
+
+// NOTE(rune): A DFA state is a sorted set of NFA instructions, after following all epsilon
+// transitions. next[] holds the index + 1 of the next state for each byte, or 0 if it has
+// not been computed yet.
+#define REGEX_DFA_STATE_MATCHED         0x1     // A match has been found, so the rest of the name does not matter.
+#define REGEX_DFA_STATE_MATCHES_AT_END  0x2     // The name matches if it ends here.
+#define REGEX_DFA_STATE_DEAD            0x4     // The name can not match.
+
+typedef struct regex_dfa_state regex_dfa_state;
+struct regex_dfa_state {
+    u16 next[256];
+    u32 set_offset;
+    u32 set_count;
+    u32 hash;
+    u16 hash_next;
+    u8  flags;
+};
+
+typedef struct regex regex;
+
+// NOTE(rune): The DFA is built while matching, so each thread needs its own. When the cache
+// is full, all states are thrown away, and the DFA is rebuilt from the current state.
+typedef struct regex_dfa regex_dfa;
+struct regex_dfa {
+    regex           *regex;
+
+    regex_dfa_state  states[REGEX_DFA_MAX_STATES];
+    u32              state_count;
+    u32              start_state;  // Index + 1, or 0 if not computed yet.
+    u32              flush_count;
+    u16              buckets[REGEX_DFA_BUCKET_COUNT];
+
+    u32              set_pool[REGEX_DFA_SET_POOL_SIZE];
+    u32              set_pool_count;
+
+    // NOTE(rune): Scratch space for computing epsilon closures.
+    u32              marks[REGEX_MAX_INSTS];
+    u32              mark_generation;
+    u32              stack[REGEX_MAX_INSTS];
+    u32              closure[REGEX_MAX_INSTS];
+    u32              closure_count;
+};
+
+struct regex {
+    regex_inst       insts[REGEX_MAX_INSTS];
+    u32              inst_count;
+    regex_byte_set   sets[REGEX_MAX_SETS];
+    u32              set_count;
+
+    // NOTE(rune): Every name that matches contains the literal.
+    char             literal[DB_MAX_NAME_LENGTH];
+    usize            literal_length;
+
+    regex_dfa       *dfas;
+    u32              dfa_count;
+};
+
+typedef struct regex_parser regex_parser;
+struct regex_parser {
+    regex           *re;
+    char            *at;
+    char            *end;
+    quickfind_flags  flags;
+    bool             error;
+
+    regex_node       nodes[REGEX_MAX_NODES];
+    u32              node_count;
+};
+
+// NOTE(rune): Returns false if the pattern is invalid, or too large.
+static bool regex_compile(regex *re, char *pattern, usize pattern_length, quickfind_flags flags);
+static void regex_dfa_init(regex_dfa *dfa, regex *re);
+static bool regex_dfa_match(regex_dfa *dfa, char *name, usize name_length);
+
+// NOTE(rune): Allocates the compiled regex together with dfa_count DFAs. *re is null if params is
+// not a regex query. Must be freed with heap_free.
+static quickfind_error regex_create_for_query(quickfind_params *params, u32 dfa_count, regex **re);
+
+////////////////////////////////////////////////////////////////
+// rune: Fuzzy matching
+
+// NOTE(rune): Scoring is modelled after fzf. Each matched character scores FUZZY_SCORE_MATCH plus
+// a bonus if it starts a word, and runs of matched characters score FUZZY_BONUS_CONSECUTIVE per
+// character. Gaps between matched characters are penalized. The best scoring alignment is found
+// with a DP over the pattern characters and name bytes, so the cost is bounded by
+// FUZZY_MAX_PATTERN_LENGTH * DB_MAX_NAME_LENGTH.
+
+#define FUZZY_MAX_PATTERN_LENGTH    64
+
+#define FUZZY_SCORE_MATCH           16
+#define FUZZY_SCORE_GAP_START       3
+#define FUZZY_SCORE_GAP_EXTENSION   1
+#define FUZZY_SCORE_NONE            (-(1 << 29))
+
+#define FUZZY_BONUS_CONSECUTIVE     4
+#define FUZZY_BONUS_BOUNDARY        8
+#define FUZZY_BONUS_CAMEL_CASE      7
+#define FUZZY_BONUS_FIRST_CHAR_MUL  2
+
+// NOTE(rune): pattern and name are compared bytewise, and must both be folded for case insensitive
+// matching. Word boundaries are taken from original_name, which has the same layout as name.
+// Returns false if the pattern is not a subsequence of the name.
+static bool fuzzy_match(char *pattern, usize pattern_length, char *name, usize name_length, char *original_name, i32 *score);
+
+////////////////////////////////////////////////////////////////
+// rune: Approximate matching
+
+// NOTE(rune): Myers' bit-parallel edit distance algorithm, with one bit per pattern byte, so
+// patterns are limited to 64 bytes. Distances are counted in bytes, so a typo in a multi-byte
+// UTF-8 character may count as more than one edit.
+
+#define APPROX_MAX_PATTERN_LENGTH   64
+#define APPROX_MAX_DISTANCE         2
+
+typedef struct approx_pattern approx_pattern;
+struct approx_pattern {
+    u64 peq[256];
+    u64 last_bit;
+    u32 length;
+};
+
+static void approx_compile(approx_pattern *pattern, char *text, usize text_length);
+
+// NOTE(rune): Returns true if the name contains a substring within max_distance edits of the
+// pattern. If whole_name is true, the whole name must be within max_distance edits instead.
+static bool approx_match(approx_pattern *pattern, char *name, usize name_length, u32 max_distance, bool whole_name);
 
 ////////////////////////////////////////////////////////////////
 // rune: Query
 
+// NOTE(rune): Flags above those of quickfind_flags, which only the CLI benches set, to compare an
+// optimization against running without it. The server clears them from client requests.
+#define QUERY_FLAG_NO_SCAN_VARIANTS     0x10000000  // NOTE(rune): Always run the generic loop instead of a query_scan_* variant.
+#define QUERY_FLAG_NO_RARE_ANCHORS      0x20000000  // NOTE(rune): Anchor substring scans on the first and last byte of the text.
+#define QUERY_FLAG_NO_BIGRAM_FILTERS    0x40000000  // NOTE(rune): Scan every block, even those the bigram filters rule out.
+#define QUERY_FLAG_NO_TRIGRAMS          0x01000000  // NOTE(rune): Never take candidates from the trigram index.
+#define QUERY_FLAG_NO_NAME_INDEX        0x02000000  // NOTE(rune): Never take full name candidates from the name index.
+#define QUERY_FLAG_NO_DIR_NAMES         0x04000000  // NOTE(rune): Never scan the directory names instead of all names.
+#define QUERY_FLAG_INTERNAL             (QUERY_FLAG_NO_SCAN_VARIANTS | QUERY_FLAG_NO_RARE_ANCHORS | QUERY_FLAG_NO_BIGRAM_FILTERS | \
+                                         QUERY_FLAG_NO_TRIGRAMS | QUERY_FLAG_NO_NAME_INDEX | QUERY_FLAG_NO_DIR_NAMES)
+
 typedef struct query_result query_result;
 struct query_result {
     quickfind_error error;
     u64 found_count;
     u32 return_count;
+
+    // NOTE(rune): Where the next page begins, if return_count > 0. Only set for unranked queries.
+    u64 next_found_count;
+    u64 next_record_index;
 };
 
 // TODO(rune): Cleanup. This seems to be much more complicated than it needs to.
@@ -271,8 +949,494 @@ static char *find_first_occurrence_and_count_nulls(
     usize           *null_count
 );
 
-// NOTE(rune): query_result_item_t's are pushed to result_buffer.
-static query_result run_query(quickfind_params params, buffer *result_buffer, db *database);
+// NOTE(rune): Unless QUICKFIND_FLAG_FULLNAME, QUICKFIND_FLAG_GLOB, QUICKFIND_FLAG_REGEX,
+// QUICKFIND_FLAG_FUZZY or a typo flag is set, the query text is split into whitespace separated
+// terms, which must all occur in a name, in any order. Glob queries have a single term, which is the longest literal in the pattern.
+// Regex queries take their literal from the compiled regex instead.
+#define QUERY_MAX_TERMS TEDDY_MAX_PATTERNS
+
+typedef struct query_term query_term;
+struct query_term {
+    char *text;
+    usize length;
+};
+
+// NOTE(rune): Terms like ext:pdf or ext:jpg;png are not searched for in names, but restrict the
+// results to files with one of the extensions, which are returned in exts. Extensions are always
+// matched case insensitively, and are resolved through the extension index.
+#define QUERY_MAX_EXTS 8
+
+typedef struct query_ext query_ext;
+struct query_ext {
+    char *text; // NOTE(rune): Folded.
+    usize length;
+    u16 id;
+};
+
+// NOTE(rune): A term like in:C:\Users\rune or in:"C:\Program Files" restricts the results to
+// descendants of the directory, and is returned in scope. Its length is 0 if there is no in: term.
+//
+// Returns false if the text has more than QUERY_MAX_TERMS terms, QUERY_MAX_EXTS extensions or
+// more than one in: term, is a glob or regex pattern longer than DB_MAX_NAME_LENGTH, or a fuzzy or
+// typo tolerant pattern longer than FUZZY_MAX_PATTERN_LENGTH or APPROX_MAX_PATTERN_LENGTH. If the
+// text has no terms, extensions or scope, the whole text is returned as a single term.
+static bool query_split_terms(char *text, usize text_length, quickfind_flags flags, query_term *terms, u32 *term_count, query_term *exts, u32 *ext_count, query_term *scope);
+
+// NOTE(rune): Iterates over all records in the [at, end) range of the name buffer which
+// match the query text and query flags. at must point to the beginning of the name
+// of the record at record_index.
+typedef struct query_iter query_iter;
+typedef bool query_scan_func(query_iter *iter, record **found);
+
+struct query_iter {
+    db              *database;
+    char            *text;
+    usize            text_length;
+    quickfind_flags  flags;
+
+    // NOTE(rune): Case insensitive queries search the folded_name_buffer with the folded
+    // text, using the case sensitive kernels.
+    char            *names;
+    char             folded_text[DB_MAX_NAME_LENGTH];
+
+    // NOTE(rune): Queries with multiple terms scan for all terms at once with the teddy
+    // prefilter, and then check that the matched name contains all the other terms.
+    query_term       terms[QUERY_MAX_TERMS];
+    u32              term_count;
+    teddy            teddy;
+
+    // NOTE(rune): Found records must have one of the extensions, which is checked against the
+    // extension id column. The extension texts point into folded_exts.
+    query_ext        exts[QUERY_MAX_EXTS];
+    u32              ext_count;
+    char             folded_exts[DB_MAX_NAME_LENGTH];
+
+    // NOTE(rune): Found records must be below the scope directory, which is checked against the
+    // directory intervals.
+    bool             has_scope;
+    u32              scope_record_index;
+
+    // NOTE(rune): Glob queries scan for the longest literal in the pattern, and then match the
+    // whole pattern against the name. Patterns without any literal visit every name.
+    char            *glob;
+    usize            glob_length;
+
+    // NOTE(rune): Regex queries scan for the required literal of the regex in the same way, and
+    // then run the name through the DFA.
+    regex_dfa       *dfa;
+
+    // NOTE(rune): Fuzzy queries scan for the first byte of the pattern, and then score the name.
+    // rank holds the rank of the last found record, where higher ranks are better.
+    bool             fuzzy;
+    u64              rank;
+
+    // NOTE(rune): Typo tolerant queries split the text into typo_distance + 1 pieces, of which at
+    // least one must occur unchanged in a matching name. The teddy prefilter scans for all pieces
+    // at once, and the name is then checked with the approximate matcher.
+    u32              typo_distance;
+    bool             typo_whole_name;
+    approx_pattern   approx;
+
+    // NOTE(rune): Set if the query has no literal to scan for, so every name is verified.
+    bool             scan_all_names;
+
+    // NOTE(rune): Set if the query text is invalid, in which case nothing is found.
+    bool             invalid;
+
+    // NOTE(rune): Bigrams of text, which each block must have for a match to start in it, or
+    // has_bigrams is false if the scan cannot skip blocks. See DB_BIGRAM_FILTER_BITS.
+    bool             has_bigrams;
+    bigram_filter    bigrams;
+
+    // NOTE(rune): Offsets of the two rarest bytes of text, which the substring kernel compares
+    // first. Only set for case sensitive scans for texts of at least 2 bytes.
+    bool             anchored;
+    usize            anchor_a;
+    usize            anchor_b;
+
+    // NOTE(rune): Specialized scan loop for plain substring queries, picked by query_iter_init, or null.
+    query_scan_func *scan;
+
+    // NOTE(rune): Reachability of each record from the directory tree, or null if the tree is
+    // not valid, in which case the ancestors of each hit are walked instead.
+    dir_interval    *intervals;
+
+    char            *at;
+    char            *end;
+    usize            record_index;
+
+    // NOTE(rune): If candidates is not null, we only verify the candidate records,
+    // instead of scanning the [at, end) range of the name buffer.
+    u32             *candidates;
+    usize            candidate_count;
+    usize            candidate_index;
+};
+
+// NOTE(rune): dfa must be non-null for regex queries, and only used by one iterator at a time.
+static void query_iter_init_text(query_iter *iter, db *database, quickfind_params *params, regex_dfa *dfa);
+static void query_iter_init(query_iter *iter, db *database, quickfind_params *params, regex_dfa *dfa, usize begin_record_index, usize end_record_index);
+static void query_iter_init_candidates(query_iter *iter, db *database, quickfind_params *params, regex_dfa *dfa, u32 *candidates, usize candidate_count);
+static bool query_iter_advance(query_iter *iter, record **found);
+static bool query_iter_advance_candidates(query_iter *iter, record **found);
+static bool query_iter_advance_all_names(query_iter *iter, record **found);
+static bool query_iter_name_contains_terms(query_iter *iter, char *name, usize name_length);
+static bool query_iter_matches_exts(query_iter *iter, usize record_index);
+static bool query_iter_matches_scope(query_iter *iter, usize record_index);
+static bool query_iter_is_reachable(query_iter *iter, usize record_index);
+
+// NOTE(rune): Runs the glob or regex verifier, if any, on a name which passed the scan.
+static bool query_iter_verify_name(query_iter *iter, char *name, usize name_length);
+
+// NOTE(rune): Picks the offsets anchor_a < anchor_b of the two bytes of the needle which occur least
+// often in the names, according to byte_counts. needle_length must be at least 2.
+static void query_pick_anchors(u64 *byte_counts, char *needle, usize needle_length, usize *anchor_a, usize *anchor_b);
+
+static void bigram_filter_add(bigram_filter *filter, char a, char b);
+
+// NOTE(rune): Adds the bigrams of the needle, which a block must have to contain a match. Case sensitive
+// needles are matched against the raw names, so only their ASCII bigrams, which fold to ASCII, are added.
+static void bigram_filter_add_needle(bigram_filter *filter, char *needle, usize needle_length, bool case_sensitive);
+
+// NOTE(rune): True if a match of the needle with needle_filter can start in the block.
+static bool bigram_filter_may_match(db *db, usize block, bigram_filter *needle_filter);
+
+// NOTE(rune): Moves at forward past blocks in which no match can start, and returns the end of the run
+// of blocks after it, in which matches may start. Returns iter->end if the iterator skips no blocks.
+static char *query_iter_next_run(query_iter *iter, char **at, usize *record_index);
+
+// NOTE(rune): Most queries are a single substring, maybe with QUICKFIND_FLAG_FULLNAME and a file or
+// directory filter. For those, query_iter_advance runs one of the query_scan_* variants instead of
+// the generic loop. Each variant is compiled with its flags as constants, so the flag checks fold
+// away, and the record's attributes are checked straight after the kernel reports a hit, before the
+// name is touched. The variants are picked once per iterator from g_query_scan_variants.
+typedef enum query_scan_only {
+    QUERY_SCAN_ONLY_ANY,
+    QUERY_SCAN_ONLY_FILES,
+    QUERY_SCAN_ONLY_DIRECTORIES,
+
+    QUERY_SCAN_ONLY_COUNT,
+} query_scan_only;
+
+static query_scan_func *query_scan_select(query_iter *iter);
+
+// NOTE(rune): Hits are often in the same directory, so each query keeps the full paths of recently
+// seen parent directories in a small direct mapped cache, keyed by the parent's record index. The
+// path of a hit is then the cached parent path, a separator and the name. Directory paths longer
+// than PATH_CACHE_MAX_PATH_LENGTH are built from scratch every time.
+#define PATH_CACHE_SLOT_COUNT       64
+#define PATH_CACHE_MAX_PATH_LENGTH  500
+
+typedef struct path_cache_slot path_cache_slot;
+struct path_cache_slot {
+    u32  dir_record_index_plus_one; // NOTE(rune): 0 if the slot is unused.
+    u32  path_length;
+    char path[PATH_CACHE_MAX_PATH_LENGTH];
+};
+
+typedef struct path_cache path_cache;
+struct path_cache {
+    path_cache_slot slots[PATH_CACHE_SLOT_COUNT];
+};
+
+static void path_cache_init(path_cache *cache);
+
+// NOTE(rune): Returns false if the directory cannot be reached from the root, or its path is too long
+// for a child to fit in path_buffer. path points into the cache, or into path_buffer on a miss.
+static bool path_cache_get(path_cache *cache, db *database, record *dir, char *path_buffer, usize path_buffer_size, char **path, usize *path_length);
+
+// NOTE(rune): Pushes a query_result_item for the record to result_buffer. paths can be null.
+static quickfind_error query_push_result_item(record *found, db *database, buffer *result_buffer, path_cache *paths);
+
+////////////////////////////////////////////////////////////////
+// rune: Query top-k
+
+// NOTE(rune): Ranked queries keep the best skip_count + return_count hits in a bounded min-heap,
+// so we only build paths for the hits that are actually returned. Higher ranks are better, and
+// equal ranks are ordered by record index.
+//
+// Sorted queries use the same heap, with ranks from query_sort_rank. Ranks cannot hold a whole
+// name or path, so hits with equal ranks are compared with query_sort_compare before the record index.
+//
+// Path ranks are the path order of the parent directory from the dir tree, then the first bytes
+// of the folded name, so query_sort_compare only walks the ancestors if the path order is stale.
+//
+// Relevance ranks are built from the match class of each term, then the depth of the record and
+// then the length of its name. Fuzzy queries use the match score in place of the match classes.
+typedef enum query_match_class {
+    QUERY_MATCH_CLASS_INFIX,        // NOTE(rune): Also used if the term does not occur unchanged, as with typo tolerant queries.
+    QUERY_MATCH_CLASS_WORD_START,   // NOTE(rune): After a non-alphanumeric character, or a lowercase to uppercase change.
+    QUERY_MATCH_CLASS_PREFIX,
+    QUERY_MATCH_CLASS_FULLNAME,     // NOTE(rune): The whole name, or the whole name without its extension.
+} query_match_class;
+
+typedef struct query_ranked_hit query_ranked_hit;
+struct query_ranked_hit {
+    u64 rank;
+    u32 record_index;
+};
+
+typedef struct query_top_k query_top_k;
+struct query_top_k {
+    query_ranked_hit *hits;
+    u64               count;
+    u64               capacity;
+
+    db               *database;
+    quickfind_sort    sort;
+};
+
+static bool query_sort_is_valid(quickfind_sort sort);
+static u64  query_sort_rank(query_iter *iter, record *record, quickfind_sort sort);
+
+// NOTE(rune): Returns the best class over all occurrences of the term in the name.
+static query_match_class query_match_class_of_term(char *name, char *original_name, usize name_length, char *term, usize term_length);
+
+// NOTE(rune): Returns < 0 if a comes before b in sort order, > 0 if after, and 0 if neither.
+static i32  query_sort_compare(db *database, record *a, record *b, quickfind_sort sort);
+
+static void query_top_k_push(query_top_k *top_k, u64 rank, u32 record_index);
+
+// NOTE(rune): Sorts the hits best first. The top_k is no longer a heap afterwards.
+static void query_top_k_sort(query_top_k *top_k);
+
+////////////////////////////////////////////////////////////////
+// rune: Query worker pool
+
+// NOTE(rune): Parallel queries split the name buffer into chunks, which always begin and
+// end on a name boundary. Each chunk is searched independently by the worker pool, and the
+// hits are merged back in record order afterwards, so skip_count/return_count/stop_count
+// give exactly the same results as a single threaded query.
+
+#define QUERY_POOL_MAX_THREADS          64
+#define QUERY_CHUNKS_PER_THREAD         4
+#define QUERY_MIN_CHUNK_SIZE            KILOBYTES(256)
+#define QUERY_MAX_CHUNK_HITS_TOTAL      (16 * 1024 * 1024)
+#define QUERY_COLLECT_STEP              4096
+
+// NOTE(rune): Collects the matches of a job as a bitmap of record indices, for the query session.
+// The session does not keep more than QUERY_SESSION_MAX_MATCHES matches, so collection stops when
+// the job has found more than that. Each chunk adds to count every QUERY_COLLECT_STEP matches.
+typedef struct query_collect query_collect;
+struct query_collect {
+    volatile LONG *bitmap;
+    volatile LONG  count;
+    volatile LONG  overflow;
+};
+
+typedef struct query_chunk query_chunk;
+struct query_chunk {
+    usize begin_record_index;
+    usize end_record_index;
+
+    // NOTE(rune): Number of hits found in the chunk, capped at stop_count.
+    u64   found_count;
+
+    // NOTE(rune): Record indices of the first hits in the chunk. Only the first
+    // skip_count + return_count hits can end up in the returned page.
+    u32  *hits;
+    u64   hits_count;
+    u64   hits_capacity;
+
+    // NOTE(rune): Ranked queries keep the best hits of the chunk instead.
+    query_top_k top_k;
+
+    volatile LONG done;
+    bool          skipped;
+};
+
+typedef struct query_job query_job;
+struct query_job {
+    db               *database;
+    quickfind_params  params;
+
+    query_chunk      *chunks;
+    u32               chunk_count;
+    volatile LONG     next_chunk;
+
+    // NOTE(rune): Each thread working on the job takes one of the regex DFAs.
+    regex            *regex;
+    volatile LONG     next_dfa;
+
+    // NOTE(rune): Ranked jobs search all chunks to the end, since the best hits can be anywhere.
+    bool              ranked;
+
+    // NOTE(rune): If not null, the matches are also collected. Until collection overflows, all
+    // chunks are searched to the end. After that, unranked jobs give up, since the caller only
+    // wanted the matches if there were few enough to keep.
+    query_collect    *collect;
+};
+
+typedef struct query_pool query_pool;
+struct query_pool {
+    HANDLE        threads[QUERY_POOL_MAX_THREADS];
+    u32           thread_count;
+
+    HANDLE        work_semaphore;
+    HANDLE        done_event;
+    volatile LONG pending_count;
+
+    query_job    *job;
+    bool          shutdown;
+};
+
+static bool  query_pool_create(query_pool *pool, u32 thread_count);
+static void  query_pool_destroy(query_pool *pool);
+static u32   query_pool_default_thread_count(void);
+static void  query_pool_run(query_pool *pool, query_job *job);
+static void  query_job_work(query_job *job);
+static void  query_collect_add(query_collect *collect, LONG count);
+
+// NOTE(rune): Splits the name buffer into chunks of roughly equal size, which begin and end on a name boundary.
+static void  query_split_chunks(db *database, query_chunk *chunks, u32 chunk_count);
+static DWORD WINAPI query_pool_thread_proc(LPVOID lpParameter);
+
+// NOTE(rune): query_result_item_t's are pushed to result_buffer. If the trigram index can narrow
+// down the candidates, only those are verified. Otherwise, if pool is null, or the database is
+// too small to be worth splitting, the query runs on the calling thread.
+static query_result run_query(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool);
+static query_result run_query_serial(quickfind_params params, buffer *result_buffer, db *database, regex *re, usize begin_record_index);
+static query_result run_query_iter(quickfind_params params, buffer *result_buffer, db *database, query_iter *iter);
+static query_result run_query_parallel(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool, regex *re);
+
+// NOTE(rune): Fuzzy and sorted queries return hits ordered by rank. The best hits can be anywhere,
+// so all matches are visited, and found_count is capped at stop_count afterwards, like for unranked queries.
+//
+// If collect is not null, the matches are also collected, until there are too many for a session.
+static query_result run_query_ranked(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool, regex *re, query_collect *collect);
+
+// NOTE(rune): Same as run_query_ranked, but on a single iterator. If found_indices is not null, the record
+// index of each match is also written to it, which must have room for all candidates of the iterator, and
+// the number of matches, which is not capped at stop_count, is written to found_index_count.
+static query_result run_query_ranked_iter(quickfind_params params, buffer *result_buffer, db *database, query_iter *iter, u32 *found_indices, usize *found_index_count);
+
+// NOTE(rune): Sorts the top_k and pushes the hits after skip_count to result_buffer.
+static query_result run_query_top_k_results(quickfind_params params, buffer *result_buffer, db *database, query_top_k *top_k, u64 found_count);
+
+////////////////////////////////////////////////////////////////
+// rune: Query cursors
+
+// NOTE(rune): Scrolling far down an unranked result list would otherwise count all the hits before
+// skip_count on every page. Each response carries a cursor with the record index after the last
+// returned hit, and the number of hits up to and including it. A request with a cursor for the same
+// query and database generation scans from that record, and only skips the hits between the cursor
+// and skip_count. Anything else falls back to scanning from the start.
+static u64              query_cursor_hash(quickfind_params *params);
+static bool             query_cursor_can_resume(quickfind_params *params, db *database);
+static quickfind_cursor query_cursor_next(quickfind_params *params, query_result *result, db *database);
+
+////////////////////////////////////////////////////////////////
+// rune: Query sessions
+
+// NOTE(rune): While typing, each query usually extends the previous one, e.g. "rep" -> "repo". Every
+// name containing "repo" also contains "rep", so the matches of the previous query are the only
+// candidates for the next. Each client gets a session, which keeps the matches of its last query as
+// a sorted list of record indices, and a query which extends the text of the last query with the same
+// flags only verifies those. Extending a glob, regex, full name, ext: or in: query can match names
+// that did not match before, so those queries are never refined.
+//
+// Matches are only kept while the database generation is unchanged, and only if there are at most
+// QUERY_SESSION_MAX_MATCHES of them, since refining a broad query saves little over a scan.
+#define QUERY_MAX_SESSIONS              4
+#define QUERY_SESSION_MAX_TEXT_LENGTH   256
+#define QUERY_SESSION_MAX_MATCHES       (256 * 1024)
+
+typedef struct query_session query_session;
+struct query_session {
+    u32             client_id; // NOTE(rune): Process id of the client, or 0 if the session is unused.
+    u64             last_used;
+
+    bool            has_matches;
+    u64             generation;
+    char            text[QUERY_SESSION_MAX_TEXT_LENGTH];
+    u32             text_length;
+    quickfind_flags flags;
+    u32            *matches;
+    usize           match_count;
+};
+
+// NOTE(rune): Returns the session of the client, or replaces the least recently used session.
+static query_session *query_session_find(query_session *sessions, u32 session_count, u32 client_id, u64 now);
+static void           query_session_reset(query_session *session);
+static bool           query_session_is_refinable(quickfind_params *params);
+static bool           query_session_can_refine(query_session *session, db *database, quickfind_params *params);
+
+// NOTE(rune): Same results as run_query, but refinable queries are answered from the matches kept
+// by the session, which is then updated with the new matches. session can be null.
+static query_result run_query_session(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool, query_session *session);
+
+// NOTE(rune): Run a refinable query, and also return all of its matches in record order, among
+// the candidates or in the whole name buffer. matches must be freed with heap_free, and is null
+// if the result has an error, or if there are more than QUERY_SESSION_MAX_MATCHES matches, in
+// which case unranked queries stop at stop_count like any other.
+static query_result run_query_session_candidates(quickfind_params params, buffer *result_buffer, db *database, u32 *candidates, usize candidate_count, u32 **matches, usize *match_count);
+static query_result run_query_session_scan(quickfind_params params, buffer *result_buffer, db *database, query_pool *pool, u32 **matches, usize *match_count);
+
+// NOTE(rune): Pushes the page of an unranked query, given all of its matches in record order.
+static query_result run_query_matches(quickfind_params params, buffer *result_buffer, db *database, u32 *matches, usize match_count);
+
+////////////////////////////////////////////////////////////////
+// rune: Query cache
+
+// NOTE(rune): Dashboards and file pickers often repeat the exact same query every few seconds.
+// The cache keeps the response body of recent queries, keyed by everything in the request, and
+// tagged with the database generation at the time the query ran. A hit with the same generation is
+// copied straight into the response. Entries from older generations are dropped when looked up.
+#define QUERY_CACHE_MAX_ENTRIES         64
+#define QUERY_CACHE_MAX_SIZE            MEGABYTES(16)
+#define QUERY_CACHE_MAX_ENTRY_SIZE      MEGABYTES(1)
+
+typedef struct query_cache_entry query_cache_entry;
+struct query_cache_entry {
+    u64             last_used;  // NOTE(rune): 0 if the entry is unused.
+    u64             generation;
+
+    // NOTE(rune): Key. text points into data, followed by the response body.
+    char           *text;
+    u32             text_length;
+    quickfind_flags flags;
+    quickfind_sort  sort;
+    u32             return_count;
+    u64             skip_count;
+    u64             stop_count;
+
+    // NOTE(rune): Value.
+    u64             found_count;
+    u32             result_return_count;
+    u64             next_found_count;
+    u64             next_record_index;
+    u8             *body;
+    u32             body_size;
+
+    void           *data;
+};
+
+typedef struct query_cache query_cache;
+struct query_cache {
+    query_cache_entry entries[QUERY_CACHE_MAX_ENTRIES];
+    usize             size;
+    u64               clock;
+
+    u64               hit_count;
+    u64               miss_count;
+};
+
+static void               query_cache_destroy(query_cache *cache);
+static void               query_cache_entry_reset(query_cache *cache, query_cache_entry *entry);
+
+// NOTE(rune): Returns the entry for the query, or null if there is none for the current generation.
+// Counts a hit or a miss.
+static query_cache_entry *query_cache_find(query_cache *cache, quickfind_params *params, u64 generation);
+
+// NOTE(rune): Stores a copy of the text and the response body, evicting the least recently used
+// entries until it fits. Does nothing if the body is larger than QUERY_CACHE_MAX_ENTRY_SIZE.
+static void               query_cache_insert(query_cache *cache, quickfind_params *params, u64 generation, query_result *result, u8 *body, u32 body_size);
+
+////////////////////////////////////////////////////////////////
+// rune: Synthetic database
+
+// NOTE(rune): Fills an empty database with a deterministic, randomly generated directory tree.
+// Used for benchmarking queries without reading a real volume.
+static void db_fill_synthetic(db *db, u32 record_count, u32 seed);
 
 ////////////////////////////////////////////////////////////////
 // rune: Server
@@ -294,6 +1458,15 @@ struct server {
     HANDLE      shutdown_event;
     HANDLE      worker_thread;
 
+    query_pool  query_pool;
+    bool        use_trigram_index;
+
+    query_session sessions[QUERY_MAX_SESSIONS];
+    u64           session_clock;
+
+    query_cache   query_cache;
+    u64           query_count;
+
     msg request;
     msg response;
 
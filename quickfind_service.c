@@ -179,9 +179,203 @@ static void WINAPI svc_main(DWORD dwArgc, LPSTR *lpszArgv) {
 ////////////////////////////////////////////////////////////////
 // rune: CLI
 
+// NOTE(rune): Creates the synthetic database of the benches, with argv[2] records, or a million by default.
+static void cli_bench_setup(db *database, int argc, char **argv) {
+    u32 record_count = argc >= 3 ? atoi(argv[2]) : 1000000;
+
+    db_create(database);
+    db_fill_synthetic(database, record_count, 1234);
+
+    printf("Synthetic database: %llu records, %llu bytes of names\n",
+           (u64)database->record_array.count, (u64)database->name_buffer.count);
+}
+
+static void cli_bench_teardown(db *database) {
+    db_destroy(database);
+}
+
+// NOTE(rune): Runs a query directly against database, without going through the pipe,
+// and returns the average duration in milliseconds.
+static f64 cli_bench_run_query(quickfind_params *params, db *database, query_pool *pool, u32 iteration_count, query_result *last_result) {
+    buffer result_buffer = {
+        .data     = heap_alloc(MEGABYTES(1), false),
+        .capacity = MEGABYTES(1),
+    };
+
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER performance_count_start;
+    LARGE_INTEGER performance_count_end;
+
+    QueryPerformanceFrequency(&frequency);
+
+    f64 sum = 0;
+    query_result result = { 0 };
+
+    for (u32 i = 0; i < iteration_count; i++) {
+        buffer_reset(&result_buffer);
+
+        QueryPerformanceCounter(&performance_count_start);
+        result = run_query(*params, &result_buffer, database, pool);
+        QueryPerformanceCounter(&performance_count_end);
+
+        LONGLONG performance_diff = performance_count_end.QuadPart - performance_count_start.QuadPart;
+        sum += ((f64)performance_diff * 1000.0) / ((f64)frequency.QuadPart);
+    }
+
+    heap_free(result_buffer.data);
+
+    if (last_result) {
+        *last_result = result;
+    }
+
+    return sum / (f64)iteration_count;
+}
+
+// NOTE(rune): Turns off the optimization measured by cli_bench_compare if enable is false, either in
+// the database or in the params of the query, and turns it back on if enable is true.
+typedef void cli_bench_toggle(db *database, quickfind_params *params, bool enable);
+
+// NOTE(rune): Runs every text with every flags, once with the optimization and once without, and prints
+// both times and found counts. Returns false if the counts differ for any query.
+static bool cli_bench_compare(db *database, char *on_label, char *off_label, char **texts, u32 text_count,
+                              quickfind_flags *flags, u32 flags_count, u32 return_count, cli_bench_toggle *toggle) {
+    bool same = true;
+
+    for (u32 i = 0; i < text_count; i++) {
+        for (u32 j = 0; j < flags_count; j++) {
+            quickfind_params params = { 0 };
+            params.return_count = return_count;
+            params.stop_count   = UINT64_MAX;
+            params.text         = texts[i];
+            params.text_length  = (u32)strlen(texts[i]);
+            params.flags        = flags[j];
+
+            query_result on_result = { 0 };
+            f64 on_time = cli_bench_run_query(&params, database, null, 20, &on_result);
+
+            toggle(database, &params, false);
+            query_result off_result = { 0 };
+            f64 off_time = cli_bench_run_query(&params, database, null, 20, &off_result);
+            toggle(database, &params, true);
+
+            bool counts_differ = on_result.found_count != off_result.found_count;
+            if (counts_differ) {
+                same = false;
+            }
+
+            printf("%s: %f ms %s: %f ms (count = %llu/%llu) (\"%.80s\"%s%s%s%s%s)%s\n",
+                   on_label, on_time, off_label, off_time, on_result.found_count, off_result.found_count, texts[i],
+                   (flags[j] & QUICKFIND_FLAG_CASE_SENSITIVE)   ? " case sensitive" : "",
+                   (flags[j] & QUICKFIND_FLAG_FULLNAME)         ? " fullname"       : "",
+                   (flags[j] & QUICKFIND_FLAG_ONLY_FILES)       ? " files"          : "",
+                   (flags[j] & QUICKFIND_FLAG_ONLY_DIRECTORIES) ? " directories"    : "",
+                   return_count ? "" : " count only",
+                   counts_differ ? ANSI_FG_RED " COUNTS DIFFER" ANSI_RESET : "");
+        }
+    }
+
+    return same;
+}
+
+static void cli_toggle_trigram_index(db *database, quickfind_params *params, bool enable) {
+    params->flags = enable ? (params->flags & ~QUERY_FLAG_NO_TRIGRAMS) : (params->flags | QUERY_FLAG_NO_TRIGRAMS);
+}
+
+// NOTE(rune): A dirty tree is not valid, so queries fall back to walking the ancestors.
+static void cli_toggle_dir_tree(db *database, quickfind_params *params, bool enable) {
+    database->dir_tree.dirty = !enable;
+}
+
+// NOTE(rune): Without the name index, full name queries scan like substring queries.
+static void cli_toggle_name_index(db *database, quickfind_params *params, bool enable) {
+    params->flags = enable ? (params->flags & ~QUERY_FLAG_NO_NAME_INDEX) : (params->flags | QUERY_FLAG_NO_NAME_INDEX);
+}
+
+// NOTE(rune): Without the directory names, directory only queries scan the whole name buffer.
+static void cli_toggle_dir_names(db *database, quickfind_params *params, bool enable) {
+    params->flags = enable ? (params->flags & ~QUERY_FLAG_NO_DIR_NAMES) : (params->flags | QUERY_FLAG_NO_DIR_NAMES);
+}
+
+static void cli_toggle_scan_variants(db *database, quickfind_params *params, bool enable) {
+    params->flags = enable ? (params->flags & ~QUERY_FLAG_NO_SCAN_VARIANTS) : (params->flags | QUERY_FLAG_NO_SCAN_VARIANTS);
+}
+
+static void cli_toggle_rare_anchors(db *database, quickfind_params *params, bool enable) {
+    params->flags = enable ? (params->flags & ~QUERY_FLAG_NO_RARE_ANCHORS) : (params->flags | QUERY_FLAG_NO_RARE_ANCHORS);
+}
+
+static void cli_toggle_bigram_filters(db *database, quickfind_params *params, bool enable) {
+    params->flags = enable ? (params->flags & ~QUERY_FLAG_NO_BIGRAM_FILTERS) : (params->flags | QUERY_FLAG_NO_BIGRAM_FILTERS);
+}
+
+// NOTE(rune): Finds all occurrences of needle in s with the currently selected SIMD kernels, and returns
+// the throughput in GB/s. The checksum combines match offsets and null counts, so the results of
+// different kernels can be compared.
+static f64 cli_bench_scan_kernel(char *s, usize n, char *needle, usize k, quickfind_flags flags, u32 iteration_count, u64 *match_count, u64 *checksum) {
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER performance_count_start;
+    LARGE_INTEGER performance_count_end;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&performance_count_start);
+
+    for (u32 i = 0; i < iteration_count; i++) {
+        char *at  = s;
+        char *end = s + n;
+
+        *match_count = 0;
+        *checksum    = 0;
+
+        while (at < end) {
+            usize null_count = 0;
+            char *match = find_first_occurrence_and_count_nulls(at, end - at, needle, k, flags, &null_count);
+            if (match == null || match >= end) {
+                break;
+            }
+
+            *match_count += 1;
+            *checksum    += (match - s) * 31 + null_count;
+            at = match + 1;
+        }
+    }
+
+    QueryPerformanceCounter(&performance_count_end);
+
+    LONGLONG performance_diff = performance_count_end.QuadPart - performance_count_start.QuadPart;
+    f64 seconds = (f64)performance_diff / (f64)frequency.QuadPart;
+    return ((f64)n * (f64)iteration_count) / seconds / 1e9;
+}
+
+// NOTE(rune): Finds every match of the needle with the current SIMD level, like cli_bench_scan_kernel,
+// but with either kernel, for comparing the kernels against each other.
+static void cli_scan_checksum(char *s, usize n, char *needle, usize k, bool anchored, usize anchor_a, usize anchor_b, u64 *match_count, u64 *checksum) {
+    char *at  = s;
+    char *end = s + n;
+
+    *match_count = 0;
+    *checksum    = 0;
+
+    while (at < end) {
+        usize null_count = 0;
+        char *match      = anchored
+            ? simd_memmem_anchored_count_zeroes(at, end - at, needle, k, anchor_a, anchor_b, &null_count)
+            : simd_memmem_count_zeroes(at, end - at, needle, k, &null_count);
+
+        if (match == null || match >= end) {
+            break;
+        }
+
+        *match_count += 1;
+        *checksum    += (match - s) * 31 + null_count;
+        at = match + 1;
+    }
+}
+
 int cli_main(int argc, char **argv) {
     // TODO(rune): More user friendly CLI
 
+    simd_init();
+
     // rune: Run server rom command line
     if (argc == 2 && _strcmpi(argv[1], "server") == 0) {
         server *server = heap_alloc(sizeof(*server), false); // TODO(rune): Report error
@@ -206,6 +400,23 @@ int cli_main(int argc, char **argv) {
         return 0;
     }
 
+    // rune: Print server statistics
+    if (argc == 2 && _strcmpi(argv[1], "stats") == 0) {
+        quickfind_stats stats = { 0 };
+        quickfind_error error = quickfind_get_stats(&stats, 1000);
+        if (error) {
+            printf("Could not get statistics from server (error %i).\n", error);
+            return 1;
+        }
+
+        printf("Queries:                %llu\n", stats.query_count);
+        printf("Query cache hits:       %llu\n", stats.query_cache_hit_count);
+        printf("Query cache misses:     %llu\n", stats.query_cache_miss_count);
+        printf("Query cache entries:    %u\n",   stats.query_cache_entry_count);
+        printf("Query cache size:       %llu bytes\n", stats.query_cache_size);
+        return 0;
+    }
+
     // rune: Benchmarks
     if (argc == 2 && _strcmpi(argv[1], "bench") == 0) {
         char *strings[] = {
@@ -270,6 +481,937 @@ int cli_main(int argc, char **argv) {
         return 0;
     }
 
+    // rune: Benchmark parallel queries against a synthetic database
+    if (argc >= 2 && _strcmpi(argv[1], "bench-threads") == 0) {
+        u32 max_thread_count = argc >= 4 ? atoi(argv[3]) : query_pool_default_thread_count();
+
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        char *strings[] = {
+            "fK",
+            "report",
+            "Invoice_2023",
+            "abcdefghjiasdjkalsddhj",
+            "report 2023 pdf",
+        };
+
+        for (u32 thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+            query_pool pool;
+            query_pool_create(&pool, thread_count);
+
+            for (int i = 0; i < countof(strings); i++) {
+                quickfind_params params = { 0 };
+                params.return_count = 100;
+                params.stop_count   = UINT64_MAX;
+                params.skip_count   = 0;
+                params.text         = strings[i];
+                params.text_length  = (u32)strlen(strings[i]);
+
+                query_result result = { 0 };
+                f64 time = cli_bench_run_query(&params, &database, &pool, 20, &result);
+                printf("Threads: %2u Average: %f ms (count = %llu) (\"%s\")\n", pool.thread_count, time, result.found_count, strings[i]);
+            }
+
+            query_pool_destroy(&pool);
+        }
+
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark queries with and without the trigram index against a synthetic database
+    if (argc >= 2 && _strcmpi(argv[1], "bench-trigrams") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        trigram_index_build(&database);
+
+        printf("Trigram postings: %llu bytes\n",
+               (u64)(database.trigram_index.blocks.count * sizeof(trigram_block) +
+                     database.trigram_index.postings.count * sizeof(trigram_posting)));
+
+        char *strings[] = {
+            "fK",
+            "report",
+            "Invoice_2023",
+            "1999.pdf",
+            "abcdefghjiasdjkalsddhj",
+            "report 2023 pdf",
+        };
+
+        for (int i = 0; i < countof(strings); i++) {
+            u32 *candidates       = null;
+            usize candidate_count = 0;
+            bool uses_index       = trigram_index_find_candidates(&database, strings[i], strlen(strings[i]), &candidates, &candidate_count);
+            if (uses_index) {
+                heap_free(candidates);
+            }
+
+            printf("Candidates: %llu%s (\"%s\")\n", (u64)candidate_count, uses_index ? "" : ", too common", strings[i]);
+        }
+
+        quickfind_flags flags[] = { 0 };
+        bool same = cli_bench_compare(&database, "Index", "Scan", strings, countof(strings), flags, countof(flags), 100, cli_toggle_trigram_index);
+
+        cli_bench_teardown(&database);
+        return same ? 0 : 1;
+    }
+
+    // rune: Benchmark glob queries against a plain substring query for their longest literal
+    if (argc >= 2 && _strcmpi(argv[1], "bench-glob") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        char *patterns[] = {
+            "*.pdf",
+            "report_??.xlsx",
+            "*backup*2024*",
+            "Invoice*2023*",
+            "*",
+        };
+
+        for (int i = 0; i < countof(patterns); i++) {
+            quickfind_params params = { 0 };
+            params.return_count = 100;
+            params.stop_count   = UINT64_MAX;
+            params.skip_count   = 0;
+            params.text         = patterns[i];
+            params.text_length  = (u32)strlen(patterns[i]);
+            params.flags        = QUICKFIND_FLAG_GLOB;
+
+            query_result glob_result = { 0 };
+            f64 glob_time = cli_bench_run_query(&params, &database, null, 20, &glob_result);
+
+            char *literal        = null;
+            usize literal_length = 0;
+            glob_longest_literal(params.text, params.text_length, &literal, &literal_length);
+
+            params.text        = literal;
+            params.text_length = (u32)literal_length;
+            params.flags       = 0;
+
+            query_result literal_result = { 0 };
+            f64 literal_time = literal_length ? cli_bench_run_query(&params, &database, null, 20, &literal_result) : 0;
+
+            printf("Glob: %f ms Literal: %f ms (count = %llu, literal count = %llu) (\"%s\" -> \"%.*s\")\n",
+                   glob_time, literal_time, glob_result.found_count, literal_result.found_count,
+                   patterns[i], (int)literal_length, literal);
+        }
+
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark regex queries against a synthetic database
+    if (argc >= 2 && _strcmpi(argv[1], "bench-regex") == 0) {
+        u32 max_thread_count = argc >= 4 ? atoi(argv[3]) : query_pool_default_thread_count();
+
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        char *patterns[] = {
+            "report",
+            "^report.*\\.pdf$",
+            "(invoice|report)_\\d{4}",
+            "\\d{4}-\\d{2}",
+            "^[a-z]+$",
+        };
+
+        query_pool pool;
+        query_pool_create(&pool, max_thread_count);
+
+        for (int i = 0; i < countof(patterns); i++) {
+            quickfind_params params = { 0 };
+            params.return_count = 100;
+            params.stop_count   = UINT64_MAX;
+            params.skip_count   = 0;
+            params.text         = patterns[i];
+            params.text_length  = (u32)strlen(patterns[i]);
+            params.flags        = QUICKFIND_FLAG_REGEX;
+
+            regex *re = null;
+            if (regex_create_for_query(&params, 1, &re) != QUICKFIND_OK) {
+                printf("Invalid regex (\"%s\")\n", patterns[i]);
+                continue;
+            }
+
+            query_result serial_result   = { 0 };
+            query_result parallel_result = { 0 };
+            f64 serial_time   = cli_bench_run_query(&params, &database, null, 5, &serial_result);
+            f64 parallel_time = cli_bench_run_query(&params, &database, &pool, 5, &parallel_result);
+
+            printf("Serial: %f ms Threads: %2u %f ms (count = %llu) (\"%s\", literal \"%.*s\")\n",
+                   serial_time, pool.thread_count, parallel_time, parallel_result.found_count,
+                   patterns[i], (int)re->literal_length, re->literal);
+
+            heap_free(re);
+        }
+
+        query_pool_destroy(&pool);
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark fuzzy queries against a synthetic database
+    if (argc >= 2 && _strcmpi(argv[1], "bench-fuzzy") == 0) {
+        u32 max_thread_count = argc >= 4 ? atoi(argv[3]) : query_pool_default_thread_count();
+
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        char *patterns[] = {
+            "qfsrv",
+            "rpt",
+            "invpdf",
+            "kbnhvn",
+        };
+
+        query_pool pool;
+        query_pool_create(&pool, max_thread_count);
+
+        for (int i = 0; i < countof(patterns); i++) {
+            quickfind_params params = { 0 };
+            params.return_count = 100;
+            params.stop_count   = UINT64_MAX;
+            params.skip_count   = 0;
+            params.text         = patterns[i];
+            params.text_length  = (u32)strlen(patterns[i]);
+            params.flags        = QUICKFIND_FLAG_FUZZY;
+
+            query_result serial_result   = { 0 };
+            query_result parallel_result = { 0 };
+            f64 serial_time   = cli_bench_run_query(&params, &database, null, 5, &serial_result);
+            f64 parallel_time = cli_bench_run_query(&params, &database, &pool, 5, &parallel_result);
+
+            printf("Serial: %f ms Threads: %2u %f ms (count = %llu) (\"%s\")\n",
+                   serial_time, pool.thread_count, parallel_time, parallel_result.found_count, patterns[i]);
+        }
+
+        query_pool_destroy(&pool);
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark typo tolerant queries against exact queries on a synthetic database
+    if (argc >= 2 && _strcmpi(argv[1], "bench-typo") == 0) {
+        u32 max_thread_count = argc >= 4 ? atoi(argv[3]) : query_pool_default_thread_count();
+
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        char *patterns[] = {
+            "report",
+            "reprot",
+            "invoise",
+            "kobenhavn",
+        };
+
+        quickfind_flags flags[] = {
+            0,
+            QUICKFIND_FLAG_TYPOS_1,
+            QUICKFIND_FLAG_TYPOS_2,
+        };
+
+        query_pool pool;
+        query_pool_create(&pool, max_thread_count);
+
+        for (int i = 0; i < countof(patterns); i++) {
+            for (int j = 0; j < countof(flags); j++) {
+                quickfind_params params = { 0 };
+                params.return_count = 100;
+                params.stop_count   = UINT64_MAX;
+                params.skip_count   = 0;
+                params.text         = patterns[i];
+                params.text_length  = (u32)strlen(patterns[i]);
+                params.flags        = flags[j];
+
+                query_result serial_result   = { 0 };
+                query_result parallel_result = { 0 };
+                f64 serial_time   = cli_bench_run_query(&params, &database, null, 5, &serial_result);
+                f64 parallel_time = cli_bench_run_query(&params, &database, &pool, 5, &parallel_result);
+
+                printf("Serial: %f ms Threads: %2u %f ms (count = %llu) (\"%s\", %d typos)\n",
+                       serial_time, pool.thread_count, parallel_time, parallel_result.found_count, patterns[i], j);
+            }
+        }
+
+        query_pool_destroy(&pool);
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark ext: filters against scanning for the extension in names
+    if (argc >= 2 && _strcmpi(argv[1], "bench-ext") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        printf("Extensions: %llu, %llu bytes of extension pages\n",
+               (u64)(database.ext_index.entries.count - EXT_ID_FIRST),
+               (u64)(database.ext_index.pages.count * sizeof(ext_page)));
+
+        struct { char *ext_text; char *scan_text; } queries[] = {
+            { "ext:pdf",                ".pdf"          },
+            { "ext:dwg",                ".dwg"          },
+            { "ext:jpg;png",            ".jpg"          },
+            { "report ext:pdf",         "report .pdf"   },
+            { "ext:nope",               ".nope"         },
+        };
+
+        for (int i = 0; i < countof(queries); i++) {
+            quickfind_params params = { 0 };
+            params.return_count = 100;
+            params.stop_count   = UINT64_MAX;
+            params.skip_count   = 0;
+            params.text         = queries[i].ext_text;
+            params.text_length  = (u32)strlen(queries[i].ext_text);
+
+            query_result ext_result = { 0 };
+            f64 ext_time = cli_bench_run_query(&params, &database, null, 20, &ext_result);
+
+            params.text        = queries[i].scan_text;
+            params.text_length = (u32)strlen(queries[i].scan_text);
+
+            query_result scan_result = { 0 };
+            f64 scan_time = cli_bench_run_query(&params, &database, null, 20, &scan_result);
+
+            printf("Ext: %f ms Scan: %f ms (count = %llu, scan count = %llu) (\"%s\" vs \"%s\")\n",
+                   ext_time, scan_time, ext_result.found_count, scan_result.found_count,
+                   queries[i].ext_text, queries[i].scan_text);
+        }
+
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark sorted queries against unsorted queries
+    if (argc >= 2 && _strcmpi(argv[1], "bench-sort") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        // NOTE(rune): Relevance ranking needs the depths from the directory tree.
+        dir_tree_build(&database);
+
+        query_pool pool;
+        query_pool_create(&pool, query_pool_default_thread_count());
+
+        printf("Threads: %u\n", pool.thread_count);
+
+        char *texts[] = { "report", "e", "ext:pdf" };
+
+        struct { quickfind_sort sort; char *name; } sorts[] = {
+            { QUICKFIND_SORT_NONE,                              "none"      },
+            { QUICKFIND_SORT_NAME,                              "name"      },
+            { QUICKFIND_SORT_PATH,                              "path"      },
+            { QUICKFIND_SORT_SIZE | QUICKFIND_SORT_DESCENDING,  "size desc" },
+            { QUICKFIND_SORT_DATE | QUICKFIND_SORT_DESCENDING,  "date desc" },
+            { QUICKFIND_SORT_RELEVANCE,                         "relevance" },
+        };
+
+        for (int i = 0; i < countof(texts); i++) {
+            for (int j = 0; j < countof(sorts); j++) {
+                quickfind_params params = { 0 };
+                params.return_count = 100;
+                params.stop_count   = UINT64_MAX;
+                params.skip_count   = 0;
+                params.text         = texts[i];
+                params.text_length  = (u32)strlen(texts[i]);
+                params.sort         = sorts[j].sort;
+
+                query_result result = { 0 };
+                f64 time = cli_bench_run_query(&params, &database, &pool, 20, &result);
+
+                printf("%f ms (count = %llu) (\"%s\" sorted by %s)\n", time, result.found_count, texts[i], sorts[j].name);
+            }
+        }
+
+        query_pool_destroy(&pool);
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark building result paths with the parent path cache against walking all ancestors of each hit
+    if (argc >= 2 && _strcmpi(argv[1], "bench-paths") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        buffer cached_buffer = { .data = heap_alloc(MEGABYTES(64), false), .capacity = MEGABYTES(64) };
+        buffer walked_buffer = { .data = heap_alloc(MEGABYTES(64), false), .capacity = MEGABYTES(64) };
+
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER performance_count_start;
+        LARGE_INTEGER performance_count_end;
+
+        QueryPerformanceFrequency(&frequency);
+
+        // NOTE(rune): Like the hits of a broad query, where neighbouring hits often share a directory.
+        u32 steps[] = { 1, 7, 101 };
+        for (int i = 0; i < countof(steps); i++) {
+            f64 times[2] = { 0 };
+            u32 item_count = 0;
+
+            for (int with_cache = 0; with_cache < 2; with_cache++) {
+                buffer *result_buffer = with_cache ? &cached_buffer : &walked_buffer;
+                buffer_reset(result_buffer);
+                item_count = 0;
+
+                static path_cache paths;
+                path_cache_init(&paths);
+
+                QueryPerformanceCounter(&performance_count_start);
+                for (usize record_index = 0; record_index < database.record_array.count && item_count < 100000; record_index += steps[i]) {
+                    query_push_result_item(&database.record_array.elems[record_index], &database, result_buffer, with_cache ? &paths : null);
+                    item_count++;
+                }
+                QueryPerformanceCounter(&performance_count_end);
+
+                LONGLONG performance_diff = performance_count_end.QuadPart - performance_count_start.QuadPart;
+                times[with_cache] = ((f64)performance_diff * 1000.0) / ((f64)frequency.QuadPart);
+            }
+
+            bool same = (cached_buffer.size == walked_buffer.size && memcmp(cached_buffer.data, walked_buffer.data, cached_buffer.size) == 0);
+
+            printf("Cached: %f ms Walked: %f ms (step = %u, items = %u, %s)\n",
+                   times[1], times[0], steps[i], item_count, same ? "same paths" : ANSI_FG_RED "DIFFERENT PATHS" ANSI_RESET);
+        }
+
+        heap_free(cached_buffer.data);
+        heap_free(walked_buffer.data);
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark full name queries with the name index against scanning the name buffer
+    if (argc >= 2 && _strcmpi(argv[1], "bench-fullname") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        // NOTE(rune): Names taken from the database, so each query has at least one hit.
+        usize record_indices[] = { 1, database.record_array.count / 3, database.record_array.count - 1 };
+        char *strings[countof(record_indices)];
+        for (int i = 0; i < countof(record_indices); i++) {
+            strings[i] = db_get_record_name(&database, &database.record_array.elems[record_indices[i]]);
+        }
+
+        quickfind_flags flags[] = { QUICKFIND_FLAG_FULLNAME, QUICKFIND_FLAG_FULLNAME | QUICKFIND_FLAG_CASE_SENSITIVE };
+        bool same = cli_bench_compare(&database, "Index", "Scan", strings, countof(strings), flags, countof(flags), 100, cli_toggle_name_index);
+
+        cli_bench_teardown(&database);
+        return same ? 0 : 1;
+    }
+
+    // rune: Benchmark count-only queries with reachability from the directory tree against walking the ancestors of each hit
+    if (argc >= 2 && _strcmpi(argv[1], "bench-reachable") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        dir_tree_build(&database);
+
+        char *strings[]         = { "e", "re", "report", "final_notes" };
+        quickfind_flags flags[] = { 0 };
+        bool same = cli_bench_compare(&database, "Tree", "Walk", strings, countof(strings), flags, countof(flags), 0, cli_toggle_dir_tree);
+
+        cli_bench_teardown(&database);
+        return same ? 0 : 1;
+    }
+
+    // rune: Benchmark directory only queries against the directory names, against scanning all names
+    if (argc >= 2 && _strcmpi(argv[1], "bench-dirs") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        printf("Directories: %llu, %llu bytes of directory names\n",
+               (u64)database.dir_names.records.count, (u64)database.dir_names.names.count);
+
+        char *strings[]         = { "e", "re", "report", "Final_Notes", "" };
+        quickfind_flags flags[] = { QUICKFIND_FLAG_ONLY_DIRECTORIES, QUICKFIND_FLAG_ONLY_DIRECTORIES | QUICKFIND_FLAG_CASE_SENSITIVE };
+        bool same = cli_bench_compare(&database, "Dirs", "Scan", strings, countof(strings), flags, countof(flags), 100, cli_toggle_dir_names);
+
+        cli_bench_teardown(&database);
+        return same ? 0 : 1;
+    }
+
+    // rune: Benchmark the specialized scan of each flag combination against the generic loop
+    if (argc >= 2 && _strcmpi(argv[1], "bench-variants") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        // NOTE(rune): Without the copy of the directory names, directory only queries scan like the others.
+        dir_names_destroy(&database.dir_names);
+        dir_tree_build(&database);
+
+        char *strings[]        = { "e", "report" };
+        quickfind_flags only[] = { 0, QUICKFIND_FLAG_ONLY_FILES, QUICKFIND_FLAG_ONLY_DIRECTORIES };
+        u32 return_counts[]    = { 0, 100 };
+
+        quickfind_flags flags[2 * 2 * countof(only)];
+        u32 flags_count = 0;
+        for (int case_sensitive = 0; case_sensitive < 2; case_sensitive++) {
+            for (int fullname = 0; fullname < 2; fullname++) {
+                for (int j = 0; j < countof(only); j++) {
+                    flags[flags_count++] = ((case_sensitive ? QUICKFIND_FLAG_CASE_SENSITIVE : 0) |
+                                            (fullname ? QUICKFIND_FLAG_FULLNAME : 0) |
+                                            only[j]);
+                }
+            }
+        }
+
+        bool same = true;
+        for (int k = 0; k < countof(return_counts); k++) {
+            same &= cli_bench_compare(&database, "Variant", "Generic", strings, countof(strings), flags, flags_count, return_counts[k], cli_toggle_scan_variants);
+        }
+
+        cli_bench_teardown(&database);
+        return same ? 0 : 1;
+    }
+
+    // rune: Benchmark substring queries anchored on the rarest needle bytes against the first and last byte
+    if (argc >= 2 && _strcmpi(argv[1], "bench-anchors") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        char *strings[]         = { "e.txt", "sss", "re", "e_n", "report", "data.json", "final notes" };
+        quickfind_flags flags[] = { 0, QUICKFIND_FLAG_CASE_SENSITIVE };
+        bool same = cli_bench_compare(&database, "Rare", "First/last", strings, countof(strings), flags, countof(flags), 100, cli_toggle_rare_anchors);
+
+        cli_bench_teardown(&database);
+        return same ? 0 : 1;
+    }
+
+    // rune: Benchmark rare term queries with the bigram filters against scanning every block
+    if (argc >= 2 && _strcmpi(argv[1], "bench-bigrams") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        printf("Bigram filters: %llu bytes\n",
+               (u64)(database.bigram_filter_array.count * sizeof(bigram_filter)));
+
+        char *strings[]         = { "qz", "xyz.dll", "K\xc3\xb8" "benhavn", "\xd0\x9c\xd0\xbe\xd1\x81", "readme.md", "report" };
+        quickfind_flags flags[] = { 0, QUICKFIND_FLAG_CASE_SENSITIVE };
+
+        for (int i = 0; i < countof(strings); i++) {
+            for (int j = 0; j < countof(flags); j++) {
+                bool case_sensitive = (flags[j] & QUICKFIND_FLAG_CASE_SENSITIVE) != 0;
+                usize text_length   = strlen(strings[i]);
+
+                // NOTE(rune): Same needle filter as query_iter_init builds.
+                char folded_text[DB_MAX_NAME_LENGTH];
+                char *text = strings[i];
+                if (!case_sensitive) {
+                    fold_utf8(strings[i], text_length, folded_text);
+                    text = folded_text;
+                }
+
+                bigram_filter needle_filter = { 0 };
+                bigram_filter_add_needle(&needle_filter, text, text_length, case_sensitive);
+
+                usize block_count = database.bigram_filter_array.count;
+                usize read_count  = 0;
+                for (usize block = 0; block < block_count; block++) {
+                    read_count += bigram_filter_may_match(&database, block, &needle_filter);
+                }
+
+                printf("Blocks read: %5.1f%% (\"%s\"%s)\n",
+                       100.0 * (f64)read_count / (f64)max(block_count, 1),
+                       strings[i], case_sensitive ? " case sensitive" : "");
+            }
+        }
+
+        bool same = cli_bench_compare(&database, "Filter", "Scan", strings, countof(strings), flags, countof(flags), 100, cli_toggle_bigram_filters);
+
+        cli_bench_teardown(&database);
+        return same ? 0 : 1;
+    }
+
+    // rune: Benchmark in: queries with directory intervals against walking the ancestors of each record
+    if (argc >= 2 && _strcmpi(argv[1], "bench-scope") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        dir_tree_build(&database);
+
+        // NOTE(rune): Directories created early in the synthetic database have the largest subtrees.
+        usize first_record_indices[] = { 2, database.record_array.count / 100, database.record_array.count / 10 };
+        char *prefixes[]             = { "", "report " };
+
+        static char text_storage[countof(first_record_indices) * countof(prefixes)][256 * 256 + 64];
+        char *strings[countof(text_storage)];
+        u32 string_count = 0;
+
+        for (int i = 0; i < countof(first_record_indices); i++) {
+            usize record_index = first_record_indices[i];
+            while (record_index < database.record_array.count &&
+                   !(database.record_array.elems[record_index].attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                record_index++;
+            }
+
+            static char path[256 * 256];
+            record *ancestors[256];
+            if (record_index >= database.record_array.count ||
+                !walk_ancestors_build_path(&database.record_array.elems[record_index], &database, ancestors, countof(ancestors), path, sizeof(path))) {
+                continue;
+            }
+
+            for (int j = 0; j < countof(prefixes); j++) {
+                char *text = text_storage[string_count];
+                snprintf(text, sizeof(text_storage[0]), "%sin:\"%s\"", prefixes[j], path);
+                strings[string_count++] = text;
+            }
+        }
+
+        quickfind_flags flags[] = { 0 };
+        bool same = cli_bench_compare(&database, "Intervals", "Walk", strings, string_count, flags, countof(flags), 100, cli_toggle_dir_tree);
+
+        cli_bench_teardown(&database);
+        return same ? 0 : 1;
+    }
+
+    // rune: Benchmark search-as-you-type queries with a query session against full queries
+    if (argc >= 2 && _strcmpi(argv[1], "bench-refine") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        query_pool pool;
+        query_pool_create(&pool, query_pool_default_thread_count());
+
+        printf("Threads: %u\n", pool.thread_count);
+
+        buffer result_buffer = {
+            .data     = heap_alloc(MEGABYTES(1), false),
+            .capacity = MEGABYTES(1),
+        };
+
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER performance_count_start;
+        LARGE_INTEGER performance_count_end;
+
+        QueryPerformanceFrequency(&frequency);
+
+        char *text             = "report final";
+        u32 text_length        = (u32)strlen(text);
+        u32 iteration_count    = 20;
+        quickfind_flags flags[] = { QUICKFIND_FLAG_NORMAL, QUICKFIND_FLAG_FUZZY };
+
+        for (int i = 0; i < countof(flags); i++) {
+            f64 session_times[64] = { 0 };
+
+            // NOTE(rune): Each iteration types the whole text into a new session, one character at a time.
+            for (u32 iteration = 0; iteration < iteration_count; iteration++) {
+                query_session session = { 0 };
+
+                for (u32 length = 1; length <= text_length; length++) {
+                    quickfind_params params = { 0 };
+                    params.return_count = 100;
+                    params.stop_count   = UINT64_MAX;
+                    params.text         = text;
+                    params.text_length  = length;
+                    params.flags        = flags[i];
+
+                    buffer_reset(&result_buffer);
+
+                    QueryPerformanceCounter(&performance_count_start);
+                    run_query_session(params, &result_buffer, &database, &pool, &session);
+                    QueryPerformanceCounter(&performance_count_end);
+
+                    LONGLONG performance_diff = performance_count_end.QuadPart - performance_count_start.QuadPart;
+                    session_times[length] += ((f64)performance_diff * 1000.0) / ((f64)frequency.QuadPart);
+                }
+
+                query_session_reset(&session);
+            }
+
+            for (u32 length = 1; length <= text_length; length++) {
+                quickfind_params params = { 0 };
+                params.return_count = 100;
+                params.stop_count   = UINT64_MAX;
+                params.text         = text;
+                params.text_length  = length;
+                params.flags        = flags[i];
+
+                query_result result = { 0 };
+                f64 full_time = cli_bench_run_query(&params, &database, &pool, iteration_count, &result);
+
+                printf("Session: %f ms Full: %f ms (count = %llu) (\"%.*s\"%s)\n",
+                       session_times[length] / iteration_count, full_time, result.found_count,
+                       length, text, flags[i] == QUICKFIND_FLAG_FUZZY ? " fuzzy" : "");
+            }
+        }
+
+        heap_free(result_buffer.data);
+        query_pool_destroy(&pool);
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Benchmark deep pages with skip_count against resuming from the cursor of the previous page
+    if (argc >= 2 && _strcmpi(argv[1], "bench-cursor") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        buffer result_buffer = {
+            .data     = heap_alloc(MEGABYTES(1), false),
+            .capacity = MEGABYTES(1),
+        };
+
+        char *text       = "e";
+        u32 page_size    = 100;
+        u32 pages[]      = { 1, 10, 100, 500, 2000 };
+
+        for (int i = 0; i < countof(pages); i++) {
+            quickfind_params params = { 0 };
+            params.return_count = page_size;
+            params.skip_count   = (u64)(pages[i] - 1) * page_size;
+            params.stop_count   = params.skip_count + page_size;
+            params.text         = text;
+            params.text_length  = (u32)strlen(text);
+
+            // NOTE(rune): The cursor comes from the page before, as when scrolling.
+            quickfind_params previous_params = params;
+            previous_params.skip_count = params.skip_count >= page_size ? params.skip_count - page_size : 0;
+            previous_params.stop_count = previous_params.skip_count + page_size;
+
+            buffer_reset(&result_buffer);
+            query_result previous_result = run_query(previous_params, &result_buffer, &database, null);
+            quickfind_cursor cursor      = query_cursor_next(&previous_params, &previous_result, &database);
+
+            query_result skip_result = { 0 };
+            f64 skip_time = cli_bench_run_query(&params, &database, null, 20, &skip_result);
+
+            params.cursor = cursor;
+            query_result cursor_result = { 0 };
+            f64 cursor_time = cli_bench_run_query(&params, &database, null, 20, &cursor_result);
+
+            printf("Skip: %f ms Cursor: %f ms (page = %u, returned = %u/%u)\n",
+                   skip_time, cursor_time, pages[i], skip_result.return_count, cursor_result.return_count);
+        }
+
+        heap_free(result_buffer.data);
+        cli_bench_teardown(&database);
+        return 0;
+    }
+
+    // rune: Compare the candidate verification of every SIMD kernel against the scalar kernel, on names
+    // built from a tiny alphabet, so that most candidates match the needle for a long way before failing
+    if (argc >= 2 && _strcmpi(argv[1], "bench-verify") == 0) {
+        usize corpus_size = argc >= 3 ? atoi(argv[2]) : MEGABYTES(4);
+        char *corpus      = heap_alloc(corpus_size + DB_NAME_BUFFER_PADDING, true);
+        u32 state         = 1234;
+
+        // NOTE(rune): Names of up to 300 bytes, so needles longer than every vector width can match.
+        usize corpus_length = 0;
+        while (corpus_length + 301 < corpus_size) {
+            u32 name_length = 1 + synthetic_random(&state) % 300;
+            for (u32 i = 0; i < name_length; i++) {
+                corpus[corpus_length++] = "aaaaaaab"[synthetic_random(&state) % 8];
+            }
+
+            corpus[corpus_length++] = '\0';
+        }
+
+        u64 byte_counts[256] = { 0 };
+        for (usize i = 0; i < corpus_length; i++) {
+            byte_counts[(u8)corpus[i]]++;
+        }
+
+        // NOTE(rune): For each length, one needle cut from a name, and copies of it with the middle or
+        // last byte changed, which mostly fail late in the verification.
+        usize lengths[] = { 2, 3, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 200 };
+        char needles[countof(lengths) * 3][DB_MAX_NAME_LENGTH];
+        usize needle_lengths[countof(lengths) * 3];
+        u32 needle_count = 0;
+
+        for (int i = 0; i < countof(lengths); i++) {
+            usize k = lengths[i];
+
+            char *needle = needles[needle_count];
+            memset(needle, 'a', k);
+
+            for (u32 attempt = 0; attempt < 1000; attempt++) {
+                usize offset = synthetic_random(&state) % (corpus_length - k);
+                if (!memchr(corpus + offset, '\0', k)) {
+                    memcpy(needle, corpus + offset, k);
+                    break;
+                }
+            }
+
+            memcpy(needles[needle_count + 1], needle, k);
+            memcpy(needles[needle_count + 2], needle, k);
+            needles[needle_count + 1][k / 2] ^= 'a' ^ 'b';
+            needles[needle_count + 2][k - 1] ^= 'a' ^ 'b';
+
+            for (u32 j = 0; j < 3; j++) {
+                needle_lengths[needle_count++] = k;
+            }
+        }
+
+        u64 expected_match_counts[countof(needle_lengths)] = { 0 };
+        u64 expected_checksums[countof(needle_lengths)]    = { 0 };
+        bool mismatch = false;
+
+        simd_level detected_level = g_simd_detected_level;
+
+        for (simd_level level = SIMD_LEVEL_SCALAR; level <= detected_level; level++) {
+            simd_set_level(level);
+
+            LARGE_INTEGER frequency;
+            LARGE_INTEGER performance_count_start;
+            LARGE_INTEGER performance_count_end;
+
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&performance_count_start);
+
+            for (u32 i = 0; i < needle_count; i++) {
+                char *needle = needles[i];
+                usize k      = needle_lengths[i];
+
+                usize rare_a = 0;
+                usize rare_b = 0;
+                query_pick_anchors(byte_counts, needle, k, &rare_a, &rare_b);
+
+                struct { bool anchored; usize a; usize b; } modes[] = {
+                    { false, 0,      0      },
+                    { true,  rare_a, rare_b },
+                    { true,  0,      1      },
+                    { true,  k - 2,  k - 1  },
+                };
+
+                for (int j = 0; j < countof(modes); j++) {
+                    u64 match_count = 0;
+                    u64 checksum    = 0;
+                    cli_scan_checksum(corpus, corpus_length, needle, k, modes[j].anchored, modes[j].a, modes[j].b, &match_count, &checksum);
+
+                    if (level == SIMD_LEVEL_SCALAR && j == 0) {
+                        expected_match_counts[i] = match_count;
+                        expected_checksums[i]    = checksum;
+                    } else if (match_count != expected_match_counts[i] || checksum != expected_checksums[i]) {
+                        mismatch = true;
+                        printf("Kernel %s does not match scalar kernel (length %llu, %s anchors %llu/%llu)\n",
+                               g_simd_kernels[level].name, (u64)k, modes[j].anchored ? "with" : "without",
+                               (u64)modes[j].a, (u64)modes[j].b);
+                    }
+                }
+            }
+
+            QueryPerformanceCounter(&performance_count_end);
+
+            LONGLONG performance_diff = performance_count_end.QuadPart - performance_count_start.QuadPart;
+            printf("Kernel: %-8s %f ms (%u needles)\n",
+                   g_simd_kernels[level].name, ((f64)performance_diff * 1000.0) / ((f64)frequency.QuadPart), needle_count);
+        }
+
+        simd_set_level(detected_level);
+        heap_free(corpus);
+        return mismatch ? 1 : 0;
+    }
+
+    // rune: Benchmark each SIMD kernel supported by the CPU against a synthetic database
+    if (argc >= 2 && _strcmpi(argv[1], "bench-kernels") == 0) {
+        db database;
+        cli_bench_setup(&database, argc, argv);
+
+        char *names      = database.name_buffer.elems;
+        usize names_size = database.name_buffer.count;
+
+        struct { char *text; quickfind_flags flags; } needles[] = {
+            { "report",                 QUICKFIND_FLAG_CASE_SENSITIVE },
+            { "report",                 0 },
+            { "abcdefghjiasdjkalsddhj", QUICKFIND_FLAG_CASE_SENSITIVE },
+            { "abcdefghjiasdjkalsddhj", 0 },
+            { "Q",                      QUICKFIND_FLAG_CASE_SENSITIVE },
+            { "q",                      0 },
+        };
+
+        u64 expected_match_counts[countof(needles)] = { 0 };
+        u64 expected_checksums[countof(needles)]    = { 0 };
+        usize expected_null_count = 0;
+        bool mismatch = false;
+
+        simd_level detected_level = g_simd_detected_level;
+
+        for (simd_level level = SIMD_LEVEL_SCALAR; level <= detected_level; level++) {
+            simd_set_level(level);
+
+            for (int i = 0; i < countof(needles); i++) {
+                u64 match_count = 0;
+                u64 checksum    = 0;
+                f64 throughput  = cli_bench_scan_kernel(names, names_size,
+                                                        needles[i].text, strlen(needles[i].text), needles[i].flags,
+                                                        10, &match_count, &checksum);
+
+                if (level == SIMD_LEVEL_SCALAR) {
+                    expected_match_counts[i] = match_count;
+                    expected_checksums[i]    = checksum;
+                } else if (match_count != expected_match_counts[i] || checksum != expected_checksums[i]) {
+                    mismatch = true;
+                    printf("Kernel %s does not match scalar kernel (\"%s\")\n", g_simd_kernels[level].name, needles[i].text);
+                }
+
+                printf("Kernel: %-8s %7.2f GB/s (count = %llu) (\"%s\", %s)\n",
+                       g_simd_kernels[level].name, throughput, match_count, needles[i].text,
+                       (needles[i].flags & QUICKFIND_FLAG_CASE_SENSITIVE) ? "case sensitive" : "case insensitive");
+            }
+
+            LARGE_INTEGER frequency;
+            LARGE_INTEGER performance_count_start;
+            LARGE_INTEGER performance_count_end;
+
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&performance_count_start);
+
+            usize null_count = 0;
+            for (u32 i = 0; i < 10; i++) {
+                null_count = simd_count_zeroes(names, names_size);
+            }
+
+            QueryPerformanceCounter(&performance_count_end);
+
+            LONGLONG performance_diff = performance_count_end.QuadPart - performance_count_start.QuadPart;
+            f64 seconds = (f64)performance_diff / (f64)frequency.QuadPart;
+
+            if (level == SIMD_LEVEL_SCALAR) {
+                expected_null_count = null_count;
+            } else if (null_count != expected_null_count) {
+                mismatch = true;
+                printf("Kernel %s does not match scalar kernel (count zeroes)\n", g_simd_kernels[level].name);
+            }
+
+            printf("Kernel: %-8s %7.2f GB/s (count = %llu) (count zeroes)\n",
+                   g_simd_kernels[level].name, ((f64)names_size * 10.0) / seconds / 1e9, (u64)null_count);
+        }
+
+        simd_set_level(detected_level);
+
+        // NOTE(rune): Case insensitive queries used to run the nocase kernels on the name buffer,
+        // but now run the case sensitive kernels on the folded name buffer, with a folded needle.
+        printf("Folded name buffer: %llu bytes (%.1f%% of names)\n",
+               (u64)database.folded_name_buffer.count,
+               100.0 * (f64)database.folded_name_buffer.count / (f64)names_size);
+
+        char *nocase_needles[] = { "report", "abcdefghjiasdjkalsddhj", "q", "K\xc3\x98" "BENHAVN" };
+
+        for (int i = 0; i < countof(nocase_needles); i++) {
+            char folded_needle[DB_MAX_NAME_LENGTH];
+            usize needle_length = strlen(nocase_needles[i]);
+            fold_utf8(nocase_needles[i], needle_length, folded_needle);
+
+            u64 nocase_count = 0;
+            u64 folded_count = 0;
+            u64 checksum     = 0;
+
+            f64 nocase_throughput = cli_bench_scan_kernel(names, names_size, nocase_needles[i], needle_length,
+                                                          0, 10, &nocase_count, &checksum);
+            f64 folded_throughput = cli_bench_scan_kernel(database.folded_name_buffer.elems, names_size, folded_needle, needle_length,
+                                                          QUICKFIND_FLAG_CASE_SENSITIVE, 10, &folded_count, &checksum);
+
+            printf("Nocase: %7.2f GB/s (count = %llu) Folded: %7.2f GB/s (count = %llu) Speedup: %.2fx (\"%s\")\n",
+                   nocase_throughput, nocase_count, folded_throughput, folded_count,
+                   folded_throughput / nocase_throughput, nocase_needles[i]);
+        }
+
+        cli_bench_teardown(&database);
+        return mismatch ? 1 : 0;
+    }
+
     // rune: If there's not arguments we assume the service control manager started the exe.
     if (argc == 1) {
         SERVICE_TABLE_ENTRYA dispatch_table[] =
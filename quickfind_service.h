@@ -27,4 +27,6 @@ static void WINAPI svc_main(DWORD dwArgc, LPSTR *lpszArgv);
 ////////////////////////////////////////////////////////////////
 // rune: CLI
 
+static f64 cli_bench_run_query(quickfind_params *params, db *database, query_pool *pool, u32 iteration_count, query_result *last_result);
+static f64 cli_bench_scan_kernel(char *s, usize n, char *needle, usize k, quickfind_flags flags, u32 iteration_count, u64 *match_count, u64 *checksum);
 static int cli_main(int argc, char **argv);
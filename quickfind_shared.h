@@ -114,26 +114,42 @@ enum msg_type {
     MSG_TYPE_NONE,
     MSG_TYPE_QUERY_REQUEST,      // msg_query_request
     MSG_TYPE_QUERY_RESPONSE,     // msg_query_response
+    MSG_TYPE_STATS_REQUEST,      // no head data
+    MSG_TYPE_STATS_RESPONSE,     // msg_stats_response
 };
 
 typedef struct msg_query_request msg_query_request;
 struct msg_query_request {
     u32 return_count;     // NOTE(rune): Number of results to return
     u64 skip_count;       // NOTE(rune): Number of results to skip before beginning to return results. Useful for pagination or scrolling lists.
-    u64 stop_count;       // NOTE(rune): Run query until stop_count number of results is found.
+    u64 stop_count;       // NOTE(rune): Run query until stop_count number of results is found. Sorted and fuzzy queries visit every result, but found_count is still capped at stop_count.
     quickfind_flags flags;
+    quickfind_sort sort;  // NOTE(rune): The server selects the first skip_count + return_count results in sort order.
+    quickfind_cursor cursor;
 };
 
 typedef struct msg_query_response msg_query_response;
 struct msg_query_response {
     u64 found_count;
     u32 return_count;
+    quickfind_cursor next_cursor; // NOTE(rune): Zeroed for sorted and fuzzy queries, or if nothing was returned.
+};
+
+typedef struct msg_stats_response msg_stats_response;
+struct msg_stats_response {
+    u64 query_count;
+    u64 query_cache_hit_count;
+    u64 query_cache_miss_count;
+    u32 query_cache_entry_count;
+    u64 query_cache_size;
 };
 
 // NOTE(rune): Variably sized struct, total size is sizeof(query_result_item_t) + path_size
 typedef struct query_result_item query_result_item;
 struct query_result_item {
     u64 id;
+    u64 size;
+    u64 modification_time; // NOTE(rune): As a FILETIME.
     u32 attributes;
 
     // NOTE(rune): Including null terminator
@@ -149,6 +165,7 @@ struct msg {
         union {
             msg_query_request query_request;
             msg_query_response query_response;
+            msg_stats_response stats_response;
         };
 
         u32 body_size;